@@ -45,6 +45,7 @@
 #include "package.h"
 #include "db.h"
 #include "remove.h"
+#include "store.h"
 #include "handle.h"
 
 /** Add a package to the transaction. */
@@ -146,6 +147,171 @@ static int try_rename(alpm_handle_t *handle, const char *src, const char *dest)
 	return 0;
 }
 
+/* State for creating new files directly in cached parent directories. */
+struct fast_extract {
+	alpm_dirstack_t dirs;
+	size_t written;
+	/* ownership is only restored when running as root */
+	uid_t euid;
+	gid_t egid;
+	/* set while no entry other than a directory existed before */
+	int fresh;
+	/* archive metadata of directories which already existed */
+	alpm_list_t *olddirs;
+};
+
+static void warn_extraction(alpm_handle_t *handle, const char *filename,
+		const char *what)
+{
+	_alpm_log(handle, ALPM_LOG_WARNING, _("warning given when extracting %s (%s)\n"),
+			filename, what);
+}
+
+/* Remember what a regular file looks like right after it was extracted, so
+ * file checks can tell whether it was touched since. Files left alone, such
+ * as NoExtract, NoUpgrade or modified backup files, are never stamped. */
+static void add_filestamp(alpm_handle_t *handle, alpm_pkg_t *newpkg,
+		const char *name, const char *path)
+{
+	alpm_filestamp_t *stamp;
+	struct stat st;
+
+	if(!handle->filestamps || newpkg->stamps_count >= newpkg->files.count) {
+		return;
+	}
+	if(lstat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return;
+	}
+	if(newpkg->stamps == NULL) {
+		CALLOC(newpkg->stamps, newpkg->files.count, sizeof(alpm_filestamp_t),
+				return);
+	}
+
+	stamp = newpkg->stamps + newpkg->stamps_count;
+	STRDUP(stamp->name, name, return);
+	stamp->dev = st.st_dev;
+	stamp->ino = st.st_ino;
+	stamp->size = st.st_size;
+	stamp->mtime = st.st_mtime;
+	stamp->ctime = st.st_ctime;
+	newpkg->stamps_count++;
+}
+
+/**
+ * Create a regular file or symlink from an archive entry relative to its
+ * cached parent directory, bypassing the libarchive disk writer. Files are
+ * only ever created here, never replaced, so anything already on disk still
+ * goes through all the checks in extract_single_file().
+ * @param handle the context handle
+ * @param archive the package archive
+ * @param entry the entry to extract
+ * @param entryname the entry path relative to the root
+ * @param filename the full path of the entry, for messages
+ * @param fe the fast extraction state
+ * @return 0 if the entry was extracted, 1 on a fatal error, -1 if the entry
+ * needs to be extracted the regular way
+ */
+static int extract_new_file_fast(alpm_handle_t *handle, struct archive *archive,
+		struct archive_entry *entry, const char *entryname, const char *filename,
+		struct fast_extract *fe)
+{
+	mode_t entrymode = archive_entry_mode(entry);
+	mode_t perms = entrymode & 07777;
+	uid_t uid = archive_entry_uid(entry);
+	gid_t gid = archive_entry_gid(entry);
+	int restore_owner = fe->euid == 0;
+	struct timespec times[2];
+	char name[PATH_MAX];
+	int dirfd, fd, ret;
+
+	if((!S_ISREG(entrymode) && !S_ISLNK(entrymode))
+			|| archive_entry_hardlink(entry) != NULL) {
+		return -1;
+	}
+
+	/* refuses to open symlinked parents like ARCHIVE_EXTRACT_SECURE_SYMLINKS */
+	dirfd = _alpm_dirstack_parent(&fe->dirs, entryname, name, PATH_MAX);
+	if(dirfd < 0) {
+		return -1;
+	}
+
+	times[0].tv_sec = archive_entry_atime(entry);
+	times[0].tv_nsec = archive_entry_atime_is_set(entry) ?
+		archive_entry_atime_nsec(entry) : UTIME_NOW;
+	times[1].tv_sec = archive_entry_mtime(entry);
+	times[1].tv_nsec = archive_entry_mtime_is_set(entry) ?
+		archive_entry_mtime_nsec(entry) : UTIME_NOW;
+
+	if(S_ISLNK(entrymode)) {
+		if(symlinkat(archive_entry_symlink(entry), dirfd, name) != 0) {
+			return -1;
+		}
+		if((restore_owner && fchownat(dirfd, name, uid, gid, AT_SYMLINK_NOFOLLOW) != 0)
+				|| utimensat(dirfd, name, times, AT_SYMLINK_NOFOLLOW) != 0) {
+			warn_extraction(handle, filename, strerror(errno));
+		}
+		fe->written++;
+		return 0;
+	}
+
+	do {
+		fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW
+				| O_CLOEXEC | O_BINARY, 0600);
+	} while(fd == -1 && errno == EINTR);
+	if(fd < 0) {
+		/* most likely EEXIST, let the regular path sort it out */
+		return -1;
+	}
+
+#ifdef HAVE_FALLOCATE
+	if(archive_entry_size(entry) > 0 && !_alpm_archive_entry_is_sparse(entry)) {
+		/* only a hint to reduce fragmentation, not every filesystem has it */
+		(void)fallocate(fd, 0, 0, archive_entry_size(entry));
+	}
+#endif
+
+	ret = archive_read_data_into_fd(archive, fd);
+	if(ret == ARCHIVE_WARN && archive_errno(archive) != ENOSPC) {
+		warn_extraction(handle, filename, archive_error_string(archive));
+	} else if(ret != ARCHIVE_OK) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not extract %s (%s)\n"),
+				filename, archive_error_string(archive));
+		alpm_logaction(handle, ALPM_CALLER_PREFIX,
+				"error: could not extract %s (%s)\n",
+				filename, archive_error_string(archive));
+		close(fd);
+		unlinkat(dirfd, name, 0);
+		return 1;
+	}
+
+	/* like the libarchive writer, never hand out setuid/setgid bits for an
+	 * owner that could not be restored */
+	if(!restore_owner && uid != fe->euid) {
+		perms &= ~S_ISUID;
+	}
+	if(!restore_owner && gid != fe->egid) {
+		perms &= ~S_ISGID;
+	}
+
+	/* ownership first, as changing it drops setuid/setgid bits */
+	if((restore_owner && fchown(fd, uid, gid) != 0) || fchmod(fd, perms) != 0
+			|| futimens(fd, times) != 0) {
+		warn_extraction(handle, filename, strerror(errno));
+	}
+
+	if(close(fd) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not extract %s (%s)\n"),
+				filename, strerror(errno));
+		alpm_logaction(handle, ALPM_CALLER_PREFIX,
+				"error: could not extract %s (%s)\n", filename, strerror(errno));
+		unlinkat(dirfd, name, 0);
+		return 1;
+	}
+
+	fe->written++;
+	return 0;
+}
+
 static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
 		struct archive_entry *entry, alpm_pkg_t *newpkg, const char *entryname)
 {
@@ -170,7 +336,8 @@ static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
 }
 
 static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t *newpkg, alpm_pkg_t *oldpkg)
+		struct archive_entry *entry, alpm_pkg_t *newpkg, alpm_pkg_t *oldpkg,
+		struct fast_extract *fe)
 {
 	const char *entryname = archive_entry_pathname(entry);
 	mode_t entrymode = archive_entry_mode(entry);
@@ -210,6 +377,17 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 		return 0;
 	}
 
+	if(fe) {
+		int ret = extract_new_file_fast(handle, archive, entry, entryname,
+				filename, fe);
+		if(ret == 0) {
+			add_filestamp(handle, newpkg, entryname, filename);
+		}
+		if(ret >= 0) {
+			return ret;
+		}
+	}
+
 	/* Check for file existence. This is one of the more crucial parts
 	 * to get 'right'. Here are the possibilities, with the filesystem
 	 * on the left and the package on the top:
@@ -227,6 +405,16 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	 */
 
 	isnewfile = llstat(filename, &lsbuf) != 0;
+	if(fe && !isnewfile && handle->storedir) {
+		/* the package store may only be populated with what was extracted */
+		if(S_ISDIR(lsbuf.st_mode) && S_ISDIR(entrymode)) {
+			if(_alpm_storedir_add(&fe->olddirs, entry) != 0) {
+				fe->fresh = 0;
+			}
+		} else {
+			fe->fresh = 0;
+		}
+	}
 	if(isnewfile) {
 		/* cases 1,2: file doesn't exist, skip all backup checks */
 	} else if(S_ISDIR(lsbuf.st_mode) && S_ISDIR(entrymode)) {
@@ -318,6 +506,10 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 		backup->hash = alpm_compute_md5sum(filename);
 	}
 
+	if(!notouch && !needbackup) {
+		add_filestamp(handle, newpkg, entryname, filename);
+	}
+
 	if(notouch) {
 		alpm_event_pacnew_created_t event = {
 			.type = ALPM_EVENT_PACNEW_CREATED,
@@ -352,6 +544,8 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 					origfile);
 			if(try_rename(handle, filename, origfile)) {
 				errors++;
+			} else {
+				add_filestamp(handle, newpkg, entryname, origfile);
 			}
 		} else if(hash_orig && hash_pkg && strcmp(hash_orig, hash_pkg) == 0) {
 			/* original and new files are the same, leave the local version alone,
@@ -368,6 +562,8 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 					origfile);
 			if(try_rename(handle, filename, origfile)) {
 				errors++;
+			} else {
+				add_filestamp(handle, newpkg, entryname, origfile);
 			}
 		} else {
 			/* none of the three files matched another,  leave the unpacked
@@ -395,6 +591,26 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	return errors;
 }
 
+/* Record all regular files of a package installed from the package store,
+ * which creates every file except the NoExtract ones. */
+static void record_filestamps(alpm_handle_t *handle, alpm_pkg_t *newpkg)
+{
+	alpm_filelist_t *filelist = &newpkg->files;
+	char path[PATH_MAX];
+	size_t i;
+
+	for(i = 0; i < filelist->count; i++) {
+		const char *name = filelist->files[i].name;
+		if(alpm_option_match_noextract(handle, name) == 0) {
+			/* whatever is there was put there by the user */
+			continue;
+		}
+		if(snprintf(path, PATH_MAX, "%s%s", handle->root, name) < PATH_MAX) {
+			add_filestamp(handle, newpkg, name, path);
+		}
+	}
+}
+
 static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		size_t pkg_current, size_t pkg_count)
 {
@@ -483,7 +699,9 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		struct archive *archive;
 		struct archive_entry *entry;
 		struct stat buf;
-		int fd, cwdfd;
+		struct fast_extract fe, *fastp = NULL;
+		char *storehash = NULL;
+		int fd, cwdfd, from_store = 0;
 
 		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting files\n");
 
@@ -494,6 +712,11 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 			goto cleanup;
 		}
 
+		/* before changing directories, pkgfile may be relative */
+		if(newpkg->backup == NULL && !oldpkg && handle->storedir) {
+			storehash = _alpm_file_sha256sum(handle, pkgfile);
+		}
+
 		/* save the cwd so we can restore it later */
 		OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
 		if(cwdfd < 0) {
@@ -506,14 +729,36 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 					handle->root, strerror(errno));
 			_alpm_archive_read_free(archive);
 			close(fd);
+			free(storehash);
 			ret = -1;
 			goto cleanup;
 		}
 
+		/* without backup files there is nothing to compare or rename, so new
+		 * files can be created directly in their cached parent directories */
+		if(newpkg->backup == NULL
+				&& _alpm_dirstack_open(&fe.dirs, handle->root, O_NOFOLLOW) == 0) {
+			fe.written = 0;
+			fe.euid = geteuid();
+			fe.egid = getegid();
+			fe.fresh = 1;
+			fe.olddirs = NULL;
+			fastp = &fe;
+		}
+
 		/* call PROGRESS once with 0 percent, as we sort-of skip that here */
 		PROGRESS(handle, progress, newpkg->name, 0, pkg_count, pkg_current);
 
-		for(i = 0; archive_read_next_header(archive, &entry) == ARCHIVE_OK; i++) {
+		/* fresh installs can share extents with a pre-extracted copy */
+		if(fastp && storehash) {
+			from_store = _alpm_store_install(handle, newpkg, storehash, &fe.dirs) == 0;
+			if(from_store) {
+				record_filestamps(handle, newpkg);
+			}
+		}
+
+		for(i = 0; !from_store && archive_read_next_header(archive, &entry) == ARCHIVE_OK;
+				i++) {
 			int percent;
 
 			if(newpkg->size != 0) {
@@ -532,11 +777,26 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 			PROGRESS(handle, progress, newpkg->name, percent, pkg_count, pkg_current);
 
 			/* extract the next file from the archive */
-			errors += extract_single_file(handle, archive, entry, newpkg, oldpkg);
+			errors += extract_single_file(handle, archive, entry, newpkg, oldpkg,
+					fastp);
 		}
 		_alpm_archive_read_free(archive);
 		close(fd);
 
+		if(fastp && storehash && !from_store && !errors && fe.fresh) {
+			_alpm_store_add(handle, newpkg, storehash, fe.olddirs);
+		}
+		free(storehash);
+
+		if(fastp) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "created %zu new files directly\n",
+					fe.written);
+			_alpm_dirstack_close(&fe.dirs);
+			alpm_list_free_inner(fe.olddirs, _alpm_storedir_free);
+			alpm_list_free(fe.olddirs);
+		}
+		trans->sync_pending = 1;
+
 		/* restore the old cwd if we have it */
 		if(cwdfd >= 0) {
 			if(fchdir(cwdfd) != 0) {
@@ -567,10 +827,13 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 	/* make an install date (in UTC) */
 	newpkg->installdate = time(NULL);
 
+	/* the files must be on disk before the entry that records them */
+	_alpm_trans_flush(handle, ALPM_DURABILITY_PACKAGE);
+
 	_alpm_log(handle, ALPM_LOG_DEBUG, "updating database\n");
 	_alpm_log(handle, ALPM_LOG_DEBUG, "adding database entry '%s'\n", newpkg->name);
 
-	if(_alpm_local_db_write(db, newpkg, INFRQ_ALL)) {
+	if(_alpm_local_db_write(db, newpkg, INFRQ_ALL | INFRQ_STAMPS)) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not update database entry %s-%s\n"),
 				newpkg->name, newpkg->version);
 		alpm_logaction(handle, ALPM_CALLER_PREFIX,
@@ -580,6 +843,8 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		ret = -1;
 		goto cleanup;
 	}
+	trans->sync_pending = 1;
+	_alpm_trans_flush(handle, ALPM_DURABILITY_PACKAGE);
 
 	if(_alpm_db_add_pkgincache(db, newpkg) == -1) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("could not add entry '%s' in cache\n"),
@@ -191,6 +191,16 @@ typedef enum _alpm_fileconflicttype_t {
 	ALPM_FILECONFLICT_FILESYSTEM
 } alpm_fileconflicttype_t;
 
+/** When changes made by a transaction are flushed to stable storage. */
+typedef enum _alpm_durability_t {
+	/** Never flush; leave write-back to the kernel */
+	ALPM_DURABILITY_NONE = 0,
+	/** Flush once after the whole transaction has been committed */
+	ALPM_DURABILITY_TRANSACTION,
+	/** Flush files, then the database entry, after each package */
+	ALPM_DURABILITY_PACKAGE
+} alpm_durability_t;
+
 /** PGP signature verification options */
 typedef enum _alpm_siglevel_t {
 	ALPM_SIG_PACKAGE = (1 << 0),
@@ -299,6 +309,16 @@ typedef struct _alpm_filelist_t {
 	alpm_file_t *files;
 } alpm_filelist_t;
 
+/** What an installed file looked like on disk right after extraction */
+typedef struct _alpm_filestamp_t {
+	char *name;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	alpm_time_t mtime;
+	alpm_time_t ctime;
+} alpm_filestamp_t;
+
 /** Local package or package file backup entry */
 typedef struct _alpm_backup_t {
 	char *name;
@@ -745,6 +765,44 @@ typedef void (*alpm_cb_download)(const char *filename,
 
 typedef void (*alpm_cb_totaldl)(off_t total);
 
+/** Progress of one byte range of a download split into several. */
+typedef struct _alpm_download_range_t {
+	/** bytes of the range received so far */
+	off_t downloaded;
+	/** size of the range in bytes */
+	off_t total;
+} alpm_download_range_t;
+
+/** A snapshot of a download in progress. */
+typedef struct _alpm_download_progress_t {
+	/** the name of the file being downloaded */
+	const char *filename;
+	/** bytes received so far, 0 on the first snapshot of a file */
+	off_t downloaded;
+	/** the total number of bytes to transfer */
+	off_t total;
+	/** transfer rate in bytes per second, averaged over the whole download
+	 * on the last snapshot */
+	off_t rate;
+	/** estimated seconds left, or -1 if unknown */
+	long eta;
+	/** milliseconds since the first snapshot of the file */
+	unsigned long elapsed;
+	/** number of byte ranges in flight, 0 unless the download is split */
+	size_t nranges;
+	/** progress of each range, nranges entries */
+	const alpm_download_range_t *ranges;
+	/** set on the last snapshot of a file */
+	int done;
+} alpm_download_progress_t;
+
+/** Type of download progress snapshot callbacks.
+ * Snapshots are passed at most once per progress interval, apart from the
+ * first and last of every file.
+ * @param progress the state of the download, valid during the call
+ */
+typedef void (*alpm_cb_dlprogress)(const alpm_download_progress_t *progress);
+
 /** A callback for downloading files
  * @param url the URL of the file to be downloaded
  * @param localpath the directory to which the file should be downloaded
@@ -762,6 +820,57 @@ typedef int (*alpm_cb_fetch)(const char *url, const char *localpath,
  */
 char *alpm_fetch_pkgurl(alpm_handle_t *handle, const char *url);
 
+/** Counters of the transfers made by libcurl for a handle. */
+typedef struct _alpm_dload_stats_t {
+	/** transfers performed, including failed ones */
+	unsigned long transfers;
+	/** connections that had to be opened */
+	unsigned long connects;
+	/** transfers served over a connection that was already open */
+	unsigned long reused;
+} alpm_dload_stats_t;
+
+/** Get the transfer counters of a handle.
+ * All downloads of a handle share one pool of connections, resolved host
+ * names and TLS sessions; these counters show how well it is reused.
+ * @param handle the context handle
+ * @return the counters, valid until the handle is released
+ */
+const alpm_dload_stats_t *alpm_dload_stats(alpm_handle_t *handle);
+
+/** A package file kept in a cache directory. */
+typedef struct _alpm_cachefile_t {
+	/** name the file was downloaded under */
+	char *filename;
+	/** path of the stored contents */
+	char *path;
+	/** package name and version taken from the file name, or NULL if the
+	 * name does not follow the name-pkgver-pkgrel-arch.pkg.tar.* pattern */
+	char *name;
+	char *version;
+	/** whether the file is kept in the index of a hashed cache directory and
+	 * must be removed with alpm_cache_remove_files() */
+	int hashed;
+} alpm_cachefile_t;
+
+/** Get the package files in a cache directory without opening them.
+ * @param handle the context handle
+ * @param cachedir a cache directory as returned by alpm_option_get_cachedirs()
+ * @return a list of alpm_cachefile_t owned by the handle, valid until the
+ * next call or until the cache is modified
+ */
+alpm_list_t *alpm_cache_get_files(alpm_handle_t *handle, const char *cachedir);
+
+/** Remove package files from a hashed cache directory.
+ * Contents and signatures no other name refers to are deleted with them.
+ * @param handle the context handle
+ * @param cachedir a cache directory as returned by alpm_option_get_cachedirs()
+ * @param filenames list of names of the files to remove
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_cache_remove_files(alpm_handle_t *handle, const char *cachedir,
+		alpm_list_t *filenames);
+
 /** @addtogroup alpm_api_options Options
  * Libalpm option getters and setters
  * @{
@@ -777,6 +886,11 @@ alpm_cb_download alpm_option_get_dlcb(alpm_handle_t *handle);
 /** Sets the callback used to report download progress. */
 int alpm_option_set_dlcb(alpm_handle_t *handle, alpm_cb_download cb);
 
+/** Returns the callback used to report download progress snapshots. */
+alpm_cb_dlprogress alpm_option_get_dlprogresscb(alpm_handle_t *handle);
+/** Sets the callback used to report download progress snapshots. */
+int alpm_option_set_dlprogresscb(alpm_handle_t *handle, alpm_cb_dlprogress cb);
+
 /** Returns the downloading callback. */
 alpm_cb_fetch alpm_option_get_fetchcb(alpm_handle_t *handle);
 /** Sets the downloading callback. */
@@ -820,6 +934,18 @@ int alpm_option_add_cachedir(alpm_handle_t *handle, const char *cachedir);
 int alpm_option_remove_cachedir(alpm_handle_t *handle, const char *cachedir);
 /** @} */
 
+/** @name Accessors to the list of package cache peers.
+ * Peers are HTTP servers exporting another machine's package cache. They
+ * are asked for a package before any repository server and are given up
+ * on quickly when they do not answer.
+ * @{
+ */
+alpm_list_t *alpm_option_get_cachepeers(alpm_handle_t *handle);
+int alpm_option_set_cachepeers(alpm_handle_t *handle, alpm_list_t *urls);
+int alpm_option_add_cachepeer(alpm_handle_t *handle, const char *url);
+int alpm_option_remove_cachepeer(alpm_handle_t *handle, const char *url);
+/** @} */
+
 /** @name Accessors to the list of package hook directories.
  * @{
  */
@@ -839,6 +965,11 @@ const char *alpm_option_get_gpgdir(alpm_handle_t *handle);
 /** Sets the path to libalpm's GnuPG home directory. */
 int alpm_option_set_gpgdir(alpm_handle_t *handle, const char *gpgdir);
 
+/** Returns the path of the pre-extracted package store. */
+const char *alpm_option_get_storedir(alpm_handle_t *handle);
+/** Sets the path of the pre-extracted package store, or NULL to disable it. */
+int alpm_option_set_storedir(alpm_handle_t *handle, const char *storedir);
+
 /** Returns whether to use syslog (0 is FALSE, TRUE otherwise). */
 int alpm_option_get_usesyslog(alpm_handle_t *handle);
 /** Sets whether to use syslog (0 is FALSE, TRUE otherwise). */
@@ -913,6 +1044,32 @@ int alpm_option_set_deltaratio(alpm_handle_t *handle, double ratio);
 int alpm_option_get_checkspace(alpm_handle_t *handle);
 int alpm_option_set_checkspace(alpm_handle_t *handle, int checkspace);
 
+int alpm_option_get_filestamps(alpm_handle_t *handle);
+int alpm_option_set_filestamps(alpm_handle_t *handle, int filestamps);
+
+/** Whether to try the servers of a repository in order of how fast they
+ * delivered recent downloads, rather than in configured order. */
+int alpm_option_get_scoremirrors(alpm_handle_t *handle);
+int alpm_option_set_scoremirrors(alpm_handle_t *handle, int scoremirrors);
+
+/** How many byte ranges large package downloads are split into and
+ * fetched from different servers at once; 1 disables splitting. */
+int alpm_option_get_dlsegments(alpm_handle_t *handle);
+int alpm_option_set_dlsegments(alpm_handle_t *handle, int segments);
+
+/** Whether package files are kept in cache directories by the sha256 of
+ * their contents, so identical files are only stored once. */
+int alpm_option_get_hashedcache(alpm_handle_t *handle);
+int alpm_option_set_hashedcache(alpm_handle_t *handle, int hashedcache);
+
+/** The minimum number of milliseconds between two download or operation
+ * progress reports; 0 reports every change. */
+unsigned int alpm_option_get_progressinterval(alpm_handle_t *handle);
+int alpm_option_set_progressinterval(alpm_handle_t *handle, unsigned int msecs);
+
+alpm_durability_t alpm_option_get_durability(alpm_handle_t *handle);
+int alpm_option_set_durability(alpm_handle_t *handle, alpm_durability_t durability);
+
 const char *alpm_option_get_dbext(alpm_handle_t *handle);
 int alpm_option_set_dbext(alpm_handle_t *handle, const char *dbext);
 
@@ -1293,6 +1450,15 @@ alpm_list_t *alpm_pkg_get_replaces(alpm_pkg_t *pkg);
  */
 alpm_filelist_t *alpm_pkg_get_files(alpm_pkg_t *pkg);
 
+/** Returns the stamp recorded for a file when pkg was installed.
+ * Stamps are only recorded while the filestamps option is enabled, and
+ * only for regular files.
+ * @param pkg a pointer to package
+ * @param path the filename relative to the install root
+ * @return a pointer to an internal stamp, or NULL if none was recorded
+ */
+const alpm_filestamp_t *alpm_pkg_get_filestamp(alpm_pkg_t *pkg, const char *path);
+
 /** Returns the list of files backed up when installing pkg.
  * @param pkg a pointer to package
  * @return a reference to a list of alpm_backup_t objects
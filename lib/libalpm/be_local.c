@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdint.h> /* intmax_t */
+#include <inttypes.h> /* strtoimax, strtoumax */
 #include <sys/stat.h>
 #include <dirent.h>
 #include <limits.h> /* PATH_MAX */
@@ -183,6 +184,27 @@ static alpm_list_t *_cache_get_backup(alpm_pkg_t *pkg)
 	return pkg->backup;
 }
 
+static int filestamp_cmp(const void *s1, const void *s2)
+{
+	const alpm_filestamp_t *stamp1 = s1;
+	const alpm_filestamp_t *stamp2 = s2;
+	return strcmp(stamp1->name, stamp2->name);
+}
+
+static const alpm_filestamp_t *_cache_get_filestamp(alpm_pkg_t *pkg,
+		const char *path)
+{
+	alpm_filestamp_t key;
+
+	LAZY_LOAD(INFRQ_STAMPS, NULL);
+	if(pkg->stamps_count == 0) {
+		return NULL;
+	}
+	key.name = (char *)path;
+	return bsearch(&key, pkg->stamps, pkg->stamps_count,
+			sizeof(alpm_filestamp_t), filestamp_cmp);
+}
+
 /**
  * Open a package changelog for reading. Similar to fopen in functionality,
  * except that the returned 'file stream' is from the database.
@@ -323,6 +345,7 @@ static struct pkg_operations local_pkg_ops = {
 	.get_replaces    = _cache_get_replaces,
 	.get_files       = _cache_get_files,
 	.get_backup      = _cache_get_backup,
+	.get_filestamp   = _cache_get_filestamp,
 
 	.changelog_open  = _cache_changelog_open,
 	.changelog_read  = _cache_changelog_read,
@@ -660,6 +683,58 @@ char *_alpm_local_db_pkgpath(alpm_db_t *db, alpm_pkg_t *info,
 	f = alpm_list_add(f, alpm_dep_from_string(line)); \
 } while(1) /* note the while(1) and not (0) */
 
+/* Parse a "mode size" line from the %FILEINFO% section of a files entry. */
+static int local_db_parse_fileinfo(char *line, alpm_file_t *file)
+{
+	char *ptr;
+	unsigned long mode;
+	off_t size;
+
+	errno = 0;
+	mode = strtoul(line, &ptr, 8);
+	if(ptr == line || *ptr != ' ' || errno != 0 || mode == 0) {
+		return -1;
+	}
+	size = _alpm_strtoofft(ptr + 1);
+	if(size < 0) {
+		return -1;
+	}
+
+	file->mode = (mode_t)mode;
+	file->size = size;
+	return 0;
+}
+
+/* "dev ino size mtime ctime name", the name taking the rest of the line */
+static int local_db_parse_stamp(char *line, alpm_filestamp_t *stamp)
+{
+	intmax_t values[5];
+	char *ptr = line;
+	int i;
+
+	errno = 0;
+	for(i = 0; i < 5; i++) {
+		char *end;
+		values[i] = i < 2 ? (intmax_t)strtoumax(ptr, &end, 10)
+			: strtoimax(ptr, &end, 10);
+		if(end == ptr || *end != ' ' || errno != 0) {
+			return -1;
+		}
+		ptr = end + 1;
+	}
+	if(*ptr == '\0') {
+		return -1;
+	}
+
+	STRDUP(stamp->name, ptr, return -1);
+	stamp->dev = (dev_t)values[0];
+	stamp->ino = (ino_t)values[1];
+	stamp->size = (off_t)values[2];
+	stamp->mtime = (alpm_time_t)values[3];
+	stamp->ctime = (alpm_time_t)values[4];
+	return 0;
+}
+
 static int local_db_read(alpm_pkg_t *info, alpm_dbinfrq_t inforeq)
 {
 	FILE *fp = NULL;
@@ -812,13 +887,31 @@ static int local_db_read(alpm_pkg_t *info, alpm_dbinfrq_t inforeq)
 				/* attempt to hand back any memory we don't need */
 				if(files_count > 0) {
 					files = realloc(files, sizeof(alpm_file_t) * files_count);
-					/* make sure the list is sorted */
-					qsort(files, files_count, sizeof(alpm_file_t), _alpm_files_cmp);
 				} else {
 					FREE(files);
 				}
 				info->files.count = files_count;
 				info->files.files = files;
+			} else if(strcmp(line, "%FILEINFO%") == 0) {
+				/* one "mode size" line per %FILES% entry, in the same order */
+				size_t files_count = 0;
+
+				while(safe_fgets(line, sizeof(line), fp) && _alpm_strip_newline(line, 0)) {
+					if(files_count < info->files.count &&
+							local_db_parse_fileinfo(line, info->files.files + files_count) != 0) {
+						break;
+					}
+					files_count++;
+				}
+				if(files_count != info->files.count) {
+					size_t i;
+					_alpm_log(db->handle, ALPM_LOG_DEBUG,
+							"ignoring mismatched file information for %s\n", info->name);
+					for(i = 0; i < info->files.count; i++) {
+						info->files.files[i].mode = 0;
+						info->files.files[i].size = 0;
+					}
+				}
 			} else if(strcmp(line, "%BACKUP%") == 0) {
 				while(safe_fgets(line, sizeof(line), fp) && _alpm_strip_newline(line, 0)) {
 					alpm_backup_t *backup;
@@ -833,6 +926,12 @@ static int local_db_read(alpm_pkg_t *info, alpm_dbinfrq_t inforeq)
 		}
 		fclose(fp);
 		fp = NULL;
+		/* make sure the list is sorted; this must happen after %FILEINFO% has
+		 * been matched up with the entries in the order they were written */
+		if(info->files.count > 0) {
+			qsort(info->files.files, info->files.count, sizeof(alpm_file_t),
+					_alpm_files_cmp);
+		}
 		info->infolevel |= INFRQ_FILES;
 	}
 
@@ -846,6 +945,43 @@ static int local_db_read(alpm_pkg_t *info, alpm_dbinfrq_t inforeq)
 		info->infolevel |= INFRQ_SCRIPTLET;
 	}
 
+	/* STAMPS */
+	if(inforeq & INFRQ_STAMPS && !(info->infolevel & INFRQ_STAMPS)) {
+		char *path = _alpm_local_db_pkgpath(db, info, "stamps");
+		/* stamps are optional, a missing file just means none were recorded */
+		if(path && (fp = fopen(path, "r")) != NULL) {
+			size_t stamps_count = 0, stamps_size = 0;
+			alpm_filestamp_t *stamps = NULL;
+
+			while(safe_fgets(line, sizeof(line), fp) && _alpm_strip_newline(line, 0)) {
+				if(strcmp(line, "%STAMPS%") == 0) {
+					continue;
+				}
+				if(!_alpm_greedy_grow((void **)&stamps, &stamps_size,
+							(stamps_count + 1) * sizeof(alpm_filestamp_t))) {
+					break;
+				}
+				if(local_db_parse_stamp(line, stamps + stamps_count) != 0) {
+					_alpm_log(db->handle, ALPM_LOG_DEBUG,
+							"ignoring malformed file stamp for %s\n", info->name);
+					continue;
+				}
+				stamps_count++;
+			}
+			fclose(fp);
+			fp = NULL;
+			if(stamps_count > 0) {
+				qsort(stamps, stamps_count, sizeof(alpm_filestamp_t), filestamp_cmp);
+			} else {
+				FREE(stamps);
+			}
+			info->stamps = stamps;
+			info->stamps_count = stamps_count;
+		}
+		free(path);
+		info->infolevel |= INFRQ_STAMPS;
+	}
+
 	return 0;
 
 error:
@@ -1025,13 +1161,28 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, alpm_dbinfrq_t inforeq
 		free(path);
 		if(info->files.count) {
 			size_t i;
+			int have_fileinfo = 1;
 			fputs("%FILES%\n", fp);
 			for(i = 0; i < info->files.count; i++) {
 				const alpm_file_t *file = info->files.files + i;
 				fputs(file->name, fp);
 				fputc('\n', fp);
+				if(file->mode == 0) {
+					have_fileinfo = 0;
+				}
 			}
 			fputc('\n', fp);
+			/* record the mode and installed size of each file so that removal
+			 * does not need to stat the filesystem to account for freed space */
+			if(have_fileinfo) {
+				fputs("%FILEINFO%\n", fp);
+				for(i = 0; i < info->files.count; i++) {
+					const alpm_file_t *file = info->files.files + i;
+					fprintf(fp, "%o %jd\n", (unsigned int)file->mode,
+							(intmax_t)file->size);
+				}
+				fputc('\n', fp);
+			}
 		}
 		if(info->backup) {
 			fputs("%BACKUP%\n", fp);
@@ -1045,6 +1196,33 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, alpm_dbinfrq_t inforeq
 		fp = NULL;
 	}
 
+	/* STAMPS */
+	if(inforeq & INFRQ_STAMPS && info->stamps_count) {
+		char *path;
+		size_t i;
+		_alpm_log(db->handle, ALPM_LOG_DEBUG,
+				"writing %s-%s STAMPS information back to db\n",
+				info->name, info->version);
+		path = _alpm_local_db_pkgpath(db, info, "stamps");
+		if(!path || (fp = fopen(path, "w")) == NULL) {
+			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+					path, strerror(errno));
+			retval = -1;
+			free(path);
+			goto cleanup;
+		}
+		free(path);
+		fputs("%STAMPS%\n", fp);
+		for(i = 0; i < info->stamps_count; i++) {
+			const alpm_filestamp_t *stamp = info->stamps + i;
+			fprintf(fp, "%ju %ju %jd %jd %jd %s\n", (uintmax_t)stamp->dev,
+					(uintmax_t)stamp->ino, (intmax_t)stamp->size,
+					(intmax_t)stamp->mtime, (intmax_t)stamp->ctime, stamp->name);
+		}
+		fclose(fp);
+		fp = NULL;
+	}
+
 	/* INSTALL and MTREE */
 	/* nothing needed here (automatically extracted) */
 
@@ -39,6 +39,7 @@
 #include "package.h"
 #include "deps.h"
 #include "filelist.h"
+#include "sigcache.h"
 #include "util.h"
 
 struct package_changelog {
@@ -318,9 +319,14 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		}
 
 		if(syncpkg->sha256sum) {
+			/* remembered for the signature cache, store and hashed cache */
+			char *sum = _alpm_file_sha256sum(handle, pkgfile);
+			int mismatch = sum == NULL || strcmp(sum, syncpkg->sha256sum) != 0;
+
 			_alpm_log(handle, ALPM_LOG_DEBUG, "sha256sum: %s\n", syncpkg->sha256sum);
 			_alpm_log(handle, ALPM_LOG_DEBUG, "checking sha256sum for %s\n", pkgfile);
-			if(_alpm_test_checksum(pkgfile, syncpkg->sha256sum, ALPM_PKG_VALIDATION_SHA256SUM) != 0) {
+			free(sum);
+			if(mismatch) {
 				RET_ERR(handle, ALPM_ERR_PKG_INVALID_CHECKSUM, -1);
 			}
 			if(validation) {
@@ -332,17 +338,34 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 	/* even if we don't have a sig, run the check code if level tells us to */
 	if(level & ALPM_SIG_PACKAGE) {
 		const char *sig = syncpkg ? syncpkg->base64_sig : NULL;
+		char *sigkey = NULL;
 		_alpm_log(handle, ALPM_LOG_DEBUG, "sig data: %s\n", sig ? sig : "<from .sig>");
 		if(!has_sig && !(level & ALPM_SIG_PACKAGE_OPTIONAL)) {
 			handle->pm_errno = ALPM_ERR_PKG_MISSING_SIG;
 			return -1;
 		}
-		if(_alpm_check_pgp_helper(handle, pkgfile, sig,
+		/* a file already verified under the current keyring can skip gpgme */
+		if(!has_sig || !_alpm_sigcache_check(handle, pkgfile, sig, &sigkey)) {
+			alpm_siglist_t *siglist = NULL;
+			int ret = _alpm_check_pgp_helper(handle, pkgfile, sig,
 					level & ALPM_SIG_PACKAGE_OPTIONAL, level & ALPM_SIG_PACKAGE_MARGINAL_OK,
-					level & ALPM_SIG_PACKAGE_UNKNOWN_OK, sigdata)) {
-			handle->pm_errno = ALPM_ERR_PKG_INVALID_SIG;
-			return -1;
+					level & ALPM_SIG_PACKAGE_UNKNOWN_OK, &siglist);
+			if(ret == 0) {
+				_alpm_sigcache_add(handle, sigkey, siglist);
+			}
+			if(sigdata) {
+				*sigdata = siglist;
+			} else {
+				alpm_siglist_cleanup(siglist);
+				free(siglist);
+			}
+			if(ret) {
+				free(sigkey);
+				handle->pm_errno = ALPM_ERR_PKG_INVALID_SIG;
+				return -1;
+			}
 		}
+		free(sigkey);
 		if(validation && has_sig) {
 			*validation |= ALPM_PKG_VALIDATION_SIGNATURE;
 		}
@@ -19,6 +19,8 @@
  */
 
 #include <errno.h>
+#include <ctype.h> /* isalnum */
+#include <stdint.h> /* intmax_t */
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -40,6 +42,8 @@
 #include "delta.h"
 #include "deps.h"
 #include "dload.h"
+#include "mirrors.h"
+#include "validators.h"
 #include "filelist.h"
 
 static char *get_sync_dir(alpm_handle_t *handle)
@@ -137,6 +141,256 @@ valid:
 	return 0;
 }
 
+/* Chains of database deltas longer than this are not followed. */
+#define DB_DELTA_MAX_CHAIN 32
+
+/* One line of a <db>.deltas index, leading from one revision to the next. */
+struct db_delta {
+	char base[65];
+	char target[65];
+	off_t size;
+	char name[256];
+};
+
+static int db_delta_name_is_safe(const char *name)
+{
+	const char *c;
+
+	/* the name ends up in a path and a shell command */
+	if(name[0] == '\0' || name[0] == '.') {
+		return 0;
+	}
+	for(c = name; *c; c++) {
+		if(!isalnum((unsigned char)*c) && !strchr("._+-@", *c)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Fetch a file of the delta update. A missing optional file only means the
+ * server does not offer deltas, it is not held against the server. */
+static int sync_db_fetch(alpm_handle_t *handle, const char *server,
+		const char *filename, const char *syncpath, off_t max_size, int optional)
+{
+	struct dload_payload payload;
+	size_t len;
+	int ret;
+
+	memset(&payload, 0, sizeof(struct dload_payload));
+	len = strlen(server) + strlen(filename) + 2;
+	MALLOC(payload.fileurl, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	snprintf(payload.fileurl, len, "%s/%s", server, filename);
+	payload.handle = handle;
+	payload.force = 1;
+	payload.errors_ok = 1;
+	payload.unlink_on_fail = 1;
+	payload.max_size = max_size;
+
+	ret = _alpm_download(&payload, syncpath, NULL, NULL);
+	if(ret != -1 || !optional) {
+		_alpm_mirrors_sample(handle, server, ret == -1, payload.ttfb,
+				payload.xfer_bytes, payload.xfer_time);
+	}
+	_alpm_dload_payload_reset(&payload);
+	return ret;
+}
+
+/* Read a <db>.deltas index: a line with the sha256sum and size of the
+ * current database, then one line per delta with the sha256sums of the
+ * revisions it leads from and to, its size and its file name. */
+static alpm_list_t *sync_db_read_deltas(alpm_handle_t *handle,
+		const char *path, char *current, off_t *current_size)
+{
+	alpm_list_t *deltas = NULL;
+	char line[PATH_MAX];
+	intmax_t size;
+	FILE *fp;
+
+	if((fp = fopen(path, "r")) == NULL) {
+		return NULL;
+	}
+	if(!fgets(line, sizeof(line), fp)
+			|| sscanf(line, "%64s %jd", current, &size) != 2
+			|| strlen(current) != 64) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "invalid delta index %s\n", path);
+		fclose(fp);
+		return NULL;
+	}
+	*current_size = (off_t)size;
+
+	while(fgets(line, sizeof(line), fp)) {
+		struct db_delta *d;
+
+		CALLOC(d, 1, sizeof(struct db_delta), break);
+		if(sscanf(line, "%64s %64s %jd %255s", d->base, d->target, &size,
+					d->name) != 4 || !db_delta_name_is_safe(d->name)) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "ignoring delta index line: %s", line);
+			free(d);
+			continue;
+		}
+		d->size = (off_t)size;
+		deltas = alpm_list_add(deltas, d);
+	}
+	fclose(fp);
+
+	return deltas;
+}
+
+/** Bring the local copy of a sync database up to date from deltas.
+ * The server may list deltas between database revisions in a
+ * <db>.deltas index next to the database. If they chain from the local
+ * copy to the current revision and are small enough for the delta ratio,
+ * they are downloaded and applied with xdelta3, and every revision is
+ * checked against its sha256sum. The local copy is only replaced once the
+ * current revision has been rebuilt exactly, so its signature still holds.
+ * @param db the sync database
+ * @param server the server to fetch the index and deltas from
+ * @param syncpath the directory holding the sync databases
+ * @return 0 if the database was updated, -1 if it has to be downloaded
+ */
+static int sync_db_apply_deltas(alpm_db_t *db, const char *server,
+		const char *syncpath)
+{
+	alpm_handle_t *handle = db->handle;
+	const char *dbpath = _alpm_db_path(db);
+	alpm_list_t *deltas = NULL, *chain = NULL, *i;
+	char *indexpath = NULL, *basepath = NULL, *newpath = NULL;
+	char *cursum = NULL, current[65];
+	const char *from, *revision;
+	off_t current_size = 0, total = 0;
+	size_t len;
+	int ret = -1;
+
+	if(!dbpath || access(dbpath, R_OK) != 0) {
+		return -1;
+	}
+
+	len = strlen(syncpath) + strlen(db->treename) + strlen(handle->dbext) + 8;
+	MALLOC(indexpath, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	snprintf(indexpath, len, "%s%s%s.deltas", syncpath, db->treename, handle->dbext);
+
+	if(sync_db_fetch(handle, server, indexpath + strlen(syncpath), syncpath,
+				64 * 1024, 1) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "no delta index for %s on %s\n",
+				db->treename, server);
+		goto cleanup;
+	}
+	deltas = sync_db_read_deltas(handle, indexpath, current, &current_size);
+	unlink(indexpath);
+	if(deltas == NULL) {
+		goto cleanup;
+	}
+
+	if((cursum = alpm_compute_sha256sum(dbpath)) == NULL) {
+		goto cleanup;
+	}
+	if(strcmp(cursum, current) == 0) {
+		/* leave it to the usual download to confirm nothing changed */
+		goto cleanup;
+	}
+
+	/* find a path through the revisions from ours to the current one */
+	revision = cursum;
+	while(strcmp(revision, current) != 0) {
+		struct db_delta *d = NULL;
+
+		for(i = deltas; i; i = i->next) {
+			struct db_delta *candidate = i->data;
+			if(strcmp(candidate->base, revision) == 0) {
+				d = candidate;
+				break;
+			}
+		}
+		if(d == NULL || alpm_list_count(chain) == DB_DELTA_MAX_CHAIN) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"no delta chain from %s to the current %s\n", cursum, db->treename);
+			goto cleanup;
+		}
+		chain = alpm_list_add(chain, d);
+		total += d->size;
+		revision = d->target;
+	}
+
+	if(total > current_size * handle->deltaratio) {
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"deltas for %s are too large (%jd of %jd bytes)\n", db->treename,
+				(intmax_t)total, (intmax_t)current_size);
+		goto cleanup;
+	}
+
+	len = strlen(dbpath) + 6;
+	MALLOC(basepath, len, handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+	snprintf(basepath, len, "%s.base", dbpath);
+	MALLOC(newpath, len, handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+	snprintf(newpath, len, "%s.new", dbpath);
+
+	from = dbpath;
+	for(i = chain; i; i = i->next) {
+		struct db_delta *d = i->data;
+		char command[PATH_MAX * 3 + 32];
+		char *deltapath, *sum;
+		int retval;
+
+		if(sync_db_fetch(handle, server, d->name, syncpath, d->size, 0) != 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "could not download delta %s\n", d->name);
+			goto cleanup;
+		}
+
+		len = strlen(syncpath) + strlen(d->name) + 1;
+		MALLOC(deltapath, len, handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+		snprintf(deltapath, len, "%s%s", syncpath, d->name);
+		snprintf(command, sizeof(command), "xdelta3 -d -q -f -s %s %s %s",
+				from, deltapath, newpath);
+		_alpm_log(handle, ALPM_LOG_DEBUG, "command: %s\n", command);
+		retval = system(command);
+		unlink(deltapath);
+		free(deltapath);
+		if(retval != 0) {
+			goto cleanup;
+		}
+
+		sum = alpm_compute_sha256sum(newpath);
+		if(sum == NULL || strcmp(sum, d->target) != 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "delta %s produced the wrong database\n",
+					d->name);
+			free(sum);
+			goto cleanup;
+		}
+		free(sum);
+
+		if(rename(newpath, basepath) != 0) {
+			goto cleanup;
+		}
+		from = basepath;
+	}
+
+	if(rename(basepath, dbpath) != 0) {
+		goto cleanup;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "updated %s with %zu deltas (%jd bytes)\n",
+			db->treename, alpm_list_count(chain), (intmax_t)total);
+	ret = 0;
+
+cleanup:
+	if(ret != 0) {
+		if(newpath) {
+			unlink(newpath);
+		}
+		if(basepath) {
+			unlink(basepath);
+		}
+	}
+	alpm_list_free(chain);
+	alpm_list_free_inner(deltas, free);
+	alpm_list_free(deltas);
+	free(indexpath);
+	free(basepath);
+	free(newpath);
+	free(cursum);
+	return ret;
+}
+
 /** Update a package database
  *
  * An update of the package database \a db will be attempted. Unless
@@ -176,7 +430,7 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 {
 	char *syncpath;
 	const char *dbext;
-	alpm_list_t *i;
+	alpm_list_t *i, *servers;
 	int updated = 0;
 	int ret = -1;
 	mode_t oldmask;
@@ -217,8 +471,9 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 	}
 
 	dbext = db->handle->dbext;
+	servers = _alpm_mirrors_sort(handle, db->servers, 0);
 
-	for(i = db->servers; i; i = i->next) {
+	for(i = servers; i; i = i->next) {
 		const char *server = i->data, *final_db_url = NULL;
 		struct dload_payload payload;
 		size_t len;
@@ -226,32 +481,38 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 
 		memset(&payload, 0, sizeof(struct dload_payload));
 
-		/* set hard upper limit of 25MiB */
-		payload.max_size = 25 * 1024 * 1024;
+		/* a few small deltas may replace downloading the whole database */
+		if(!force && handle->deltaratio > 0.0
+				&& sync_db_apply_deltas(db, server, syncpath) == 0) {
+			ret = 0;
+		} else {
+			/* set hard upper limit of 25MiB */
+			payload.max_size = 25 * 1024 * 1024;
 
-		/* print server + filename into a buffer */
-		len = strlen(server) + strlen(db->treename) + strlen(dbext) + 2;
-		/* TODO fix leak syncpath and umask unset */
-		MALLOC(payload.fileurl, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
-		snprintf(payload.fileurl, len, "%s/%s%s", server, db->treename, dbext);
-		payload.handle = handle;
-		payload.force = force;
-		payload.unlink_on_fail = 1;
+			/* print server + filename into a buffer */
+			len = strlen(server) + strlen(db->treename) + strlen(dbext) + 2;
+			/* TODO fix leak syncpath and umask unset */
+			MALLOC(payload.fileurl, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+			snprintf(payload.fileurl, len, "%s/%s%s", server, db->treename, dbext);
+			payload.handle = handle;
+			payload.force = force;
+			payload.revalidate = 1;
+			payload.unlink_on_fail = 1;
 
-		ret = _alpm_download(&payload, syncpath, NULL, &final_db_url);
-		_alpm_dload_payload_reset(&payload);
+			ret = _alpm_download(&payload, syncpath, NULL, &final_db_url);
+			_alpm_mirrors_record(handle, server, &payload, ret);
+			_alpm_dload_payload_reset(&payload);
+		}
 		updated = (updated || ret == 0);
 
 		if(ret != -1 && updated && (level & ALPM_SIG_DATABASE)) {
-			/* an existing sig file is no good at this point */
+			/* the database changed, so whatever sig file we have belongs to the
+			 * old one; it is removed when the download fails */
 			char *sigpath = _alpm_sigpath(handle, _alpm_db_path(db));
 			if(!sigpath) {
 				ret = -1;
 				break;
 			}
-			unlink(sigpath);
-			free(sigpath);
-
 
 			/* check if the final URL from internal downloader looks reasonable */
 			if(final_db_url != NULL) {
@@ -281,6 +542,9 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 			}
 
 			payload.handle = handle;
+			/* never ask the server whether our sig file is current: its date
+			 * need not be newer than ours when the database was re-signed,
+			 * and a sig is small enough to fetch every time */
 			payload.force = 1;
 			payload.errors_ok = (level & ALPM_SIG_DATABASE_OPTIONAL);
 
@@ -288,6 +552,11 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 			payload.max_size = 16 * 1024;
 
 			sig_ret = _alpm_download(&payload, syncpath, NULL, NULL);
+			_alpm_mirrors_record(handle, server, &payload, sig_ret);
+			if(sig_ret == -1) {
+				unlink(sigpath);
+			}
+			free(sigpath);
 			/* errors_ok suppresses error messages, but not the return code */
 			sig_ret = payload.errors_ok ? 0 : sig_ret;
 			_alpm_dload_payload_reset(&payload);
@@ -297,6 +566,9 @@ int SYMEXPORT alpm_db_update(int force, alpm_db_t *db)
 			break;
 		}
 	}
+	alpm_list_free(servers);
+	_alpm_mirrors_save(handle);
+	_alpm_validators_save(handle);
 
 	if(updated) {
 		/* Cache needs to be rebuilt */
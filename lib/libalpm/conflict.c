@@ -159,12 +159,12 @@ static int add_conflict(alpm_handle_t *handle, alpm_list_t **baddeps,
  *
  * @param handle the context handle
  * @param list1 first list of packages
- * @param list2 second list of packages
+ * @param list2 second list of packages, indexed by names and provisions
  * @param baddeps list to store conflicts
  * @param order if >= 0 the conflict order is preserved, if < 0 it's reversed
  */
 static void check_conflict(alpm_handle_t *handle,
-		alpm_list_t *list1, alpm_list_t *list2,
+		alpm_list_t *list1, alpm_pkgindex_t *list2,
 		alpm_list_t **baddeps, int order)
 {
 	alpm_list_t *i;
@@ -178,9 +178,11 @@ static void check_conflict(alpm_handle_t *handle,
 
 		for(j = alpm_pkg_get_conflicts(pkg1); j; j = j->next) {
 			alpm_depend_t *conflict = j->data;
-			alpm_list_t *k;
+			alpm_list_t *k, *matches;
 
-			for(k = list2; k; k = k->next) {
+			/* only the packages named or providing the conflict can match */
+			matches = _alpm_pkgindex_find_satisfiers(list2, conflict);
+			for(k = matches; k; k = k->next) {
 				alpm_pkg_t *pkg2 = k->data;
 
 				if(pkg1->name_hash == pkg2->name_hash
@@ -189,14 +191,13 @@ static void check_conflict(alpm_handle_t *handle,
 					continue;
 				}
 
-				if(_alpm_depcmp(pkg2, conflict)) {
-					if(order >= 0) {
-						add_conflict(handle, baddeps, pkg1, pkg2, conflict);
-					} else {
-						add_conflict(handle, baddeps, pkg2, pkg1, conflict);
-					}
+				if(order >= 0) {
+					add_conflict(handle, baddeps, pkg1, pkg2, conflict);
+				} else {
+					add_conflict(handle, baddeps, pkg2, pkg1, conflict);
 				}
 			}
+			alpm_list_free(matches);
 		}
 	}
 }
@@ -212,10 +213,15 @@ static void check_conflict(alpm_handle_t *handle,
 alpm_list_t *_alpm_innerconflicts(alpm_handle_t *handle, alpm_list_t *packages)
 {
 	alpm_list_t *baddeps = NULL;
+	alpm_pkgindex_t index;
+
+	/* if the index can't be built, lookups scan the list instead */
+	_alpm_pkgindex_init(&index, packages);
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "check targets vs targets\n");
-	check_conflict(handle, packages, packages, &baddeps, 0);
+	check_conflict(handle, packages, &index, &baddeps, 0);
 
+	_alpm_pkgindex_free(&index);
 	return baddeps;
 }
 
@@ -225,6 +231,7 @@ alpm_list_t *_alpm_innerconflicts(alpm_handle_t *handle, alpm_list_t *packages)
 alpm_list_t *_alpm_outerconflicts(alpm_db_t *db, alpm_list_t *packages)
 {
 	alpm_list_t *baddeps = NULL;
+	alpm_pkgindex_t dbindex, pkgindex;
 
 	if(db == NULL) {
 		return NULL;
@@ -233,12 +240,19 @@ alpm_list_t *_alpm_outerconflicts(alpm_db_t *db, alpm_list_t *packages)
 	alpm_list_t *dblist = alpm_list_diff(_alpm_db_get_pkgcache(db),
 			packages, _alpm_pkg_cmp);
 
+	/* both sides are indexed once, so each conflict only looks at the
+	 * packages named or providing it */
+	_alpm_pkgindex_init(&dbindex, dblist);
+	_alpm_pkgindex_init(&pkgindex, packages);
+
 	/* two checks to be done here for conflicts */
 	_alpm_log(db->handle, ALPM_LOG_DEBUG, "check targets vs db\n");
-	check_conflict(db->handle, packages, dblist, &baddeps, 1);
+	check_conflict(db->handle, packages, &dbindex, &baddeps, 1);
 	_alpm_log(db->handle, ALPM_LOG_DEBUG, "check db vs targets\n");
-	check_conflict(db->handle, dblist, packages, &baddeps, -1);
+	check_conflict(db->handle, dblist, &pkgindex, &baddeps, -1);
 
+	_alpm_pkgindex_free(&dbindex);
+	_alpm_pkgindex_free(&pkgindex);
 	alpm_list_free(dblist);
 	return baddeps;
 }
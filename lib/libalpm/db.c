@@ -36,6 +36,7 @@
 #include "alpm.h"
 #include "package.h"
 #include "group.h"
+#include "deps.h"
 
 /** \addtogroup alpm_databases Database Functions
  * @brief Functions to query and manipulate the database of libalpm
@@ -515,6 +516,21 @@ static void free_groupcache(alpm_db_t *db)
 	db->status &= ~DB_STATUS_GRPCACHE;
 }
 
+static void free_depindex(alpm_db_t *db)
+{
+	int which;
+
+	if(db == NULL || !(db->status & DB_STATUS_DEPINDEX)) {
+		return;
+	}
+
+	for(which = 0; which < DEPINDEX_COUNT; which++) {
+		FREE(db->depindex[which]);
+		db->depindex_count[which] = 0;
+	}
+	db->status &= ~DB_STATUS_DEPINDEX;
+}
+
 void _alpm_db_free_pkgcache(alpm_db_t *db)
 {
 	if(db == NULL || !(db->status & DB_STATUS_PKGCACHE)) {
@@ -532,6 +548,7 @@ void _alpm_db_free_pkgcache(alpm_db_t *db)
 	db->status &= ~DB_STATUS_PKGCACHE;
 
 	free_groupcache(db);
+	free_depindex(db);
 }
 
 alpm_pkghash_t *_alpm_db_get_pkgcache_hash(alpm_db_t *db)
@@ -592,6 +609,7 @@ int _alpm_db_add_pkgincache(alpm_db_t *db, alpm_pkg_t *pkg)
 	db->pkgcache = _alpm_pkghash_add_sorted(db->pkgcache, newpkg);
 
 	free_groupcache(db);
+	free_depindex(db);
 
 	return 0;
 }
@@ -618,6 +636,7 @@ int _alpm_db_remove_pkgfromcache(alpm_db_t *db, alpm_pkg_t *pkg)
 	_alpm_pkg_free(data);
 
 	free_groupcache(db);
+	free_depindex(db);
 
 	return 0;
 }
@@ -724,4 +743,231 @@ alpm_group_t *_alpm_db_get_groupfromcache(alpm_db_t *db, const char *target)
 	return NULL;
 }
 
+static int depentry_cmp(const void *p1, const void *p2)
+{
+	const alpm_depentry_t *e1 = p1;
+	const alpm_depentry_t *e2 = p2;
+
+	if(e1->dep->name_hash != e2->dep->name_hash) {
+		return e1->dep->name_hash < e2->dep->name_hash ? -1 : 1;
+	}
+	return strcmp(e1->dep->name, e2->dep->name);
+}
+
+static alpm_list_t *depindex_list(alpm_pkg_t *pkg, int which)
+{
+	switch(which) {
+		case DEPINDEX_DEPENDS:
+			return alpm_pkg_get_depends(pkg);
+		case DEPINDEX_OPTDEPENDS:
+			return alpm_pkg_get_optdepends(pkg);
+		case DEPINDEX_PROVIDES:
+			return alpm_pkg_get_provides(pkg);
+		default:
+			return alpm_pkg_get_replaces(pkg);
+	}
+}
+
+/* Index the depends, optdepends, provides and replaces of every package in
+ * the db by name, so lookups in either direction don't need to scan the whole
+ * cache.
+ */
+static int load_depindex(alpm_db_t *db)
+{
+	int which;
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG,
+			"loading dependency index for repository '%s'\n", db->treename);
+
+	for(which = 0; which < DEPINDEX_COUNT; which++) {
+		alpm_depentry_t *entries;
+		alpm_list_t *lp;
+		size_t n = 0;
+
+		for(lp = _alpm_db_get_pkgcache(db); lp; lp = lp->next) {
+			n += alpm_list_count(depindex_list(lp->data, which));
+		}
+		if(n == 0) {
+			continue;
+		}
+
+		CALLOC(entries, n, sizeof(alpm_depentry_t), goto error);
+		n = 0;
+		for(lp = _alpm_db_get_pkgcache(db); lp; lp = lp->next) {
+			alpm_list_t *i;
+			for(i = depindex_list(lp->data, which); i; i = i->next) {
+				entries[n].dep = i->data;
+				entries[n].pkg = lp->data;
+				n++;
+			}
+		}
+		qsort(entries, n, sizeof(alpm_depentry_t), depentry_cmp);
+		db->depindex[which] = entries;
+		db->depindex_count[which] = n;
+	}
+
+	db->status |= DB_STATUS_DEPINDEX;
+	return 0;
+
+error:
+	for(which = 0; which < DEPINDEX_COUNT; which++) {
+		FREE(db->depindex[which]);
+		db->depindex_count[which] = 0;
+	}
+	return -1;
+}
+
+/* Returns the index of the first entry for name, or the entry count. */
+static size_t depindex_find(alpm_db_t *db, int which, const char *name,
+		unsigned long name_hash)
+{
+	alpm_depentry_t *entries = db->depindex[which];
+	size_t lo = 0, hi = db->depindex_count[which];
+	alpm_depend_t key;
+	alpm_depentry_t needle;
+
+	key.name = (char *)name;
+	key.name_hash = name_hash;
+	needle.dep = &key;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(depentry_cmp(&entries[mid], &needle) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if(lo < db->depindex_count[which]
+			&& depentry_cmp(&entries[lo], &needle) != 0) {
+		return db->depindex_count[which];
+	}
+	return lo;
+}
+
+/* Add the packages whose dependencies on name are satisfied by pkg. */
+static alpm_list_t *find_dependents(alpm_db_t *db, alpm_pkg_t *pkg,
+		const alpm_depend_t *name, int which, alpm_list_t *reqs)
+{
+	alpm_depentry_t *entries = db->depindex[which];
+	size_t i = depindex_find(db, which, name->name, name->name_hash);
+
+	for(; i < db->depindex_count[which]
+			&& entries[i].dep->name_hash == name->name_hash
+			&& strcmp(entries[i].dep->name, name->name) == 0; i++) {
+		if(_alpm_depcmp(pkg, entries[i].dep)
+				&& !alpm_list_find_ptr(reqs, entries[i].pkg)) {
+			reqs = alpm_list_add(reqs, entries[i].pkg);
+		}
+	}
+	return reqs;
+}
+
+static int ensure_depindex(alpm_db_t *db)
+{
+	if(db == NULL) {
+		return -1;
+	}
+	if(!(db->status & DB_STATUS_DEPINDEX)) {
+		return load_depindex(db);
+	}
+	return 0;
+}
+
+/** Find the packages in a db that depend on a package.
+ * @param db the database to search
+ * @param pkg the package which may be required, need not be in db
+ * @param optional look at optdepends instead of depends
+ * @return a list of packages in db sorted by name, to be freed with
+ * alpm_list_free() only
+ */
+alpm_list_t *_alpm_db_find_requiredby(alpm_db_t *db, alpm_pkg_t *pkg, int optional)
+{
+	int which = optional ? DEPINDEX_OPTDEPENDS : DEPINDEX_DEPENDS;
+	alpm_depend_t self;
+	alpm_list_t *i, *reqs = NULL;
+
+	if(pkg == NULL || ensure_depindex(db) != 0) {
+		return NULL;
+	}
+
+	/* a dependency can only be satisfied through its name, either
+	 * literally or by a provision of that name */
+	self.name = pkg->name;
+	self.name_hash = pkg->name_hash;
+	reqs = find_dependents(db, pkg, &self, which, reqs);
+	for(i = alpm_pkg_get_provides(pkg); i; i = i->next) {
+		reqs = find_dependents(db, pkg, i->data, which, reqs);
+	}
+
+	return alpm_list_msort(reqs, alpm_list_count(reqs), _alpm_pkg_cmp);
+}
+
+/** Find the packages in a db that satisfy a dependency.
+ * @param db the database to search
+ * @param dep the dependency to satisfy
+ * @return a list of packages in db sorted by name, to be freed with
+ * alpm_list_free() only
+ */
+alpm_list_t *_alpm_db_find_satisfiers(alpm_db_t *db, alpm_depend_t *dep)
+{
+	alpm_depentry_t *entries;
+	alpm_list_t *sats = NULL;
+	alpm_pkg_t *pkg;
+	size_t i;
+
+	if(dep == NULL || ensure_depindex(db) != 0) {
+		return NULL;
+	}
+
+	pkg = _alpm_db_get_pkgfromcache(db, dep->name);
+	if(pkg && _alpm_depcmp(pkg, dep)) {
+		sats = alpm_list_add(sats, pkg);
+	}
+
+	entries = db->depindex[DEPINDEX_PROVIDES];
+	for(i = depindex_find(db, DEPINDEX_PROVIDES, dep->name, dep->name_hash);
+			i < db->depindex_count[DEPINDEX_PROVIDES]
+			&& entries[i].dep->name_hash == dep->name_hash
+			&& strcmp(entries[i].dep->name, dep->name) == 0; i++) {
+		if(_alpm_depcmp(entries[i].pkg, dep)
+				&& !alpm_list_find_ptr(sats, entries[i].pkg)) {
+			sats = alpm_list_add(sats, entries[i].pkg);
+		}
+	}
+
+	return alpm_list_msort(sats, alpm_list_count(sats), _alpm_pkg_cmp);
+}
+
+/** Find the packages in a db that replace a package.
+ * Only literal matches of the replaces entries are considered.
+ * @param db the database to search
+ * @param pkg the package which may be replaced, need not be in db
+ * @return a list of packages in db sorted by name, to be freed with
+ * alpm_list_free() only
+ */
+alpm_list_t *_alpm_db_find_replacers(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	alpm_depentry_t *entries;
+	alpm_list_t *replacers = NULL;
+	size_t i;
+
+	if(pkg == NULL || ensure_depindex(db) != 0) {
+		return NULL;
+	}
+
+	entries = db->depindex[DEPINDEX_REPLACES];
+	for(i = depindex_find(db, DEPINDEX_REPLACES, pkg->name, pkg->name_hash);
+			i < db->depindex_count[DEPINDEX_REPLACES]
+			&& entries[i].dep->name_hash == pkg->name_hash
+			&& strcmp(entries[i].dep->name, pkg->name) == 0; i++) {
+		if(_alpm_depcmp_literal(pkg, entries[i].dep)
+				&& !alpm_list_find_ptr(replacers, entries[i].pkg)) {
+			replacers = alpm_list_add(replacers, entries[i].pkg);
+		}
+	}
+
+	return alpm_list_msort(replacers, alpm_list_count(replacers), _alpm_pkg_cmp);
+}
+
 /* vim: set noet: */
@@ -40,6 +40,8 @@ typedef enum _alpm_dbinfrq_t {
 	/* ALL should be info stored in the package or database */
 	INFRQ_ALL = INFRQ_BASE | INFRQ_DESC | INFRQ_FILES |
 		INFRQ_SCRIPTLET | INFRQ_DSIZE,
+	/* recorded file stamps of a local package, only loaded on request */
+	INFRQ_STAMPS = (1 << 5),
 	INFRQ_ERROR = (1 << 30)
 } alpm_dbinfrq_t;
 
@@ -52,7 +54,8 @@ enum _alpm_dbstatus_t {
 
 	DB_STATUS_LOCAL = (1 << 10),
 	DB_STATUS_PKGCACHE = (1 << 11),
-	DB_STATUS_GRPCACHE = (1 << 12)
+	DB_STATUS_GRPCACHE = (1 << 12),
+	DB_STATUS_DEPINDEX = (1 << 13)
 };
 
 struct db_operations {
@@ -61,6 +64,21 @@ struct db_operations {
 	void (*unregister) (alpm_db_t *);
 };
 
+/* Per-package lists covered by the dependency index */
+enum _alpm_depindex_t {
+	DEPINDEX_DEPENDS = 0,
+	DEPINDEX_OPTDEPENDS,
+	DEPINDEX_PROVIDES,
+	DEPINDEX_REPLACES,
+	DEPINDEX_COUNT
+};
+
+/* One depend, optdepend, provision or replace of a package, indexed by name */
+typedef struct _alpm_depentry_t {
+	alpm_depend_t *dep;
+	alpm_pkg_t *pkg;
+} alpm_depentry_t;
+
 /* Database */
 struct __alpm_db_t {
 	alpm_handle_t *handle;
@@ -69,6 +87,9 @@ struct __alpm_db_t {
 	char *_path;
 	alpm_pkghash_t *pkgcache;
 	alpm_list_t *grpcache;
+	/* sorted by name, indexed by enum _alpm_depindex_t */
+	alpm_depentry_t *depindex[DEPINDEX_COUNT];
+	size_t depindex_count[DEPINDEX_COUNT];
 	alpm_list_t *servers;
 	struct db_operations *ops;
 	/* flags determining validity, local, loaded caches, etc. */
@@ -106,6 +127,10 @@ alpm_pkg_t *_alpm_db_get_pkgfromcache(alpm_db_t *db, const char *target);
 /* groups */
 alpm_list_t *_alpm_db_get_groupcache(alpm_db_t *db);
 alpm_group_t *_alpm_db_get_groupfromcache(alpm_db_t *db, const char *target);
+/* dependency index */
+alpm_list_t *_alpm_db_find_requiredby(alpm_db_t *db, alpm_pkg_t *pkg, int optional);
+alpm_list_t *_alpm_db_find_satisfiers(alpm_db_t *db, alpm_depend_t *dep);
+alpm_list_t *_alpm_db_find_replacers(alpm_db_t *db, alpm_pkg_t *pkg);
 
 #endif /* _ALPM_DB_H */
 
@@ -29,7 +29,6 @@
 #include "alpm_list.h"
 #include "util.h"
 #include "log.h"
-#include "graph.h"
 #include "package.h"
 #include "db.h"
 #include "handle.h"
@@ -71,91 +70,444 @@ void SYMEXPORT alpm_depmissing_free(alpm_depmissing_t *miss)
 	FREE(miss);
 }
 
-/** Check if pkg2 satisfies a dependency of pkg1 */
-static int _alpm_pkg_depends_on(alpm_pkg_t *pkg1, alpm_pkg_t *pkg2)
+static alpm_pkg_t *find_dep_satisfier(alpm_list_t *pkgs, alpm_depend_t *dep)
 {
 	alpm_list_t *i;
-	for(i = alpm_pkg_get_depends(pkg1); i; i = i->next) {
-		if(_alpm_depcmp(pkg2, i->data)) {
-			return 1;
+
+	for(i = pkgs; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if(_alpm_depcmp(pkg, dep)) {
+			return pkg;
 		}
 	}
+	return NULL;
+}
+
+static int pkg_name_cmp(const void *p1, const void *p2)
+{
+	const alpm_pkgname_t *n1 = p1;
+	const alpm_pkgname_t *n2 = p2;
+	int ret = strcmp(n1->name, n2->name);
+	if(ret == 0) {
+		ret = n1->idx < n2->idx ? -1 : n1->idx > n2->idx;
+	}
+	return ret;
+}
+
+void _alpm_pkgindex_free(alpm_pkgindex_t *index)
+{
+	FREE(index->pkgs);
+	FREE(index->names);
+	index->count = index->nnames = 0;
+}
+
+static int pkg_index_built(alpm_pkgindex_t *index)
+{
+	return index->names != NULL || index->list == NULL;
+}
+
+/* On errors the index is left empty, and lookups scan the list instead */
+int _alpm_pkgindex_init(alpm_pkgindex_t *index, alpm_list_t *pkgs)
+{
+	alpm_list_t *i, *j;
+	size_t n;
+
+	memset(index, 0, sizeof(alpm_pkgindex_t));
+	index->list = pkgs;
+	index->count = alpm_list_count(pkgs);
+	if(index->count == 0) {
+		return 0;
+	}
+
+	MALLOC(index->pkgs, index->count * sizeof(alpm_pkg_t *), goto error);
+	for(n = 0, i = pkgs; i; i = i->next, n++) {
+		index->pkgs[n] = i->data;
+		index->nnames += 1 + alpm_list_count(alpm_pkg_get_provides(i->data));
+	}
+
+	MALLOC(index->names, index->nnames * sizeof(alpm_pkgname_t), goto error);
+	index->nnames = 0;
+	for(n = 0; n < index->count; n++) {
+		alpm_pkg_t *pkg = index->pkgs[n];
+		index->names[index->nnames].name = pkg->name;
+		index->names[index->nnames++].idx = n;
+		for(j = alpm_pkg_get_provides(pkg); j; j = j->next) {
+			alpm_depend_t *prov = j->data;
+			index->names[index->nnames].name = prov->name;
+			index->names[index->nnames++].idx = n;
+		}
+	}
+	qsort(index->names, index->nnames, sizeof(alpm_pkgname_t), pkg_name_cmp);
 	return 0;
+
+error:
+	_alpm_pkgindex_free(index);
+	index->list = pkgs;
+	return -1;
 }
 
-static alpm_pkg_t *find_dep_satisfier(alpm_list_t *pkgs, alpm_depend_t *dep)
+/* Returns the first entry for a name or provision, or NULL. Entries for the
+ * same name follow it up to pkg_index_end(). */
+static alpm_pkgname_t *pkg_index_lookup(alpm_pkgindex_t *index, const char *name)
 {
-	alpm_list_t *i;
+	size_t lo = 0, hi = index->nnames;
 
-	for(i = pkgs; i; i = i->next) {
-		alpm_pkg_t *pkg = i->data;
-		if(_alpm_depcmp(pkg, dep)) {
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(strcmp(index->names[mid].name, name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if(lo < index->nnames && strcmp(index->names[lo].name, name) == 0) {
+		return &index->names[lo];
+	}
+	return NULL;
+}
+
+static int pkg_index_end(alpm_pkgindex_t *index, alpm_pkgname_t *entry,
+		const char *name)
+{
+	return entry == index->names + index->nnames || strcmp(entry->name, name) != 0;
+}
+
+/* Returns the package with the given name, like alpm_pkg_find() */
+alpm_pkg_t *_alpm_pkgindex_find(alpm_pkgindex_t *index, const char *name)
+{
+	alpm_pkgname_t *entry;
+
+	if(!pkg_index_built(index)) {
+		return alpm_pkg_find(index->list, name);
+	}
+	for(entry = pkg_index_lookup(index, name);
+			entry && !pkg_index_end(index, entry, name); entry++) {
+		alpm_pkg_t *pkg = index->pkgs[entry->idx];
+		if(strcmp(pkg->name, name) == 0) {
 			return pkg;
 		}
 	}
 	return NULL;
 }
 
-/* Convert a list of alpm_pkg_t * to a graph structure,
- * with a edge for each dependency.
- * Returns a list of vertices (one vertex = one package)
- * (used by alpm_sortbydeps)
- */
-static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
-		alpm_list_t *targets, alpm_list_t *ignore)
+/* Returns the first package of the list satisfying dep, like
+ * find_dep_satisfier() */
+alpm_pkg_t *_alpm_pkgindex_find_satisfier(alpm_pkgindex_t *index,
+		alpm_depend_t *dep)
 {
-	alpm_list_t *i, *j;
-	alpm_list_t *vertices = NULL;
-	alpm_list_t *localpkgs = alpm_list_diff(
-			alpm_db_get_pkgcache(handle->db_local), targets, _alpm_pkg_cmp);
+	alpm_pkgname_t *entry;
+
+	if(!pkg_index_built(index)) {
+		return find_dep_satisfier(index->list, dep);
+	}
+	/* every candidate is listed under the dependency name, in list order */
+	for(entry = pkg_index_lookup(index, dep->name);
+			entry && !pkg_index_end(index, entry, dep->name); entry++) {
+		if(_alpm_depcmp(index->pkgs[entry->idx], dep)) {
+			return index->pkgs[entry->idx];
+		}
+	}
+	return NULL;
+}
+
+/* Returns all packages of the list satisfying dep, in list order. The list
+ * must be freed with alpm_list_free() only. */
+alpm_list_t *_alpm_pkgindex_find_satisfiers(alpm_pkgindex_t *index,
+		alpm_depend_t *dep)
+{
+	alpm_list_t *i, *sats = NULL;
+	alpm_pkgname_t *entry;
+	size_t last = 0;
+
+	if(!pkg_index_built(index)) {
+		for(i = index->list; i; i = i->next) {
+			if(_alpm_depcmp(i->data, dep)) {
+				sats = alpm_list_add(sats, i->data);
+			}
+		}
+		return sats;
+	}
+	for(entry = pkg_index_lookup(index, dep->name);
+			entry && !pkg_index_end(index, entry, dep->name); entry++) {
+		/* a package can be listed twice, by name and by a provision */
+		if((sats && entry->idx == last)
+				|| !_alpm_depcmp(index->pkgs[entry->idx], dep)) {
+			continue;
+		}
+		sats = alpm_list_add(sats, index->pkgs[entry->idx]);
+		last = entry->idx;
+	}
+	return sats;
+}
+
+/* A vertex of the dependency graph used by _alpm_sortbydeps */
+typedef struct _dep_vertex_t {
+	alpm_pkg_t *pkg;
+	/* indices of the vertices satisfying a dependency, ascending */
+	size_t *children;
+	size_t nchildren;
+	size_t childptr; /* next child to visit */
+	long parent; /* where did we come from? -1 at the top level */
+	signed char state; /* 0: untouched, -1: entered, 1: left */
+} dep_vertex_t;
+
+typedef struct _dep_graph_t {
+	alpm_db_t *db_local;
+	/* the first ntargets vertices are the targets, in the given order,
+	 * followed by the local packages they pull in */
+	dep_vertex_t *vertices;
+	size_t count;
+	size_t ntargets;
+	/* the targets, whose positions are their vertex indices */
+	alpm_pkgindex_t targets;
+	/* local packages sorted by name, with their vertex index or one of
+	 * the DEP_VERTEX_* values below */
+	alpm_pkg_t **local;
+	long *localvertex;
+	size_t nlocal;
+} dep_graph_t;
+
+#define DEP_VERTEX_NONE -1
+#define DEP_VERTEX_EXCLUDED -2
+#define DEP_VERTEX_PENDING -3
+
+static int size_cmp(const void *p1, const void *p2)
+{
+	size_t s1 = *(const size_t *)p1;
+	size_t s2 = *(const size_t *)p2;
+	return s1 < s2 ? -1 : s1 > s2;
+}
+
+/* Returns the index of the local package with the given name, or -1 */
+static long dep_graph_find_local(dep_graph_t *graph, const char *name)
+{
+	size_t lo = 0, hi = graph->nlocal;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(graph->local[mid]->name, name);
+		if(cmp == 0) {
+			return (long)mid;
+		} else if(cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
 
-	if(ignore) {
-		alpm_list_t *oldlocal = localpkgs;
-		localpkgs = alpm_list_diff(oldlocal, ignore, _alpm_pkg_cmp);
-		alpm_list_free(oldlocal);
+static void dep_graph_free(dep_graph_t *graph)
+{
+	size_t i;
+
+	if(graph->vertices) {
+		for(i = 0; i < graph->count; i++) {
+			free(graph->vertices[i].children);
+		}
 	}
+	free(graph->vertices);
+	_alpm_pkgindex_free(&graph->targets);
+	free(graph->local);
+	free(graph->localvertex);
+}
 
-	/* We create the vertices */
+static int dep_graph_index(dep_graph_t *graph, alpm_list_t *targets,
+		alpm_list_t *ignore)
+{
+	alpm_list_t *i;
+	size_t n;
+
+	graph->ntargets = alpm_list_count(targets);
+	graph->nlocal = alpm_list_count(_alpm_db_get_pkgcache(graph->db_local));
+
+	CALLOC(graph->vertices, graph->ntargets + graph->nlocal,
+			sizeof(dep_vertex_t), return -1);
+	for(n = 0, i = targets; i; i = i->next, n++) {
+		graph->vertices[n].pkg = i->data;
+		graph->vertices[n].parent = -1;
+	}
+	graph->count = graph->ntargets;
+
+	if(_alpm_pkgindex_init(&graph->targets, targets) != 0) {
+		return -1;
+	}
+
+	if(graph->nlocal == 0) {
+		return 0;
+	}
+	/* the cache list is sorted by name */
+	MALLOC(graph->local, graph->nlocal * sizeof(alpm_pkg_t *), return -1);
+	MALLOC(graph->localvertex, graph->nlocal * sizeof(long), return -1);
+	for(n = 0, i = _alpm_db_get_pkgcache(graph->db_local); i; i = i->next, n++) {
+		graph->local[n] = i->data;
+		graph->localvertex[n] = DEP_VERTEX_NONE;
+	}
+	/* local packages replaced by a target, or listed in ignore, are never
+	 * used to detect indirect dependencies */
 	for(i = targets; i; i = i->next) {
-		alpm_graph_t *vertex = _alpm_graph_new();
-		vertex->data = (void *)i->data;
-		vertices = alpm_list_add(vertices, vertex);
-	}
-
-	/* We compute the edges */
-	for(i = vertices; i; i = i->next) {
-		alpm_graph_t *vertex_i = i->data;
-		alpm_pkg_t *p_i = vertex_i->data;
-		/* TODO this should be somehow combined with alpm_checkdeps */
-		for(j = vertices; j; j = j->next) {
-			alpm_graph_t *vertex_j = j->data;
-			alpm_pkg_t *p_j = vertex_j->data;
-			if(_alpm_pkg_depends_on(p_i, p_j)) {
-				vertex_i->children =
-					alpm_list_add(vertex_i->children, vertex_j);
+		long idx = dep_graph_find_local(graph, ((alpm_pkg_t *)i->data)->name);
+		if(idx >= 0) {
+			graph->localvertex[idx] = DEP_VERTEX_EXCLUDED;
+		}
+	}
+	for(i = ignore; i; i = i->next) {
+		long idx = dep_graph_find_local(graph, ((alpm_pkg_t *)i->data)->name);
+		if(idx >= 0) {
+			graph->localvertex[idx] = DEP_VERTEX_EXCLUDED;
+		}
+	}
+	return 0;
+}
+
+/* Append an index to a growing array, sizes are in bytes */
+static int push_index(size_t **array, size_t *count, size_t *size, size_t idx)
+{
+	if(!_alpm_greedy_grow((void **)array, size, (*count + 1) * sizeof(size_t))) {
+		return -1;
+	}
+	(*array)[(*count)++] = idx;
+	return 0;
+}
+
+/* Find the vertices satisfying a dependency of the given vertex.
+ * Local packages are lazily added to the graph the first time they are
+ * needed, in the order they appear in the local db, so they don't get
+ * resolved unnecessarily. */
+static int dep_graph_edges(dep_graph_t *graph, size_t v)
+{
+	dep_vertex_t *vertex = &graph->vertices[v];
+	size_t *children = NULL, *fresh = NULL;
+	size_t nchildren = 0, nfresh = 0, children_size = 0, fresh_size = 0;
+	alpm_list_t *i, *j;
+	size_t k;
+
+	/* TODO this should be somehow combined with alpm_checkdeps */
+	for(i = alpm_pkg_get_depends(vertex->pkg); i; i = i->next) {
+		alpm_depend_t *dep = i->data;
+		alpm_pkgname_t *entry;
+		alpm_list_t *sats;
+
+		for(entry = pkg_index_lookup(&graph->targets, dep->name);
+				entry && !pkg_index_end(&graph->targets, entry, dep->name); entry++) {
+			if(_alpm_depcmp(graph->targets.pkgs[entry->idx], dep)
+					&& push_index(&children, &nchildren, &children_size,
+						entry->idx) != 0) {
+				goto error;
 			}
 		}
 
-		/* lazily add local packages to the dep graph so they don't
-		 * get resolved unnecessarily */
-		j = localpkgs;
-		while(j) {
-			alpm_list_t *next = j->next;
-			if(_alpm_pkg_depends_on(p_i, j->data)) {
-				alpm_graph_t *vertex_j = _alpm_graph_new();
-				vertex_j->data = (void *)j->data;
-				vertices = alpm_list_add(vertices, vertex_j);
-				vertex_i->children = alpm_list_add(vertex_i->children, vertex_j);
-				localpkgs = alpm_list_remove_item(localpkgs, j);
-				free(j);
+		sats = _alpm_db_find_satisfiers(graph->db_local, dep);
+		for(j = sats; j; j = j->next) {
+			long idx = dep_graph_find_local(graph, ((alpm_pkg_t *)j->data)->name);
+			int ret = 0;
+
+			if(idx < 0) {
+				continue;
+			} else if(graph->localvertex[idx] == DEP_VERTEX_NONE) {
+				graph->localvertex[idx] = DEP_VERTEX_PENDING;
+				ret = push_index(&fresh, &nfresh, &fresh_size, (size_t)idx);
+			} else if(graph->localvertex[idx] >= 0) {
+				ret = push_index(&children, &nchildren, &children_size,
+						(size_t)graph->localvertex[idx]);
 			}
-			j = next;
+			if(ret != 0) {
+				alpm_list_free(sats);
+				goto error;
+			}
+		}
+		alpm_list_free(sats);
+	}
+
+	/* new vertices are appended in local db order */
+	qsort(fresh, nfresh, sizeof(size_t), size_cmp);
+	for(k = 0; k < nfresh; k++) {
+		dep_vertex_t *newvertex = &graph->vertices[graph->count];
+		newvertex->pkg = graph->local[fresh[k]];
+		newvertex->parent = -1;
+		graph->localvertex[fresh[k]] = (long)graph->count;
+		if(push_index(&children, &nchildren, &children_size, graph->count++) != 0) {
+			goto error;
+		}
+	}
+	free(fresh);
+
+	/* visit children in graph order, once each */
+	qsort(children, nchildren, sizeof(size_t), size_cmp);
+	vertex->nchildren = 0;
+	for(k = 0; k < nchildren; k++) {
+		if(k == 0 || children[k] != children[k - 1]) {
+			children[vertex->nchildren++] = children[k];
+		}
+	}
+	vertex->children = children;
+	return 0;
+
+error:
+	/* pending local packages will never be added now */
+	for(k = 0; k < nfresh; k++) {
+		graph->localvertex[fresh[k]] = DEP_VERTEX_NONE;
+	}
+	free(children);
+	free(fresh);
+	return -1;
+}
+
+/* Build the dependency graph of targets, with an edge for each dependency.
+ * Local packages (not in ignore) are added to detect indirect dependencies. */
+static int dep_graph_init(alpm_handle_t *handle, dep_graph_t *graph,
+		alpm_list_t *targets, alpm_list_t *ignore)
+{
+	size_t v;
+
+	memset(graph, 0, sizeof(dep_graph_t));
+	graph->db_local = handle->db_local;
+
+	if(dep_graph_index(graph, targets, ignore) != 0) {
+		return -1;
+	}
+	/* count grows as local packages are pulled in */
+	for(v = 0; v < graph->count; v++) {
+		if(dep_graph_edges(graph, v) != 0) {
+			return -1;
 		}
+	}
+	return 0;
+}
+
+/* Warn about a dependency cycle between transaction packages. */
+static void dep_graph_warn_cycle(alpm_handle_t *handle, dep_graph_t *graph,
+		size_t v, size_t child, int reverse)
+{
+	long transvertex = (long)v;
+
+	if(child >= graph->ntargets) {
+		/* child is not part of the transaction, not a problem */
+		return;
+	}
+
+	/* find the nearest parent that's part of the transaction */
+	while(transvertex >= 0 && (size_t)transvertex >= graph->ntargets) {
+		transvertex = graph->vertices[transvertex].parent;
+	}
 
-		vertex_i->childptr = vertex_i->children;
+	if(transvertex < 0 || (size_t)transvertex == child) {
+		/* no transaction package in our ancestry or the package has
+		 * a circular dependency with itself, not a problem */
+	} else {
+		alpm_pkg_t *transpkg = graph->vertices[transvertex].pkg;
+		alpm_pkg_t *childpkg = graph->vertices[child].pkg;
+		_alpm_log(handle, ALPM_LOG_WARNING, _("dependency cycle detected:\n"));
+		if(reverse) {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("%s will be removed after its %s dependency\n"),
+					transpkg->name, childpkg->name);
+		} else {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("%s will be installed before its %s dependency\n"),
+					transpkg->name, childpkg->name);
+		}
 	}
-	alpm_list_free(localpkgs);
-	return vertices;
 }
 
 /* Re-order a list of target packages with respect to their dependencies.
@@ -171,16 +523,21 @@ static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
  *
  * if reverse is > 0, the dependency order will be reversed.
  *
- * This function returns the new alpm_list_t* target list.
+ * The graph is walked depth first over arrays, and edges are found through
+ * an index of target names and the local db, so sorting is linear in the
+ * size of the graph.
+ *
+ * This function returns the new alpm_list_t* target list, or NULL with
+ * pm_errno set on errors.
  *
  */
 alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		alpm_list_t *targets, alpm_list_t *ignore, int reverse)
 {
 	alpm_list_t *newtargs = NULL;
-	alpm_list_t *vertices = NULL;
-	alpm_list_t *vptr;
-	alpm_graph_t *vertex;
+	dep_graph_t graph;
+	size_t vptr;
+	long v;
 
 	if(targets == NULL) {
 		return NULL;
@@ -188,69 +545,43 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "started sorting dependencies\n");
 
-	vertices = dep_graph_init(handle, targets, ignore);
+	if(dep_graph_init(handle, &graph, targets, ignore) != 0) {
+		dep_graph_free(&graph);
+		handle->pm_errno = ALPM_ERR_MEMORY;
+		return NULL;
+	}
 
-	vptr = vertices;
-	vertex = vertices->data;
-	while(vptr) {
+	vptr = 0;
+	v = 0;
+	while(vptr < graph.count) {
+		dep_vertex_t *vertex = &graph.vertices[v];
+		int found = 0;
 		/* mark that we touched the vertex */
 		vertex->state = -1;
-		int found = 0;
-		while(vertex->childptr && !found) {
-			alpm_graph_t *nextchild = vertex->childptr->data;
-			vertex->childptr = vertex->childptr->next;
+		while(vertex->childptr < vertex->nchildren && !found) {
+			size_t child = vertex->children[vertex->childptr++];
+			dep_vertex_t *nextchild = &graph.vertices[child];
 			if(nextchild->state == 0) {
 				found = 1;
-				nextchild->parent = vertex;
-				vertex = nextchild;
+				nextchild->parent = v;
+				v = (long)child;
 			} else if(nextchild->state == -1) {
 				/* child is an ancestor of vertex */
-				alpm_graph_t *transvertex = vertex;
-
-				if(!alpm_list_find_ptr(targets, nextchild->data)) {
-					/* child is not part of the transaction, not a problem */
-					continue;
-				}
-
-				/* find the nearest parent that's part of the transaction */
-				while(transvertex) {
-					if(alpm_list_find_ptr(targets, transvertex->data)) {
-						break;
-					}
-					transvertex = transvertex->parent;
-				}
-
-				if(!transvertex || transvertex == nextchild) {
-					/* no transaction package in our ancestry or the package has
-					 * a circular dependency with itself, not a problem */
-				} else {
-					alpm_pkg_t *transpkg = transvertex->data;
-					alpm_pkg_t *childpkg = nextchild->data;
-					_alpm_log(handle, ALPM_LOG_WARNING, _("dependency cycle detected:\n"));
-					if(reverse) {
-						_alpm_log(handle, ALPM_LOG_WARNING,
-								_("%s will be removed after its %s dependency\n"),
-								transpkg->name, childpkg->name);
-					} else {
-						_alpm_log(handle, ALPM_LOG_WARNING,
-								_("%s will be installed before its %s dependency\n"),
-								transpkg->name, childpkg->name);
-					}
-				}
+				dep_graph_warn_cycle(handle, &graph, (size_t)v, child, reverse);
 			}
 		}
 		if(!found) {
-			if(alpm_list_find_ptr(targets, vertex->data)) {
-				newtargs = alpm_list_add(newtargs, vertex->data);
+			if((size_t)v < graph.ntargets) {
+				newtargs = alpm_list_add(newtargs, vertex->pkg);
 			}
 			/* mark that we've left this vertex */
 			vertex->state = 1;
-			vertex = vertex->parent;
-			if(!vertex) {
+			v = vertex->parent;
+			if(v < 0) {
 				/* top level vertex reached, move to the next unprocessed vertex */
-				for( vptr = vptr->next; vptr; vptr = vptr->next) {
-					vertex = vptr->data;
-					if(vertex->state == 0) {
+				for(vptr++; vptr < graph.count; vptr++) {
+					if(graph.vertices[vptr].state == 0) {
+						v = (long)vptr;
 						break;
 					}
 				}
@@ -268,8 +599,7 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		newtargs = tmptargs;
 	}
 
-	alpm_list_free_inner(vertices, _alpm_graph_free);
-	alpm_list_free(vertices);
+	dep_graph_free(&graph);
 
 	return newtargs;
 }
@@ -299,34 +629,113 @@ alpm_pkg_t SYMEXPORT *alpm_find_satisfier(alpm_list_t *pkgs, const char *depstri
 	return pkg;
 }
 
-/** Checks dependencies and returns missing ones in a list.
- * Dependencies can include versions with depmod operators.
+/* Lookups used by alpm_checkdeps, which can be shared by several checks
+ * against the same local packages */
+struct _alpm_depcheck_t {
+	alpm_handle_t *handle;
+	alpm_list_t *pkglist;
+	alpm_pkgindex_t rem;
+	/* set if the package list is the local db, whose own dependency index
+	 * is then used instead of indexing the list */
+	alpm_db_t *db;
+	alpm_pkgindex_t pkgs;
+	/* only valid during a check */
+	alpm_pkgindex_t upgrade;
+};
+
+/** Prepare checking dependencies against a list of local packages.
+ * Packages are looked up by name and provisions; if an index can't be built,
+ * its list is scanned instead.
  * @param handle the context handle
- * @param pkglist the list of local packages
- * @param remove an alpm_list_t* of packages to be removed
+ * @param pkglist the list of local packages, must outlive the returned object
+ * @param rem the packages to be removed, must outlive the returned object
+ * @return the prepared check, to be freed with _alpm_depcheck_free()
+ */
+alpm_depcheck_t *_alpm_depcheck_new(alpm_handle_t *handle,
+		alpm_list_t *pkglist, alpm_list_t *rem)
+{
+	alpm_depcheck_t *check;
+
+	CALLOC(check, 1, sizeof(alpm_depcheck_t), return NULL);
+	check->handle = handle;
+	check->pkglist = pkglist;
+	_alpm_pkgindex_init(&check->rem, rem);
+	if(handle->db_local && pkglist
+			&& pkglist == _alpm_db_get_pkgcache(handle->db_local)) {
+		check->db = handle->db_local;
+	} else {
+		_alpm_pkgindex_init(&check->pkgs, pkglist);
+	}
+	return check;
+}
+
+void _alpm_depcheck_free(alpm_depcheck_t *check)
+{
+	if(check == NULL) {
+		return;
+	}
+	_alpm_pkgindex_free(&check->rem);
+	_alpm_pkgindex_free(&check->pkgs);
+	free(check);
+}
+
+static int depcheck_is_modified(alpm_depcheck_t *check, alpm_pkg_t *pkg)
+{
+	return _alpm_pkgindex_find(&check->rem, pkg->name)
+		|| _alpm_pkgindex_find(&check->upgrade, pkg->name);
+}
+
+/* Find a local package satisfying dep which is not modified. */
+static alpm_pkg_t *depcheck_find_untouched(alpm_depcheck_t *check,
+		alpm_depend_t *dep)
+{
+	alpm_list_t *i, *sats;
+	alpm_pkg_t *pkg = NULL;
+
+	if(check->db == NULL && !pkg_index_built(&check->pkgs)) {
+		for(i = check->pkglist; i; i = i->next) {
+			if(_alpm_depcmp(i->data, dep) && !depcheck_is_modified(check, i->data)) {
+				return i->data;
+			}
+		}
+		return NULL;
+	} else if(check->db == NULL) {
+		alpm_pkgname_t *entry;
+		for(entry = pkg_index_lookup(&check->pkgs, dep->name);
+				entry && !pkg_index_end(&check->pkgs, entry, dep->name); entry++) {
+			alpm_pkg_t *sat = check->pkgs.pkgs[entry->idx];
+			if(_alpm_depcmp(sat, dep) && !depcheck_is_modified(check, sat)) {
+				return sat;
+			}
+		}
+		return NULL;
+	}
+
+	sats = _alpm_db_find_satisfiers(check->db, dep);
+	for(i = sats; i && !pkg; i = i->next) {
+		if(!depcheck_is_modified(check, i->data)) {
+			pkg = i->data;
+		}
+	}
+	alpm_list_free(sats);
+	return pkg;
+}
+
+/** Checks dependencies against prepared local packages.
+ * @param check the local packages and packages to be removed
  * @param upgrade an alpm_list_t* of packages to be upgraded (remove-then-upgrade)
  * @param reversedeps handles the backward dependencies
  * @return an alpm_list_t* of alpm_depmissing_t pointers.
  */
-alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
-		alpm_list_t *pkglist, alpm_list_t *rem, alpm_list_t *upgrade,
+alpm_list_t *_alpm_depcheck_run(alpm_depcheck_t *check, alpm_list_t *upgrade,
 		int reversedeps)
 {
+	alpm_handle_t *handle = check->handle;
 	alpm_list_t *i, *j;
-	alpm_list_t *dblist = NULL, *modified = NULL;
 	alpm_list_t *baddeps = NULL;
 	int nodepversion;
 
-	CHECK_HANDLE(handle, return NULL);
-
-	for(i = pkglist; i; i = i->next) {
-		alpm_pkg_t *pkg = i->data;
-		if(alpm_pkg_find(rem, pkg->name) || alpm_pkg_find(upgrade, pkg->name)) {
-			modified = alpm_list_add(modified, pkg);
-		} else {
-			dblist = alpm_list_add(dblist, pkg);
-		}
-	}
+	_alpm_pkgindex_init(&check->upgrade, upgrade);
 
 	nodepversion = no_dep_version(handle);
 
@@ -345,8 +754,8 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 			/* 1. we check the upgrade list */
 			/* 2. we check database for untouched satisfying packages */
 			/* 3. we check the dependency ignore list */
-			if(!find_dep_satisfier(upgrade, depend) &&
-					!find_dep_satisfier(dblist, depend) &&
+			if(!_alpm_pkgindex_find_satisfier(&check->upgrade, depend) &&
+					!depcheck_find_untouched(check, depend) &&
 					!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 				/* Unsatisfied dependency in the upgrade list */
 				alpm_depmissing_t *miss;
@@ -362,6 +771,19 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 	}
 
 	if(reversedeps) {
+		alpm_list_t *dblist = NULL, *modified = NULL;
+		alpm_pkgindex_t modidx;
+
+		for(i = check->pkglist; i; i = i->next) {
+			alpm_pkg_t *pkg = i->data;
+			if(depcheck_is_modified(check, pkg)) {
+				modified = alpm_list_add(modified, pkg);
+			} else {
+				dblist = alpm_list_add(dblist, pkg);
+			}
+		}
+		_alpm_pkgindex_init(&modidx, modified);
+
 		/* reversedeps handles the backwards dependencies, ie,
 		 * the packages listed in the requiredby field. */
 		for(i = dblist; i; i = i->next) {
@@ -372,14 +794,14 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 				if(nodepversion) {
 					depend->mod = ALPM_DEP_MOD_ANY;
 				}
-				alpm_pkg_t *causingpkg = find_dep_satisfier(modified, depend);
+				alpm_pkg_t *causingpkg = _alpm_pkgindex_find_satisfier(&modidx, depend);
 				/* we won't break this depend, if it is already broken, we ignore it */
 				/* 1. check upgrade list for satisfiers */
 				/* 2. check dblist for satisfiers */
 				/* 3. we check the dependency ignore list */
 				if(causingpkg &&
-						!find_dep_satisfier(upgrade, depend) &&
-						!find_dep_satisfier(dblist, depend) &&
+						!_alpm_pkgindex_find_satisfier(&check->upgrade, depend) &&
+						!depcheck_find_untouched(check, depend) &&
 						!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 					alpm_depmissing_t *miss;
 					char *missdepstring = alpm_dep_compute_string(depend);
@@ -392,10 +814,42 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 				depend->mod = orig_mod;
 			}
 		}
+
+		_alpm_pkgindex_free(&modidx);
+		alpm_list_free(modified);
+		alpm_list_free(dblist);
 	}
 
-	alpm_list_free(modified);
-	alpm_list_free(dblist);
+	_alpm_pkgindex_free(&check->upgrade);
+
+	return baddeps;
+}
+
+/** Checks dependencies and returns missing ones in a list.
+ * Dependencies can include versions with depmod operators.
+ * @param handle the context handle
+ * @param pkglist the list of local packages
+ * @param remove an alpm_list_t* of packages to be removed
+ * @param upgrade an alpm_list_t* of packages to be upgraded (remove-then-upgrade)
+ * @param reversedeps handles the backward dependencies
+ * @return an alpm_list_t* of alpm_depmissing_t pointers.
+ */
+alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
+		alpm_list_t *pkglist, alpm_list_t *rem, alpm_list_t *upgrade,
+		int reversedeps)
+{
+	alpm_depcheck_t *check;
+	alpm_list_t *baddeps;
+
+	CHECK_HANDLE(handle, return NULL);
+
+	check = _alpm_depcheck_new(handle, pkglist, rem);
+	if(check == NULL) {
+		handle->pm_errno = ALPM_ERR_MEMORY;
+		return NULL;
+	}
+	baddeps = _alpm_depcheck_run(check, upgrade, reversedeps);
+	_alpm_depcheck_free(check);
 
 	return baddeps;
 }
@@ -551,44 +1005,102 @@ error:
 	return NULL;
 }
 
-/* These parameters are messy. We check if this package, given a list of
- * targets and a db is safe to remove. We do NOT remove it if it is in the
- * target list, or if the package was explicitly installed and
- * include_explicit == 0 */
-static int can_remove_package(alpm_db_t *db, alpm_pkg_t *pkg,
-		alpm_list_t *targets, int include_explicit)
+/* Per-package state for _alpm_recursedeps, indexed like the db cache */
+typedef struct _recurse_node_t {
+	/* packages in the db satisfying a dependency of this one */
+	alpm_list_t *sats;
+	/* packages requiring this one that are not targets, -1 if unknown */
+	int refs;
+	unsigned int intargs:1;
+	unsigned int sats_loaded:1;
+} recurse_node_t;
+
+typedef struct _recurse_ctx_t {
+	alpm_db_t *db;
+	/* the db cache as an array sorted by name */
+	alpm_pkg_t **pkgs;
+	recurse_node_t *nodes;
+	size_t count;
+} recurse_ctx_t;
+
+/* Returns the index of the db package with the given name, or -1 */
+static long recurse_find(recurse_ctx_t *ctx, const char *name)
 {
-	alpm_list_t *i;
-
-	if(alpm_pkg_find(targets, pkg->name)) {
-		return 0;
+	size_t lo = 0, hi = ctx->count;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(ctx->pkgs[mid]->name, name);
+		if(cmp == 0) {
+			return (long)mid;
+		} else if(cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
 	}
+	return -1;
+}
+
+/* Find the db packages satisfying any dependency of pkg, sorted by name. */
+static alpm_list_t *find_pkg_satisfiers(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	alpm_list_t *i, *j, *sats = NULL;
 
-	if(!include_explicit) {
-		/* see if it was explicitly installed */
-		if(alpm_pkg_get_reason(pkg) == ALPM_PKG_REASON_EXPLICIT) {
-			_alpm_log(db->handle, ALPM_LOG_DEBUG,
-					"excluding %s -- explicitly installed\n", pkg->name);
-			return 0;
+	for(i = alpm_pkg_get_depends(pkg); i; i = i->next) {
+		alpm_list_t *found = _alpm_db_find_satisfiers(db, i->data);
+		for(j = found; j; j = j->next) {
+			if(!alpm_list_find_ptr(sats, j->data)) {
+				sats = alpm_list_add(sats, j->data);
+			}
 		}
+		alpm_list_free(found);
 	}
+	return alpm_list_msort(sats, alpm_list_count(sats), _alpm_pkg_cmp);
+}
 
-	/* TODO: checkdeps could be used here, it handles multiple providers
-	 * better, but that also makes it slower.
-	 * Also this would require to first add the package to the targets list,
-	 * then call checkdeps with it, then remove the package from the targets list
-	 * if checkdeps detected it would break something */
+static alpm_list_t *node_satisfiers(recurse_ctx_t *ctx, long idx)
+{
+	recurse_node_t *node = &ctx->nodes[idx];
 
-	/* see if other packages need it */
-	for(i = _alpm_db_get_pkgcache(db); i; i = i->next) {
-		alpm_pkg_t *lpkg = i->data;
-		if(_alpm_pkg_depends_on(lpkg, pkg) && !alpm_pkg_find(targets, lpkg->name)) {
-			return 0;
+	if(!node->sats_loaded) {
+		node->sats = find_pkg_satisfiers(ctx->db, ctx->pkgs[idx]);
+		node->sats_loaded = 1;
+	}
+	return node->sats;
+}
+
+/* Count the packages requiring pkg which are not yet targets. */
+static int count_external_refs(recurse_ctx_t *ctx, alpm_pkg_t *pkg)
+{
+	alpm_list_t *i, *reqs;
+	int refs = 0;
+
+	/* TODO: checkdeps could be used here, it handles multiple providers
+	 * better, but that also makes it slower. */
+	reqs = _alpm_db_find_requiredby(ctx->db, pkg, 0);
+	for(i = reqs; i; i = i->next) {
+		long idx = recurse_find(ctx, ((alpm_pkg_t *)i->data)->name);
+		if(idx < 0 || !ctx->nodes[idx].intargs) {
+			refs++;
 		}
 	}
+	alpm_list_free(reqs);
+	return refs;
+}
 
-	/* it's ok to remove */
-	return 1;
+/* Mark a package as a target, releasing its hold on its dependencies. */
+static void mark_target(recurse_ctx_t *ctx, long idx)
+{
+	alpm_list_t *i;
+
+	ctx->nodes[idx].intargs = 1;
+	for(i = node_satisfiers(ctx, idx); i; i = i->next) {
+		long dep = recurse_find(ctx, ((alpm_pkg_t *)i->data)->name);
+		if(dep >= 0 && ctx->nodes[dep].refs > 0) {
+			ctx->nodes[dep].refs--;
+		}
+	}
 }
 
 /**
@@ -597,6 +1109,11 @@ static int can_remove_package(alpm_db_t *db, alpm_pkg_t *pkg,
  * target list, so they can be safely removed.
  * If the input list was topo sorted, the output list will be topo sorted too.
  *
+ * Every package keeps a count of the packages outside the target list that
+ * require it, which is computed the first time the package is reached and
+ * then only decremented as its dependents join the targets, so each
+ * dependency edge is looked at a bounded number of times.
+ *
  * @param db package database to do dependency tracing in
  * @param *targs pointer to a list of packages
  * @param include_explicit if 0, explicitly installed packages are not included
@@ -605,31 +1122,95 @@ static int can_remove_package(alpm_db_t *db, alpm_pkg_t *pkg,
 int _alpm_recursedeps(alpm_db_t *db, alpm_list_t **targs, int include_explicit)
 {
 	alpm_list_t *i, *j;
+	recurse_ctx_t ctx;
+	recurse_node_t *nodes;
+	size_t n;
+	int ret = -1;
 
 	if(db == NULL || targs == NULL) {
 		return -1;
 	}
 
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.db = db;
+	ctx.count = alpm_list_count(_alpm_db_get_pkgcache(db));
+	if(ctx.count == 0) {
+		return 0;
+	}
+	MALLOC(ctx.pkgs, ctx.count * sizeof(alpm_pkg_t *), goto cleanup);
+	CALLOC(ctx.nodes, ctx.count, sizeof(recurse_node_t), goto cleanup);
+	nodes = ctx.nodes;
+	/* the cache list is sorted by name */
+	for(n = 0, i = _alpm_db_get_pkgcache(db); i; i = i->next, n++) {
+		ctx.pkgs[n] = i->data;
+		nodes[n].refs = -1;
+	}
+
+	/* no refcounts are known yet, so there is nothing to release */
+	for(i = *targs; i; i = i->next) {
+		long idx = recurse_find(&ctx, ((alpm_pkg_t *)i->data)->name);
+		if(idx >= 0) {
+			nodes[idx].intargs = 1;
+		}
+	}
+
 	for(i = *targs; i; i = i->next) {
 		alpm_pkg_t *pkg = i->data;
-		for(j = _alpm_db_get_pkgcache(db); j; j = j->next) {
+		long idx = recurse_find(&ctx, pkg->name);
+		alpm_list_t *sats, *owned = NULL;
+
+		if(idx >= 0) {
+			sats = node_satisfiers(&ctx, idx);
+		} else {
+			sats = owned = find_pkg_satisfiers(db, pkg);
+		}
+
+		for(j = sats; j; j = j->next) {
 			alpm_pkg_t *deppkg = j->data;
-			if(_alpm_pkg_depends_on(pkg, deppkg)
-					&& can_remove_package(db, deppkg, *targs, include_explicit)) {
-				alpm_pkg_t *copy = NULL;
-				_alpm_log(db->handle, ALPM_LOG_DEBUG, "adding '%s' to the targets\n",
-						deppkg->name);
-				/* add it to the target list */
-				if(_alpm_pkg_dup(deppkg, &copy)) {
-					/* we return memory on "non-fatal" error in _alpm_pkg_dup */
-					_alpm_pkg_free(copy);
-					return -1;
-				}
-				*targs = alpm_list_add(*targs, copy);
+			long dep = recurse_find(&ctx, deppkg->name);
+			alpm_pkg_t *copy = NULL;
+
+			if(dep < 0 || nodes[dep].intargs) {
+				continue;
+			}
+			if(!include_explicit
+					&& alpm_pkg_get_reason(deppkg) == ALPM_PKG_REASON_EXPLICIT) {
+				_alpm_log(db->handle, ALPM_LOG_DEBUG,
+						"excluding %s -- explicitly installed\n", deppkg->name);
+				continue;
+			}
+			if(nodes[dep].refs < 0) {
+				nodes[dep].refs = count_external_refs(&ctx, deppkg);
 			}
+			if(nodes[dep].refs > 0) {
+				continue;
+			}
+
+			_alpm_log(db->handle, ALPM_LOG_DEBUG, "adding '%s' to the targets\n",
+					deppkg->name);
+			/* add it to the target list */
+			if(_alpm_pkg_dup(deppkg, &copy)) {
+				/* we return memory on "non-fatal" error in _alpm_pkg_dup */
+				_alpm_pkg_free(copy);
+				alpm_list_free(owned);
+				goto cleanup;
+			}
+			*targs = alpm_list_add(*targs, copy);
+			mark_target(&ctx, dep);
 		}
+		alpm_list_free(owned);
 	}
-	return 0;
+	ret = 0;
+
+cleanup:
+	if(ctx.nodes) {
+		for(n = 0; n < ctx.count; n++) {
+			alpm_list_free(ctx.nodes[n].sats);
+		}
+	}
+	free(ctx.nodes);
+	free(ctx.pkgs);
+	return ret;
 }
 
 /**
@@ -792,7 +1373,7 @@ alpm_pkg_t SYMEXPORT *alpm_find_dbs_satisfier(alpm_handle_t *handle,
  * and those resolvable dependencies to a list.
  *
  * @param handle the context handle
- * @param localpkgs is the list of local packages
+ * @param check the local packages, prepared with the remove list
  * @param pkg is the package to resolve
  * @param preferred packages to prefer when resolving
  * @param packages is a pointer to a list of packages which will be
@@ -808,7 +1389,7 @@ alpm_pkg_t SYMEXPORT *alpm_find_dbs_satisfier(alpm_handle_t *handle,
  *         unresolvable dependency, in which case the [*packages] list will be
  *         unmodified by this function
  */
-int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
+int _alpm_resolvedeps(alpm_handle_t *handle, alpm_depcheck_t *check,
 		alpm_pkg_t *pkg, alpm_list_t *preferred, alpm_list_t **packages,
 		alpm_list_t *rem, alpm_list_t **data)
 {
@@ -831,7 +1412,7 @@ int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "started resolving dependencies\n");
 	targ = alpm_list_add(NULL, pkg);
-	deps = alpm_checkdeps(handle, localpkgs, rem, targ, 0);
+	deps = _alpm_depcheck_run(check, targ, 0);
 	alpm_list_free(targ);
 	targ = NULL;
 
@@ -851,7 +1432,7 @@ int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 			/* find a satisfier package in the given repositories */
 			spkg = resolvedep(handle, missdep, handle->dbs_sync, *packages, 0);
 		}
-		if(spkg && _alpm_resolvedeps(handle, localpkgs, spkg, preferred, packages, rem, data) == 0) {
+		if(spkg && _alpm_resolvedeps(handle, check, spkg, preferred, packages, rem, data) == 0) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"pulling dependency %s (needed by %s)\n",
 					spkg->name, pkg->name);
@@ -27,11 +27,44 @@
 #include "package.h"
 #include "alpm.h"
 
+/* A package name or provision, pointing back to its position in a list */
+typedef struct _alpm_pkgname_t {
+	const char *name;
+	size_t idx;
+} alpm_pkgname_t;
+
+/* Index of a package list by names and provisions, to find the packages
+ * which may satisfy a dependency without scanning the whole list */
+typedef struct _alpm_pkgindex_t {
+	/* scanned instead if the index could not be built */
+	alpm_list_t *list;
+	/* the packages in list order */
+	alpm_pkg_t **pkgs;
+	size_t count;
+	/* names and provisions sorted by name, ties in list order */
+	alpm_pkgname_t *names;
+	size_t nnames;
+} alpm_pkgindex_t;
+
+typedef struct _alpm_depcheck_t alpm_depcheck_t;
+
 alpm_depend_t *_alpm_dep_dup(const alpm_depend_t *dep);
+int _alpm_pkgindex_init(alpm_pkgindex_t *index, alpm_list_t *pkgs);
+void _alpm_pkgindex_free(alpm_pkgindex_t *index);
+alpm_pkg_t *_alpm_pkgindex_find(alpm_pkgindex_t *index, const char *name);
+alpm_pkg_t *_alpm_pkgindex_find_satisfier(alpm_pkgindex_t *index,
+		alpm_depend_t *dep);
+alpm_list_t *_alpm_pkgindex_find_satisfiers(alpm_pkgindex_t *index,
+		alpm_depend_t *dep);
 alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		alpm_list_t *targets, alpm_list_t *ignore, int reverse);
 int _alpm_recursedeps(alpm_db_t *db, alpm_list_t **targs, int include_explicit);
-int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs, alpm_pkg_t *pkg,
+alpm_depcheck_t *_alpm_depcheck_new(alpm_handle_t *handle,
+		alpm_list_t *pkglist, alpm_list_t *rem);
+void _alpm_depcheck_free(alpm_depcheck_t *check);
+alpm_list_t *_alpm_depcheck_run(alpm_depcheck_t *check, alpm_list_t *upgrade,
+		int reversedeps);
+int _alpm_resolvedeps(alpm_handle_t *handle, alpm_depcheck_t *check, alpm_pkg_t *pkg,
 		alpm_list_t *preferred, alpm_list_t **packages, alpm_list_t *remove,
 		alpm_list_t **data);
 int _alpm_depcmp_literal(alpm_pkg_t *pkg, alpm_depend_t *dep);
@@ -229,25 +229,41 @@ static int calculate_removed_size(alpm_handle_t *handle,
 	for(i = 0; i < filelist->count; i++) {
 		const alpm_file_t *file = filelist->files + i;
 		alpm_mountpoint_t *mp;
-		struct stat st;
 		char path[PATH_MAX];
 		blkcnt_t remove_size;
 		const char *filename = file->name;
+		off_t size;
 
 		snprintf(path, PATH_MAX, "%s%s", handle->root, filename);
 
-		if(llstat(path, &st) == -1) {
-			if(alpm_option_match_noextract(handle, filename)) {
-				_alpm_log(handle, ALPM_LOG_WARNING,
-						_("could not get file information for %s\n"), filename);
+		if(file->mode != 0) {
+			/* the local database recorded the installed mode and size of this
+			 * file, so no stat is needed; files that were never extracted do not
+			 * free anything */
+			if(alpm_option_match_noextract(handle, filename) == 0) {
+				continue;
+			}
+			if(S_ISDIR(file->mode) || S_ISLNK(file->mode)) {
+				continue;
+			}
+			size = file->size;
+		} else {
+			struct stat st;
+
+			if(llstat(path, &st) == -1) {
+				if(alpm_option_match_noextract(handle, filename)) {
+					_alpm_log(handle, ALPM_LOG_WARNING,
+							_("could not get file information for %s\n"), filename);
+				}
+				continue;
 			}
-			continue;
-		}
 
-		/* skip directories and symlinks to be consistent with libarchive that
-		 * reports them to be zero size */
-		if(S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode)) {
-			continue;
+			/* skip directories and symlinks to be consistent with libarchive that
+			 * reports them to be zero size */
+			if(S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode)) {
+				continue;
+			}
+			size = st.st_size;
 		}
 
 		mp = match_mount_point(mount_points, path);
@@ -270,7 +286,7 @@ static int calculate_removed_size(alpm_handle_t *handle,
 		}
 
 		/* the addition of (divisor - 1) performs ceil() with integer division */
-		remove_size = (st.st_size + mp->fsp.f_bsize - 1) / mp->fsp.f_bsize;
+		remove_size = (size + mp->fsp.f_bsize - 1) / mp->fsp.f_bsize;
 		mp->blocks_needed -= remove_size;
 		mp->used |= USED_REMOVE;
 	}
@@ -22,7 +22,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h> /* intmax_t */
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h> /* setsockopt, SO_KEEPALIVE */
 #include <sys/time.h>
 #include <sys/types.h>
@@ -47,6 +49,8 @@
 #include "log.h"
 #include "util.h"
 #include "handle.h"
+#include "mirrors.h"
+#include "validators.h"
 
 #ifdef HAVE_LIBCURL
 static const char *get_filename(const char *url)
@@ -70,15 +74,70 @@ static char *get_fullpath(const char *path, const char *filename,
 	return filepath;
 }
 
+/* The share keeps resolved hosts, TLS sessions and, with libcurl >= 7.57,
+ * open connections across every easy handle of an alpm handle. We never
+ * transfer from more than one thread, so it needs no locking callbacks. */
+static CURLSH *get_libcurl_share(alpm_handle_t *handle)
+{
+	if(!handle->curlshare) {
+		handle->curlshare = curl_share_init();
+		if(!handle->curlshare) {
+			return NULL;
+		}
+		curl_share_setopt(handle->curlshare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+		curl_share_setopt(handle->curlshare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+		curl_share_setopt(handle->curlshare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	}
+	return handle->curlshare;
+}
+
+/* curl_easy_reset() keeps the share, so it only needs attaching once */
+static CURL *new_libcurl_handle(alpm_handle_t *handle)
+{
+	CURL *curl = curl_easy_init();
+	CURLSH *share = get_libcurl_share(handle);
+
+	if(curl && share) {
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+	}
+	return curl;
+}
+
 static CURL *get_libcurl_handle(alpm_handle_t *handle)
 {
 	if(!handle->curl) {
 		curl_global_init(CURL_GLOBAL_SSL);
-		handle->curl = curl_easy_init();
+		handle->curl = new_libcurl_handle(handle);
 	}
 	return handle->curl;
 }
 
+static CURLM *get_libcurl_multi(alpm_handle_t *handle)
+{
+	if(!handle->curlmulti) {
+		curl_global_init(CURL_GLOBAL_SSL);
+		handle->curlmulti = curl_multi_init();
+	}
+	return handle->curlmulti;
+}
+
+static void count_transfer(alpm_handle_t *handle, CURL *curl, CURLcode result)
+{
+	long connects = 0;
+
+	handle->dlstats.transfers++;
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+	if(connects > 0) {
+		handle->dlstats.connects += connects;
+	} else if(result == CURLE_OK) {
+		handle->dlstats.reused++;
+	}
+}
+
 enum {
 	ABORT_SIGINT = 1,
 	ABORT_OVER_MAXFILESIZE
@@ -90,6 +149,89 @@ static void inthandler(int UNUSED signum)
 	dload_interrupted = ABORT_SIGINT;
 }
 
+static void dload_snapshot(struct dload_payload *payload, off_t downloaded,
+		off_t total, uint64_t now)
+{
+	alpm_handle_t *handle = payload->handle;
+	alpm_download_progress_t progress;
+	uint64_t elapsed = now - payload->progress_start;
+
+	progress.filename = payload->remote_name;
+	progress.downloaded = downloaded;
+	progress.total = total;
+	progress.done = (downloaded == total);
+	progress.elapsed = elapsed;
+	progress.nranges = payload->nranges;
+	progress.ranges = payload->ranges;
+
+	if(progress.done) {
+		/* report the average over the whole download */
+		if(elapsed > 0) {
+			payload->progress_rate = downloaded * 1000 / elapsed;
+		}
+	} else if(now > payload->progress_last && downloaded > payload->progress_size) {
+		off_t rate = (downloaded - payload->progress_size) * 1000
+			/ (off_t)(now - payload->progress_last);
+		/* average rate to reduce jumpiness */
+		payload->progress_rate = payload->progress_rate == 0 ? rate
+			: (rate + 2 * payload->progress_rate) / 3;
+	}
+	progress.rate = payload->progress_rate;
+	if(progress.done) {
+		progress.eta = 0;
+	} else if(progress.rate > 0) {
+		progress.eta = (total - downloaded) / progress.rate;
+	} else {
+		progress.eta = -1;
+	}
+
+	payload->progress_last = now;
+	payload->progress_size = downloaded;
+	handle->dlprogresscb(&progress);
+}
+
+/** Pass the progress of a download on to the front end.
+ * The first and last report of a file are always made, others at most once
+ * per progress interval.
+ * @param payload the download
+ * @param downloaded bytes received so far
+ * @param total bytes to receive
+ * @return 1 if the progress was reported, 0 otherwise
+ */
+static int dload_report(struct dload_payload *payload, off_t downloaded,
+		off_t total)
+{
+	alpm_handle_t *handle = payload->handle;
+	uint64_t now = _alpm_time_ms();
+
+	if(payload->prevprogress == 0) {
+		/* initialize the progress bar here to avoid displaying it when
+		 * a repo is up to date and nothing gets downloaded */
+		payload->progress_start = now;
+		payload->progress_last = now;
+		payload->progress_size = 0;
+		payload->progress_rate = 0;
+		if(handle->dlcb) {
+			handle->dlcb(payload->remote_name, 0, total);
+		}
+		if(handle->dlprogresscb) {
+			dload_snapshot(payload, 0, total, now);
+		}
+	} else if(downloaded < total
+			&& now - payload->progress_last < handle->progressinterval) {
+		return 0;
+	}
+
+	if(handle->dlcb) {
+		handle->dlcb(payload->remote_name, downloaded, total);
+	}
+	if(handle->dlprogresscb) {
+		dload_snapshot(payload, downloaded, total, now);
+	}
+	payload->progress_last = now;
+	return 1;
+}
+
 static int dload_progress_cb(void *file, double dltotal, double dlnow,
 		double UNUSED ultotal, double UNUSED ulnow)
 {
@@ -115,7 +257,7 @@ static int dload_progress_cb(void *file, double dltotal, double dlnow,
 	}
 
 	/* none of what follows matters if the front end has no callback */
-	if(payload->handle->dlcb == NULL) {
+	if(payload->handle->dlcb == NULL && payload->handle->dlprogresscb == NULL) {
 		return 0;
 	}
 
@@ -125,17 +267,11 @@ static int dload_progress_cb(void *file, double dltotal, double dlnow,
 		return 0;
 	}
 
-	/* initialize the progress bar here to avoid displaying it when
-	 * a repo is up to date and nothing gets downloaded */
-	if(payload->prevprogress == 0) {
-		payload->handle->dlcb(payload->remote_name, 0, (off_t)dltotal);
-	}
-
 	/* do NOT include initial_size since it wasn't part of the package's
 	 * download_size (nor included in the total download size callback) */
-	payload->handle->dlcb(payload->remote_name, (off_t)dlnow, (off_t)dltotal);
-
-	payload->prevprogress = current_size;
+	if(dload_report(payload, (off_t)dlnow, (off_t)dltotal)) {
+		payload->prevprogress = current_size;
+	}
 
 	return 0;
 }
@@ -205,6 +341,7 @@ static size_t dload_parseheader_cb(void *ptr, size_t size, size_t nmemb, void *u
 	const char *fptr, *endptr = NULL;
 	const char * const cd_header = "Content-Disposition:";
 	const char * const fn_key = "filename=";
+	const char * const etag_header = "ETag:";
 	struct dload_payload *payload = (struct dload_payload *)user;
 	long respcode;
 
@@ -228,6 +365,18 @@ static size_t dload_parseheader_cb(void *ptr, size_t size, size_t nmemb, void *u
 		}
 	}
 
+	if(_alpm_raw_ncmp(etag_header, ptr, strlen(etag_header)) == 0) {
+		fptr = (const char *)ptr + strlen(etag_header);
+		fptr += strspn(fptr, " \t");
+		endptr = fptr + strcspn(fptr, "\r\n");
+		/* a redirect may have sent one already */
+		FREE(payload->etag);
+		if(endptr > fptr) {
+			STRNDUP(payload->etag, fptr, endptr - fptr,
+					RET_ERR(payload->handle, ALPM_ERR_MEMORY, realsize));
+		}
+	}
+
 	curl_easy_getinfo(payload->handle->curl, CURLINFO_RESPONSE_CODE, &respcode);
 	if(payload->respcode != respcode) {
 		payload->respcode = respcode;
@@ -289,14 +438,14 @@ static void curl_set_handle_opts(struct dload_payload *payload,
 	curl_easy_reset(curl);
 	curl_easy_setopt(curl, CURLOPT_URL, payload->fileurl);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
-	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, payload->quick ? 2L : 10L);
 	curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
 	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, dload_progress_cb);
 	curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, (void *)payload);
 	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
-	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, payload->quick ? 3L : 10L);
 	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, dload_parseheader_cb);
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)payload);
 	curl_easy_setopt(curl, CURLOPT_NETRC, CURL_NETRC_OPTIONAL);
@@ -399,6 +548,7 @@ static int curl_download_internal(struct dload_payload *payload,
 	long timecond, remote_time = -1;
 	double remote_size, bytes_dl;
 	struct sigaction orig_sig_pipe, orig_sig_int;
+	struct curl_slist *headers = NULL;
 	/* shortcut to our handle within the payload */
 	alpm_handle_t *handle = payload->handle;
 	CURL *curl = get_libcurl_handle(handle);
@@ -408,6 +558,7 @@ static int curl_download_internal(struct dload_payload *payload,
 	FREE(payload->tempfile_name);
 	FREE(payload->destfile_name);
 	FREE(payload->content_disp_name);
+	FREE(payload->etag);
 
 	payload->tempfile_openmode = "wb";
 	if(!payload->remote_name) {
@@ -422,7 +573,8 @@ static int curl_download_internal(struct dload_payload *payload,
 	if(payload->remote_name && strlen(payload->remote_name) > 0 &&
 			strcmp(payload->remote_name, ".sig") != 0) {
 		payload->destfile_name = get_fullpath(localpath, payload->remote_name, "");
-		payload->tempfile_name = get_fullpath(localpath, payload->remote_name, ".part");
+		payload->tempfile_name = get_fullpath(localpath, payload->remote_name,
+				payload->tempfile_suffix ? payload->tempfile_suffix : ".part");
 		if(!payload->destfile_name || !payload->tempfile_name) {
 			goto cleanup;
 		}
@@ -454,6 +606,23 @@ static int curl_download_internal(struct dload_payload *payload,
 			"opened tempfile for download: %s (%s)\n", payload->tempfile_name,
 			payload->tempfile_openmode);
 
+	if(payload->revalidate && !payload->force && payload->destfile_name) {
+		/* the server can tell from the ETag that our copy is still current */
+		const char *etag = _alpm_validators_get(handle, payload->fileurl,
+				payload->destfile_name);
+		if(etag) {
+			size_t len = strlen(etag) + 16;
+			char *header;
+
+			MALLOC(header, len, handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+			snprintf(header, len, "If-None-Match: %s", etag);
+			headers = curl_slist_append(NULL, header);
+			free(header);
+			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+			_alpm_log(handle, ALPM_LOG_DEBUG, "using etag: %s\n", etag);
+		}
+	}
+
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, localf);
 
 	/* Ignore any SIGPIPE signals. With libcurl, these shouldn't be happening,
@@ -465,12 +634,20 @@ static int curl_download_internal(struct dload_payload *payload,
 	payload->curlerr = curl_easy_perform(curl);
 	_alpm_log(handle, ALPM_LOG_DEBUG, "curl returned error %d from transfer\n",
 			payload->curlerr);
+	count_transfer(handle, curl, payload->curlerr);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &payload->ttfb);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &payload->xfer_time);
+	if(curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &bytes_dl) == CURLE_OK
+			&& bytes_dl > 0) {
+		payload->xfer_bytes = (off_t)bytes_dl;
+	}
 
 	/* disconnect relationships from the curl handle for things that might go out
 	 * of scope, but could still be touched on connection teardown. This really
 	 * only applies to FTP transfers. */
 	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *)NULL);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, (struct curl_slist *)NULL);
 
 	/* was it a success? */
 	switch(payload->curlerr) {
@@ -530,9 +707,9 @@ static int curl_download_internal(struct dload_payload *payload,
 		*final_url = effective_url;
 	}
 
-	/* time condition was met and we didn't download anything. we need to
-	 * clean up the 0 byte .part file that's left behind. */
-	if(timecond == 1 && DOUBLE_EQ(bytes_dl, 0)) {
+	/* time condition was met or the ETag still matched and we didn't download
+	 * anything. we need to clean up the 0 byte .part file that's left behind. */
+	if((timecond == 1 || payload->respcode == 304) && DOUBLE_EQ(bytes_dl, 0)) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "file met time condition\n");
 		ret = 1;
 		unlink(payload->tempfile_name);
@@ -591,6 +768,9 @@ cleanup:
 				ret = -1;
 			}
 		}
+		if(ret != -1 && payload->revalidate && payload->destfile_name) {
+			_alpm_validators_set(handle, payload->fileurl, realname, payload->etag);
+		}
 		if(ret != -1 && final_file) {
 			STRDUP(*final_file, strrchr(realname, '/') + 1,
 					RET_ERR(handle, ALPM_ERR_MEMORY, -1));
@@ -602,6 +782,8 @@ cleanup:
 		unlink(payload->tempfile_name);
 	}
 
+	curl_slist_free_all(headers);
+
 	/* restore the old signal handlers */
 	unmask_signal(SIGINT, &orig_sig_int);
 	unmask_signal(SIGPIPE, &orig_sig_pipe);
@@ -612,6 +794,420 @@ cleanup:
 
 	return ret;
 }
+
+/* segments are never smaller than this */
+#define SEGMENT_MIN_SIZE (16 * 1024 * 1024)
+
+/* The test suite cannot serve packages of several times SEGMENT_MIN_SIZE,
+ * so it lowers the limit through the environment. */
+static off_t segment_min_size(void)
+{
+	const char *env = getenv("ALPM_SEGMENT_MIN_SIZE");
+	char *end;
+	long long size;
+
+	if(env == NULL || *env == '\0') {
+		return SEGMENT_MIN_SIZE;
+	}
+	size = strtoll(env, &end, 10);
+	if(*end != '\0' || size < 1) {
+		return SEGMENT_MIN_SIZE;
+	}
+	return (off_t)size;
+}
+
+/* One byte range of a segmented download. */
+struct dload_segment {
+	struct dload_payload *payload;
+	CURL *curl;
+	int fd;
+	off_t offset;           /* where the range starts in the file */
+	off_t length;
+	off_t written;
+	size_t server;          /* index of the server in use */
+	size_t attempts;        /* servers tried so far */
+	int checked;            /* the response was verified to be partial? */
+	int norange;            /* the server answered with the whole file? */
+	char error_buffer[CURL_ERROR_SIZE];
+};
+
+static size_t dload_segment_write_cb(char *ptr, size_t size, size_t nmemb,
+		void *data)
+{
+	struct dload_segment *seg = data;
+	size_t len = size * nmemb, done = 0;
+
+	if(dload_interrupted) {
+		return 0;
+	}
+
+	/* a server ignoring the range would hand us the start of the file */
+	if(!seg->checked) {
+		long respcode = 0;
+		curl_easy_getinfo(seg->curl, CURLINFO_RESPONSE_CODE, &respcode);
+		if(respcode != 206) {
+			_alpm_log(seg->payload->handle, ALPM_LOG_DEBUG,
+					"server ignored range request (response code %ld)\n", respcode);
+			seg->norange = 1;
+			return 0;
+		}
+		seg->checked = 1;
+	}
+
+	if((off_t)len > seg->length - seg->written) {
+		_alpm_log(seg->payload->handle, ALPM_LOG_DEBUG,
+				"server sent more than the requested range\n");
+		return 0;
+	}
+
+	while(done < len) {
+		ssize_t ret = pwrite(seg->fd, ptr + done, len - done,
+				seg->offset + seg->written + done);
+		if(ret < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			_alpm_log(seg->payload->handle, ALPM_LOG_ERROR,
+					_("could not write to file %s: %s\n"),
+					seg->payload->tempfile_name, strerror(errno));
+			return 0;
+		}
+		done += ret;
+	}
+	seg->written += len;
+
+	return len;
+}
+
+/* Start fetching whatever is left of a segment from its current server. */
+static int dload_segment_start(struct dload_segment *seg, CURLM *multi,
+		const char *server)
+{
+	struct dload_payload *payload = seg->payload;
+	alpm_handle_t *handle = payload->handle;
+	const char *useragent = getenv("HTTP_USER_AGENT");
+	char range[64];
+	char *url;
+	size_t len;
+
+	len = strlen(server) + strlen(payload->remote_name) + 2;
+	MALLOC(url, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	snprintf(url, len, "%s/%s", server, payload->remote_name);
+	snprintf(range, sizeof(range), "%jd-%jd",
+			(intmax_t)(seg->offset + seg->written),
+			(intmax_t)(seg->offset + seg->length - 1));
+
+	if(seg->curl == NULL && (seg->curl = new_libcurl_handle(handle)) == NULL) {
+		free(url);
+		RET_ERR(handle, ALPM_ERR_LIBCURL, -1);
+	}
+	curl_easy_reset(seg->curl);
+	curl_easy_setopt(seg->curl, CURLOPT_URL, url);
+	curl_easy_setopt(seg->curl, CURLOPT_RANGE, range);
+	curl_easy_setopt(seg->curl, CURLOPT_ERRORBUFFER, seg->error_buffer);
+	curl_easy_setopt(seg->curl, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(seg->curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(seg->curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(seg->curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(seg->curl, CURLOPT_LOW_SPEED_TIME, 10L);
+	curl_easy_setopt(seg->curl, CURLOPT_WRITEFUNCTION, dload_segment_write_cb);
+	curl_easy_setopt(seg->curl, CURLOPT_WRITEDATA, (void *)seg);
+	curl_easy_setopt(seg->curl, CURLOPT_NETRC, CURL_NETRC_OPTIONAL);
+	curl_easy_setopt(seg->curl, CURLOPT_SOCKOPTFUNCTION, dload_sockopt_cb);
+	curl_easy_setopt(seg->curl, CURLOPT_SOCKOPTDATA, (void *)handle);
+	curl_easy_setopt(seg->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+	if(useragent != NULL) {
+		curl_easy_setopt(seg->curl, CURLOPT_USERAGENT, useragent);
+	}
+	seg->checked = 0;
+	seg->norange = 0;
+	seg->error_buffer[0] = '\0';
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "segment url: %s (bytes %s)\n", url, range);
+	free(url);
+
+	if(curl_multi_add_handle(multi, seg->curl) != CURLM_OK) {
+		RET_ERR(handle, ALPM_ERR_LIBCURL, -1);
+	}
+	return 0;
+}
+
+/* Account the transfer of a segment to the server it came from. Segments
+ * share the bandwidth, so the throughput is that of one connection out of
+ * several. */
+static void dload_segment_record(struct dload_segment *seg, const char *server,
+		int failed)
+{
+	double ttfb = -1, seconds = 0, bytes = 0;
+
+	if(seg->norange) {
+		/* says nothing about how well the server delivers whole files */
+		return;
+	}
+	curl_easy_getinfo(seg->curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+	curl_easy_getinfo(seg->curl, CURLINFO_TOTAL_TIME, &seconds);
+	curl_easy_getinfo(seg->curl, CURLINFO_SIZE_DOWNLOAD, &bytes);
+	_alpm_mirrors_sample(seg->payload->handle, server, failed, ttfb,
+			bytes > 0 ? (off_t)bytes : 0, seconds);
+}
+
+/* Report the combined progress of all segments to the front end. */
+static void dload_segments_progress(struct dload_payload *payload,
+		struct dload_segment *segs, size_t nsegs)
+{
+	alpm_handle_t *handle = payload->handle;
+	off_t current = 0;
+	size_t i;
+
+	if(handle->dlcb == NULL && handle->dlprogresscb == NULL) {
+		return;
+	}
+	for(i = 0; i < nsegs; i++) {
+		current += segs[i].written;
+		payload->ranges[i].downloaded = segs[i].written;
+	}
+	if(current == 0 || current == payload->prevprogress) {
+		return;
+	}
+	if(dload_report(payload, current, payload->max_size)) {
+		payload->prevprogress = current;
+	}
+}
+
+/* Transfer all segments, moving a failed one on to the next server. */
+static int dload_segments_run(struct dload_payload *payload, CURLM *multi,
+		struct dload_segment *segs, size_t nsegs, const char **servers,
+		size_t nservers)
+{
+	alpm_handle_t *handle = payload->handle;
+	int running = 1;
+
+	while(running) {
+		CURLMsg *msg;
+		int msgs;
+
+		while(curl_multi_perform(multi, &running) == CURLM_CALL_MULTI_PERFORM);
+
+		while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+			struct dload_segment *seg = NULL;
+			size_t i;
+
+			if(msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			for(i = 0; i < nsegs; i++) {
+				if(segs[i].curl == msg->easy_handle) {
+					seg = segs + i;
+					break;
+				}
+			}
+			if(seg == NULL) {
+				continue;
+			}
+			curl_multi_remove_handle(multi, seg->curl);
+			count_transfer(handle, seg->curl, msg->data.result);
+			if(msg->data.result == CURLE_OK && seg->written == seg->length) {
+				dload_segment_record(seg, servers[seg->server], 0);
+				continue;
+			}
+
+			if(dload_interrupted) {
+				return -1;
+			}
+			dload_segment_record(seg, servers[seg->server], 1);
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"segment at %jd failed on %s: %s\n", (intmax_t)seg->offset,
+					servers[seg->server], seg->error_buffer[0] ? seg->error_buffer
+					: curl_easy_strerror(msg->data.result));
+			if(++seg->attempts >= nservers) {
+				return -1;
+			}
+			seg->server = (seg->server + 1) % nservers;
+			if(dload_segment_start(seg, multi, servers[seg->server]) != 0) {
+				return -1;
+			}
+			running = 1;
+		}
+
+		dload_segments_progress(payload, segs, nsegs);
+		if(dload_interrupted) {
+			return -1;
+		}
+
+		if(running) {
+			fd_set fdread, fdwrite, fdexcep;
+			struct timeval timeout;
+			int maxfd = -1;
+
+			FD_ZERO(&fdread);
+			FD_ZERO(&fdwrite);
+			FD_ZERO(&fdexcep);
+			curl_multi_fdset(multi, &fdread, &fdwrite, &fdexcep, &maxfd);
+			timeout.tv_sec = 0;
+			timeout.tv_usec = 100000;
+			if(maxfd == -1) {
+				/* curl is waiting on something we cannot select on */
+				select(0, NULL, NULL, NULL, &timeout);
+			} else {
+				select(maxfd + 1, &fdread, &fdwrite, &fdexcep, &timeout);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int curl_download_segmented(struct dload_payload *payload,
+		const char *localpath, alpm_list_t *servers)
+{
+	alpm_handle_t *handle = payload->handle;
+	struct dload_segment *segs = NULL;
+	const char **urls = NULL;
+	size_t nsegs, nservers = 0, i;
+	struct sigaction orig_sig_pipe, orig_sig_int;
+	struct stat st;
+	CURLM *multi = NULL;
+	alpm_list_t *lp;
+	off_t seglen, minsize = segment_min_size();
+	int fd = -1, ret = -1;
+
+	nsegs = handle->dlsegments;
+	if((off_t)nsegs > payload->max_size / minsize) {
+		nsegs = payload->max_size / minsize;
+	}
+	if(nsegs < 2 || !payload->remote_name) {
+		return 1;
+	}
+
+	/* only HTTP tells us reliably whether a range was honoured */
+	CALLOC(urls, alpm_list_count(servers), sizeof(char *),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(lp = servers; lp; lp = lp->next) {
+		const char *server = lp->data;
+		if(strncmp(server, "http://", 7) == 0 || strncmp(server, "https://", 8) == 0) {
+			urls[nservers++] = server;
+		}
+	}
+	if(nservers == 0) {
+		free(urls);
+		return 1;
+	}
+
+	FREE(payload->tempfile_name);
+	FREE(payload->destfile_name);
+	payload->destfile_name = get_fullpath(localpath, payload->remote_name, "");
+	payload->tempfile_name = get_fullpath(localpath, payload->remote_name, ".part");
+	if(!payload->destfile_name || !payload->tempfile_name) {
+		free(urls);
+		return -1;
+	}
+	if(stat(payload->tempfile_name, &st) == 0) {
+		/* leave an interrupted download to be resumed as one stream */
+		free(urls);
+		return 1;
+	}
+
+	fd = open(payload->tempfile_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	if(fd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				payload->tempfile_name, strerror(errno));
+		free(urls);
+		RET_ERR(handle, ALPM_ERR_RETRIEVE, -1);
+	}
+#ifdef HAVE_FALLOCATE
+	/* reserve the space up front so segments do not fragment the file */
+	(void)fallocate(fd, 0, 0, payload->max_size);
+#endif
+	if(ftruncate(fd, payload->max_size) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				payload->tempfile_name, strerror(errno));
+		handle->pm_errno = ALPM_ERR_RETRIEVE;
+		goto cleanup;
+	}
+
+	CALLOC(segs, nsegs, sizeof(struct dload_segment),
+			handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+	CALLOC(payload->ranges, nsegs, sizeof(alpm_download_range_t),
+			handle->pm_errno = ALPM_ERR_MEMORY; goto cleanup);
+	payload->nranges = nsegs;
+	if((multi = get_libcurl_multi(handle)) == NULL) {
+		handle->pm_errno = ALPM_ERR_LIBCURL;
+		goto cleanup;
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "downloading %s in %zu segments from %zu servers\n",
+			payload->remote_name, nsegs, nservers);
+
+	mask_signal(SIGPIPE, SIG_IGN, &orig_sig_pipe);
+	mask_signal(SIGINT, &inthandler, &orig_sig_int);
+
+	seglen = payload->max_size / nsegs;
+	for(i = 0; i < nsegs; i++) {
+		struct dload_segment *seg = segs + i;
+		seg->payload = payload;
+		seg->fd = fd;
+		seg->offset = i * seglen;
+		seg->length = (i == nsegs - 1) ? payload->max_size - seg->offset : seglen;
+		payload->ranges[i].total = seg->length;
+		seg->server = i % nservers;
+		if(dload_segment_start(seg, multi, urls[seg->server]) != 0) {
+			break;
+		}
+	}
+	if(i == nsegs) {
+		ret = dload_segments_run(payload, multi, segs, nsegs, urls, nservers);
+	}
+
+	unmask_signal(SIGINT, &orig_sig_int);
+	unmask_signal(SIGPIPE, &orig_sig_pipe);
+
+	if(ret == 0) {
+		if(handle->dlcb || handle->dlprogresscb) {
+			for(i = 0; i < nsegs; i++) {
+				payload->ranges[i].downloaded = payload->ranges[i].total;
+			}
+			dload_report(payload, payload->max_size, payload->max_size);
+		}
+		if(close(fd) != 0) {
+			ret = -1;
+		}
+		fd = -1;
+	}
+	if(ret == 0 && rename(payload->tempfile_name, payload->destfile_name) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not rename %s to %s (%s)\n"),
+				payload->tempfile_name, payload->destfile_name, strerror(errno));
+		ret = -1;
+	}
+
+cleanup:
+	if(segs) {
+		for(i = 0; i < nsegs; i++) {
+			if(segs[i].curl) {
+				if(multi) {
+					curl_multi_remove_handle(multi, segs[i].curl);
+				}
+				curl_easy_cleanup(segs[i].curl);
+			}
+		}
+		free(segs);
+	}
+	FREE(payload->ranges);
+	payload->nranges = 0;
+	if(fd >= 0) {
+		close(fd);
+	}
+	if(ret != 0) {
+		/* holes left by unfinished segments must never be resumed */
+		unlink(payload->tempfile_name);
+	}
+	free(urls);
+
+	if(dload_interrupted) {
+		raise(SIGINT);
+	}
+
+	return ret;
+}
 #endif
 
 /** Download a file given by a URL to a local directory.
@@ -626,6 +1222,10 @@ int _alpm_download(struct dload_payload *payload, const char *localpath,
 {
 	alpm_handle_t *handle = payload->handle;
 
+	payload->ttfb = -1;
+	payload->xfer_time = 0;
+	payload->xfer_bytes = 0;
+
 	if(handle->fetchcb == NULL) {
 #ifdef HAVE_LIBCURL
 		return curl_download_internal(payload, localpath, final_file, final_url);
@@ -644,6 +1244,38 @@ int _alpm_download(struct dload_payload *payload, const char *localpath,
 	}
 }
 
+/** Download a large file in byte ranges from several servers at once.
+ * The segments are written into a preallocated .part file which is only
+ * renamed into place once every range has arrived.
+ * @param payload the payload context, with remote_name and max_size set
+ * @param localpath the directory to save the file in
+ * @param servers the servers to spread the segments over
+ * @return 0 on success, 1 if the file should be fetched as a single stream
+ * instead, -1 on error
+ */
+int _alpm_download_segmented(struct dload_payload *payload,
+		const char *localpath, alpm_list_t *servers)
+{
+	alpm_handle_t *handle = payload->handle;
+
+	if(handle->fetchcb != NULL || handle->dlsegments < 2) {
+		return 1;
+	}
+
+	payload->ttfb = -1;
+	payload->xfer_time = 0;
+	payload->xfer_bytes = 0;
+	payload->prevprogress = 0;
+
+#ifdef HAVE_LIBCURL
+	return curl_download_segmented(payload, localpath, servers);
+#else
+	(void)localpath;
+	(void)servers;
+	return 1;
+#endif
+}
+
 static char *filecache_find_url(alpm_handle_t *handle, const char *url)
 {
 	const char *filebase = strrchr(url, '/');
@@ -740,6 +1372,12 @@ char SYMEXPORT *alpm_fetch_pkgurl(alpm_handle_t *handle, const char *url)
 	return filepath;
 }
 
+const alpm_dload_stats_t SYMEXPORT *alpm_dload_stats(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return &handle->dlstats;
+}
+
 void _alpm_dload_payload_reset(struct dload_payload *payload)
 {
 	ASSERT(payload, return);
@@ -749,6 +1387,7 @@ void _alpm_dload_payload_reset(struct dload_payload *payload)
 	FREE(payload->destfile_name);
 	FREE(payload->content_disp_name);
 	FREE(payload->fileurl);
+	FREE(payload->etag);
 	memset(payload, '\0', sizeof(*payload));
 }
 
@@ -26,6 +26,7 @@
 struct dload_payload {
 	alpm_handle_t *handle;
 	const char *tempfile_openmode;
+	const char *tempfile_suffix;    /* appended to remote_name, ".part" if NULL */
 	char *remote_name;
 	char *tempfile_name;
 	char *destfile_name;
@@ -36,11 +37,28 @@ struct dload_payload {
 	off_t initial_size;
 	off_t max_size;
 	off_t prevprogress;
+	/* expected checksums of the file, to check sources that are not trusted */
+	const char *md5sum;
+	const char *sha256sum;
+	/* progress snapshots passed to the front end */
+	uint64_t progress_start;  /* when the first snapshot of the file was made */
+	uint64_t progress_last;   /* when the last snapshot was made */
+	off_t progress_size;      /* bytes received at the last snapshot */
+	off_t progress_rate;      /* smoothed rate in bytes per second */
+	alpm_download_range_t *ranges; /* progress of each range of a split download */
+	size_t nranges;
+	/* how the last transfer went, for ranking servers */
+	double ttfb;            /* seconds until the first byte, -1 if unknown */
+	double xfer_time;       /* seconds the whole transfer took */
+	off_t xfer_bytes;       /* bytes received */
+	char *etag;             /* ETag the server sent with the file */
 	int force;
 	int allow_resume;
 	int errors_ok;
 	int unlink_on_fail;
 	int trust_remote_name;
+	int revalidate;         /* store ETags and send them back if not forced */
+	int quick;              /* give up early on a server that does not answer */
 #ifdef HAVE_LIBCURL
 	CURLcode curlerr;       /* last error produced by curl */
 #endif
@@ -50,6 +68,8 @@ void _alpm_dload_payload_reset(struct dload_payload *payload);
 
 int _alpm_download(struct dload_payload *payload, const char *localpath,
 		char **final_file, const char **final_url);
+int _alpm_download_segmented(struct dload_payload *payload,
+		const char *localpath, alpm_list_t *servers);
 
 #endif /* _ALPM_DLOAD_H */
 
@@ -38,6 +38,11 @@
 #include "trans.h"
 #include "alpm.h"
 #include "deps.h"
+#include "signing.h"
+#include "sigcache.h"
+#include "mirrors.h"
+#include "validators.h"
+#include "hashcache.h"
 
 alpm_handle_t *_alpm_handle_new(void)
 {
@@ -46,6 +51,13 @@ alpm_handle_t *_alpm_handle_new(void)
 	CALLOC(handle, 1, sizeof(alpm_handle_t), return NULL);
 	handle->deltaratio = 0.0;
 	handle->lockfd = -1;
+#ifdef HAVE_SYNCFS
+	handle->durability = ALPM_DURABILITY_TRANSACTION;
+#else
+	/* without syncfs() a flush syncs every mounted filesystem */
+	handle->durability = ALPM_DURABILITY_NONE;
+#endif
+	handle->dlsegments = 1;
 
 	return handle;
 }
@@ -67,11 +79,26 @@ void _alpm_handle_free(alpm_handle_t *handle)
 	}
 
 #ifdef HAVE_LIBCURL
-	/* release curl handle */
+	/* release curl handles, the share last as the others may still use it */
 	curl_easy_cleanup(handle->curl);
+	if(handle->curlmulti) {
+		curl_multi_cleanup(handle->curlmulti);
+	}
+	if(handle->curlshare) {
+		curl_share_cleanup(handle->curlshare);
+	}
 #endif
 
+	_alpm_mirrors_free(handle);
+	_alpm_validators_free(handle);
+	_alpm_hashcache_free(handle);
+	_alpm_filesums_free(handle);
+
 #ifdef HAVE_LIBGPGME
+	/* close any session a caller left open, however deeply nested */
+	handle->gpgme_session = 0;
+	_alpm_gpgme_session_end(handle);
+	_alpm_sigcache_free(handle);
 	FREELIST(handle->known_keys);
 #endif
 
@@ -84,10 +111,12 @@ void _alpm_handle_free(alpm_handle_t *handle)
 	FREE(handle->dbext);
 	FREELIST(handle->cachedirs);
 	FREELIST(handle->hookdirs);
+	FREELIST(handle->cachepeers);
 	FREE(handle->logfile);
 	FREE(handle->lockfile);
 	FREE(handle->arch);
 	FREE(handle->gpgdir);
+	FREE(handle->storedir);
 	FREELIST(handle->noupgrade);
 	FREELIST(handle->noextract);
 	FREELIST(handle->ignorepkg);
@@ -181,6 +210,12 @@ alpm_cb_download SYMEXPORT alpm_option_get_dlcb(alpm_handle_t *handle)
 	return handle->dlcb;
 }
 
+alpm_cb_dlprogress SYMEXPORT alpm_option_get_dlprogresscb(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return handle->dlprogresscb;
+}
+
 alpm_cb_fetch SYMEXPORT alpm_option_get_fetchcb(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -235,6 +270,12 @@ alpm_list_t SYMEXPORT *alpm_option_get_cachedirs(alpm_handle_t *handle)
 	return handle->cachedirs;
 }
 
+alpm_list_t SYMEXPORT *alpm_option_get_cachepeers(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return handle->cachepeers;
+}
+
 const char SYMEXPORT *alpm_option_get_logfile(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -253,6 +294,12 @@ const char SYMEXPORT *alpm_option_get_gpgdir(alpm_handle_t *handle)
 	return handle->gpgdir;
 }
 
+const char SYMEXPORT *alpm_option_get_storedir(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return handle->storedir;
+}
+
 int SYMEXPORT alpm_option_get_usesyslog(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -307,6 +354,42 @@ int SYMEXPORT alpm_option_get_checkspace(alpm_handle_t *handle)
 	return handle->checkspace;
 }
 
+int SYMEXPORT alpm_option_get_filestamps(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->filestamps;
+}
+
+int SYMEXPORT alpm_option_get_scoremirrors(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->scoremirrors;
+}
+
+int SYMEXPORT alpm_option_get_dlsegments(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->dlsegments;
+}
+
+int SYMEXPORT alpm_option_get_hashedcache(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->hashedcache;
+}
+
+unsigned int SYMEXPORT alpm_option_get_progressinterval(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return 0);
+	return handle->progressinterval;
+}
+
+alpm_durability_t SYMEXPORT alpm_option_get_durability(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->durability;
+}
+
 const char SYMEXPORT *alpm_option_get_dbext(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -327,6 +410,14 @@ int SYMEXPORT alpm_option_set_dlcb(alpm_handle_t *handle, alpm_cb_download cb)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_dlprogresscb(alpm_handle_t *handle,
+		alpm_cb_dlprogress cb)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->dlprogresscb = cb;
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_fetchcb(alpm_handle_t *handle, alpm_cb_fetch cb)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -515,6 +606,71 @@ int SYMEXPORT alpm_option_remove_cachedir(alpm_handle_t *handle, const char *cac
 	return 0;
 }
 
+static char *sanitize_peer(const char *url)
+{
+	char *newurl;
+	size_t len = strlen(url);
+
+	STRDUP(newurl, url, return NULL);
+	/* strip the trailing slash if one exists */
+	if(len > 0 && newurl[len - 1] == '/') {
+		newurl[len - 1] = '\0';
+	}
+	return newurl;
+}
+
+int SYMEXPORT alpm_option_add_cachepeer(alpm_handle_t *handle, const char *url)
+{
+	char *newurl;
+
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(url != NULL && strlen(url) > 0, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	newurl = sanitize_peer(url);
+	if(!newurl) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	handle->cachepeers = alpm_list_add(handle->cachepeers, newurl);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "option 'cachepeer' = %s\n", newurl);
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_cachepeers(alpm_handle_t *handle, alpm_list_t *urls)
+{
+	alpm_list_t *i;
+	CHECK_HANDLE(handle, return -1);
+	if(handle->cachepeers) {
+		FREELIST(handle->cachepeers);
+	}
+	for(i = urls; i; i = i->next) {
+		int ret = alpm_option_add_cachepeer(handle, i->data);
+		if(ret) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+int SYMEXPORT alpm_option_remove_cachepeer(alpm_handle_t *handle, const char *url)
+{
+	char *vdata = NULL;
+	char *newurl;
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(url != NULL && strlen(url) > 0, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	newurl = sanitize_peer(url);
+	if(!newurl) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	handle->cachepeers = alpm_list_remove_str(handle->cachepeers, newurl, &vdata);
+	FREE(newurl);
+	if(vdata != NULL) {
+		FREE(vdata);
+		return 1;
+	}
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_logfile(alpm_handle_t *handle, const char *logfile)
 {
 	char *oldlogfile = handle->logfile;
@@ -551,6 +707,21 @@ int SYMEXPORT alpm_option_set_gpgdir(alpm_handle_t *handle, const char *gpgdir)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_storedir(alpm_handle_t *handle, const char *storedir)
+{
+	int err;
+	CHECK_HANDLE(handle, return -1);
+	if(!storedir) {
+		FREE(handle->storedir);
+		return 0;
+	}
+	if((err = _alpm_set_directory_option(storedir, &(handle->storedir), 1))) {
+		RET_ERR(handle, err, -1);
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "option 'storedir' = %s\n", handle->storedir);
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_usesyslog(alpm_handle_t *handle, int usesyslog)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -761,6 +932,54 @@ int SYMEXPORT alpm_option_set_checkspace(alpm_handle_t *handle, int checkspace)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_filestamps(alpm_handle_t *handle, int filestamps)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->filestamps = filestamps;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_scoremirrors(alpm_handle_t *handle, int scoremirrors)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->scoremirrors = scoremirrors;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_dlsegments(alpm_handle_t *handle, int segments)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(segments > 0, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->dlsegments = segments;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_hashedcache(alpm_handle_t *handle, int hashedcache)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->hashedcache = hashedcache;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_progressinterval(alpm_handle_t *handle,
+		unsigned int msecs)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->progressinterval = msecs;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_durability(alpm_handle_t *handle,
+		alpm_durability_t durability)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(durability >= ALPM_DURABILITY_NONE
+			&& durability <= ALPM_DURABILITY_PACKAGE,
+			RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->durability = durability;
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_dbext(alpm_handle_t *handle, const char *dbext)
 {
 	CHECK_HANDLE(handle, return -1);
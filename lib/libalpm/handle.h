@@ -31,6 +31,10 @@
 #include <curl/curl.h>
 #endif
 
+#ifdef HAVE_LIBGPGME
+#include <gpgme.h>
+#endif
+
 #define EVENT(h, e) \
 do { \
 	if((h)->eventcb) { \
@@ -45,7 +49,7 @@ do { \
 } while(0)
 #define PROGRESS(h, e, p, per, n, r) \
 do { \
-	if((h)->progresscb) { \
+	if((h)->progresscb && _alpm_progress_due(h, e, per, r)) { \
 		(h)->progresscb(e, p, per, n, r); \
 	} \
 } while(0)
@@ -60,10 +64,31 @@ struct __alpm_handle_t {
 #ifdef HAVE_LIBCURL
 	/* libcurl handle */
 	CURL *curl;             /* reusable curl_easy handle */
+	CURLSH *curlshare;      /* hosts, TLS sessions and connections of all transfers */
+	CURLM *curlmulti;       /* drives segmented downloads */
 #endif
+	alpm_dload_stats_t dlstats;
+
+	alpm_list_t *mirrorstats;   /* how servers performed on recent downloads */
+	int mirrorstats_loaded;     /* mirrorstats were read from disk? */
+	int mirrorstats_dirty;      /* mirrorstats differ from what is on disk? */
+	alpm_list_t *validators;    /* ETags of downloaded databases and signatures */
+	int validators_loaded;      /* validators were read from disk? */
+	int validators_dirty;       /* validators differ from what is on disk? */
+	alpm_list_t *hashcaches;    /* indexes of hashed cache directories */
+	alpm_list_t *filesums;      /* sha256sums of files hashed so far */
 
 #ifdef HAVE_LIBGPGME
 	alpm_list_t *known_keys;  /* keys verified to be in our keychain */
+	int gpgme_session;        /* open verification sessions (nesting depth) */
+	gpgme_ctx_t gpgme_ctx;    /* context shared by the current session */
+	alpm_list_t *gpgme_keys;  /* key lookups cached for the current session */
+	alpm_time_t sig_expires;  /* earliest signature expiry of the last check */
+	char **sigcache;          /* package signatures known to be good, sorted */
+	size_t sigcache_count;    /* number of entries in sigcache */
+	size_t sigcache_size;     /* allocated size of sigcache in bytes */
+	char *sigcache_stamp;     /* keyring state the sigcache is valid for */
+	int sigcache_current;     /* on-disk sigcache matches sigcache_stamp? */
 #endif
 
 	/* callback functions */
@@ -74,6 +99,14 @@ struct __alpm_handle_t {
 	alpm_cb_event eventcb;
 	alpm_cb_question questioncb;
 	alpm_cb_progress progresscb;
+	alpm_cb_dlprogress dlprogresscb; /* Download progress snapshot callback */
+
+	/* progress reporting */
+	unsigned int progressinterval; /* Minimum milliseconds between reports */
+	uint64_t progress_last;        /* When the last operation report was made */
+	alpm_progress_t progress_event;
+	size_t progress_current;
+	int progress_percent;
 
 	/* filesystem paths */
 	char *root;              /* Root path, default '/' */
@@ -81,8 +114,10 @@ struct __alpm_handle_t {
 	char *logfile;           /* Name of the log file */
 	char *lockfile;          /* Name of the lock file */
 	char *gpgdir;            /* Directory where GnuPG files are stored */
+	char *storedir;          /* Store of pre-extracted packages to reflink from */
 	alpm_list_t *cachedirs;  /* Paths to pacman cache directories */
 	alpm_list_t *hookdirs;   /* Paths to hook directories */
+	alpm_list_t *cachepeers; /* URLs of peers serving their package cache */
 
 	/* package lists */
 	alpm_list_t *noupgrade;   /* List of packages NOT to be upgraded */
@@ -96,6 +131,11 @@ struct __alpm_handle_t {
 	double deltaratio;       /* Download deltas if possible; a ratio value */
 	int usesyslog;           /* Use syslog instead of logfile? */ /* TODO move to frontend */
 	int checkspace;          /* Check disk space before installing */
+	int filestamps;          /* Record installed file stamps in the local db */
+	int scoremirrors;        /* Try servers in order of measured speed */
+	int dlsegments;          /* Ranges to split large downloads into */
+	int hashedcache;         /* Store cached packages by content hash */
+	alpm_durability_t durability; /* When to flush committed changes to disk */
 	char *dbext;             /* Sync DB extension */
 	alpm_siglevel_t siglevel;   /* Default signature verification level */
 	alpm_siglevel_t localfilesiglevel;  /* Signature verification level for local file
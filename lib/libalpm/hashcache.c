@@ -0,0 +1,726 @@
+/*
+ *  hashcache.c
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/* libalpm */
+#include "hashcache.h"
+#include "alpm_list.h"
+#include "handle.h"
+#include "log.h"
+#include "util.h"
+
+/*
+ * A hashed cache directory stores the contents of every package file once,
+ * named by its sha256, as <cachedir>.sha256/<first two digits>/<sha256>. A
+ * signature is kept next to the contents with a .sig suffix. The names the
+ * files were downloaded under are mapped to their contents by the index
+ * <cachedir>.sha256/index, which holds one "<sha256> <filename>" line per
+ * name. Adding a name appends a line; removing names rewrites the file. All
+ * writers hold an flock() on the index, so several roots can share one cache.
+ *
+ * Packages are downloaded under their plain name and moved into this layout
+ * once a transaction has validated them, see _alpm_hashcache_store().
+ */
+
+#define HASHCACHE_DIR ".sha256/"
+#define HASHCACHE_INDEX HASHCACHE_DIR "index"
+
+struct hashcache_entry {
+	char *filename;
+	unsigned long hash;
+	char sha256[65];
+	struct hashcache_entry *next;
+};
+
+struct hashcache {
+	char *cachedir;
+	struct hashcache_entry **buckets;
+	size_t nbuckets;
+	size_t count;
+	alpm_list_t *files;     /* alpm_cachefile_t list handed out to frontends */
+};
+
+static int is_sha256(const char *str)
+{
+	int i;
+	for(i = 0; i < 64; i++) {
+		if(!((str[i] >= '0' && str[i] <= '9') || (str[i] >= 'a' && str[i] <= 'f'))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int sha256_cmp(const void *p1, const void *p2)
+{
+	return strcmp(*(const char * const *)p1, *(const char * const *)p2);
+}
+
+static int is_pkgfile(const char *filename)
+{
+	return fnmatch("*.pkg.tar*", filename, 0) == 0
+		&& fnmatch("*.sig", filename, 0) != 0
+		&& fnmatch("*.part", filename, 0) != 0;
+}
+
+/** Take name and version of a package from the name of its file.
+ * Package files are named name-pkgver-pkgrel-arch.pkg.tar.* by makepkg;
+ * names that do not follow that pattern are left for the caller to load.
+ * @return 0 on success, -1 if the file name does not follow the pattern
+ */
+static int parse_pkgfile(const char *filename, char **name, char **version)
+{
+	const char *end = strstr(filename, ".pkg.tar"), *p, *dash[3];
+	int i, digits = 1;
+
+	if(end == NULL) {
+		return -1;
+	}
+	/* find the dashes before arch, pkgrel and pkgver */
+	for(p = end, i = 0; i < 3; i++) {
+		while(p > filename && *(p - 1) != '-') {
+			p--;
+		}
+		if(p <= filename + 1) {
+			return -1;
+		}
+		dash[i] = --p;
+	}
+	/* arch must not be empty or a number, pkgrel must only hold digits and dots */
+	for(p = dash[0] + 1; p < end; p++) {
+		digits = digits && *p >= '0' && *p <= '9';
+	}
+	if(dash[0] + 1 == end || digits || dash[1] + 1 == dash[0]
+			|| dash[2] + 1 == dash[1]) {
+		return -1;
+	}
+	for(p = dash[1] + 1; p < dash[0]; p++) {
+		if(!(*p >= '0' && *p <= '9') && *p != '.') {
+			return -1;
+		}
+	}
+
+	STRNDUP(*name, filename, dash[2] - filename, return -1);
+	STRNDUP(*version, dash[2] + 1, dash[0] - dash[2] - 1, FREE(*name); return -1);
+	return 0;
+}
+
+static int add_file(struct hashcache *hc, const char *filename,
+		const char *path, int hashed)
+{
+	alpm_cachefile_t *file;
+
+	CALLOC(file, 1, sizeof(alpm_cachefile_t), return -1);
+	hc->files = alpm_list_add(hc->files, file);
+	STRDUP(file->filename, filename, return -1);
+	STRDUP(file->path, path, return -1);
+	file->hashed = hashed;
+	parse_pkgfile(filename, &file->name, &file->version);
+	return 0;
+}
+
+static void blob_path(const char *cachedir, const char *sha256,
+		const char *suffix, char *path)
+{
+	snprintf(path, PATH_MAX, "%s" HASHCACHE_DIR "%.2s/%s%s",
+			cachedir, sha256, sha256, suffix);
+}
+
+static void free_files(struct hashcache *hc)
+{
+	alpm_list_t *i;
+	for(i = hc->files; i; i = i->next) {
+		alpm_cachefile_t *file = i->data;
+		free(file->filename);
+		free(file->path);
+		free(file->name);
+		free(file->version);
+		free(file);
+	}
+	alpm_list_free(hc->files);
+	hc->files = NULL;
+}
+
+static struct hashcache_entry *entry_find(struct hashcache *hc,
+		const char *filename)
+{
+	unsigned long hash;
+	struct hashcache_entry *e;
+
+	if(hc->nbuckets == 0) {
+		return NULL;
+	}
+	hash = _alpm_hash_sdbm(filename);
+	for(e = hc->buckets[hash % hc->nbuckets]; e; e = e->next) {
+		if(e->hash == hash && strcmp(e->filename, filename) == 0) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static int hashcache_grow(struct hashcache *hc)
+{
+	size_t i, nbuckets = hc->nbuckets ? hc->nbuckets * 2 : 256;
+	struct hashcache_entry **buckets;
+
+	CALLOC(buckets, nbuckets, sizeof(struct hashcache_entry *), return -1);
+	for(i = 0; i < hc->nbuckets; i++) {
+		struct hashcache_entry *e, *next;
+		for(e = hc->buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = buckets[e->hash % nbuckets];
+			buckets[e->hash % nbuckets] = e;
+		}
+	}
+	free(hc->buckets);
+	hc->buckets = buckets;
+	hc->nbuckets = nbuckets;
+	return 0;
+}
+
+static int entry_set(struct hashcache *hc, const char *sha256,
+		const char *filename)
+{
+	struct hashcache_entry *e = entry_find(hc, filename);
+	size_t idx;
+
+	if(e) {
+		if(memcmp(e->sha256, sha256, 64) != 0) {
+			memcpy(e->sha256, sha256, 64);
+			free_files(hc);
+		}
+		return 0;
+	}
+	free_files(hc);
+
+	if(hc->count >= hc->nbuckets / 4 * 3 && hashcache_grow(hc) != 0) {
+		return -1;
+	}
+	CALLOC(e, 1, sizeof(struct hashcache_entry), return -1);
+	STRDUP(e->filename, filename, free(e); return -1);
+	e->hash = _alpm_hash_sdbm(filename);
+	memcpy(e->sha256, sha256, 64);
+	idx = e->hash % hc->nbuckets;
+	e->next = hc->buckets[idx];
+	hc->buckets[idx] = e;
+	hc->count++;
+	return 0;
+}
+
+static void entry_unset(struct hashcache *hc, const char *filename)
+{
+	struct hashcache_entry **prev, *e;
+	unsigned long hash;
+
+	if(hc->nbuckets == 0) {
+		return;
+	}
+	hash = _alpm_hash_sdbm(filename);
+	for(prev = &hc->buckets[hash % hc->nbuckets]; (e = *prev); prev = &e->next) {
+		if(e->hash == hash && strcmp(e->filename, filename) == 0) {
+			*prev = e->next;
+			free(e->filename);
+			free(e);
+			hc->count--;
+			return;
+		}
+	}
+}
+
+static void hashcache_clear(struct hashcache *hc)
+{
+	size_t i;
+	for(i = 0; i < hc->nbuckets; i++) {
+		struct hashcache_entry *e, *next;
+		for(e = hc->buckets[i]; e; e = next) {
+			next = e->next;
+			free(e->filename);
+			free(e);
+		}
+	}
+	FREE(hc->buckets);
+	hc->nbuckets = 0;
+	hc->count = 0;
+	free_files(hc);
+}
+
+/** Merge the index lines of a stream into the in-memory index.
+ * Lines without a trailing newline are skipped, they may still be written.
+ */
+static void hashcache_read(struct hashcache *hc, FILE *fp)
+{
+	char line[PATH_MAX + 80];
+
+	while(fgets(line, sizeof(line), fp)) {
+		size_t len = strlen(line);
+		if(len < 67 || line[len - 1] != '\n' || line[64] != ' '
+				|| !is_sha256(line)) {
+			continue;
+		}
+		_alpm_strip_newline(line, len);
+		if(strchr(line + 65, '/') || line[65] == '.') {
+			continue;
+		}
+		entry_set(hc, line, line + 65);
+	}
+}
+
+static struct hashcache *hashcache_get(alpm_handle_t *handle,
+		const char *cachedir)
+{
+	struct hashcache *hc;
+	char path[PATH_MAX];
+	alpm_list_t *i;
+	FILE *fp;
+
+	for(i = handle->hashcaches; i; i = i->next) {
+		hc = i->data;
+		if(strcmp(hc->cachedir, cachedir) == 0) {
+			return hc;
+		}
+	}
+
+	CALLOC(hc, 1, sizeof(struct hashcache), return NULL);
+	STRDUP(hc->cachedir, cachedir, free(hc); return NULL);
+	handle->hashcaches = alpm_list_add(handle->hashcaches, hc);
+
+	snprintf(path, PATH_MAX, "%s%s", cachedir, HASHCACHE_INDEX);
+	if((fp = fopen(path, "r")) != NULL) {
+		hashcache_read(hc, fp);
+		fclose(fp);
+		_alpm_log(handle, ALPM_LOG_DEBUG, "loaded %zu entries from %s\n",
+				hc->count, path);
+	}
+	return hc;
+}
+
+/** Open and lock the index of a cache directory.
+ * The index is replaced when names are removed, so the lock is only taken
+ * once the file that was opened is still the index.
+ * @return a locked file descriptor, -1 on error
+ */
+static int index_open(struct hashcache *hc, int flags)
+{
+	char path[PATH_MAX];
+	struct stat fst, st;
+	int fd;
+
+	snprintf(path, PATH_MAX, "%s%s", hc->cachedir, HASHCACHE_INDEX);
+	for(;;) {
+		do {
+			fd = open(path, flags | O_CREAT | O_CLOEXEC, 0644);
+		} while(fd == -1 && errno == EINTR);
+		if(fd < 0) {
+			return -1;
+		}
+		if(flock(fd, LOCK_EX) != 0 || fstat(fd, &fst) != 0) {
+			close(fd);
+			return -1;
+		}
+		if(stat(path, &st) == 0 && st.st_dev == fst.st_dev
+				&& st.st_ino == fst.st_ino) {
+			return fd;
+		}
+		close(fd);
+	}
+}
+
+/** Add a name to the index of a cache directory.
+ * @param fd the index, opened with index_open() for appending
+ */
+static int hashcache_append(struct hashcache *hc, int fd,
+		const char *sha256, const char *filename)
+{
+	char line[PATH_MAX + 80];
+	int len;
+
+	len = snprintf(line, sizeof(line), "%s %s\n", sha256, filename);
+	if(len < 0 || (size_t)len >= sizeof(line)) {
+		return -1;
+	}
+	if(write(fd, line, len) != len) {
+		return -1;
+	}
+	entry_set(hc, sha256, filename);
+	return 0;
+}
+
+/** Move a flat signature file next to the stored contents of its package. */
+static void adopt_sig(const char *cachedir, const char *filename,
+		const char *blob)
+{
+	char flat[PATH_MAX], sig[PATH_MAX];
+	struct stat st;
+
+	snprintf(flat, PATH_MAX, "%s%s.sig", cachedir, filename);
+	if(stat(flat, &st) != 0) {
+		return;
+	}
+	snprintf(sig, PATH_MAX, "%s.sig", blob);
+	if(stat(sig, &st) == 0 || rename(flat, sig) != 0) {
+		unlink(flat);
+	}
+}
+
+/** Move a package file stored under its own name into the hashed layout.
+ * Contents already stored in any cache directory are not stored again.
+ * The index of a directory is locked before its contents are looked at, so
+ * contents cannot be removed between finding them and naming them.
+ * @return path of the stored contents, NULL if the file was left alone
+ */
+static char *hashcache_add(alpm_handle_t *handle, struct hashcache *hc,
+		const char *filename)
+{
+	char flat[PATH_MAX], blob[PATH_MAX];
+	char *sha256, *ret = NULL;
+	struct stat st;
+	alpm_list_t *i;
+	int fd;
+
+	snprintf(flat, PATH_MAX, "%s%s", hc->cachedir, filename);
+	if((sha256 = _alpm_file_sha256sum(handle, flat)) == NULL) {
+		return NULL;
+	}
+
+	for(i = handle->cachedirs; i; i = i->next) {
+		struct hashcache *other = hashcache_get(handle, i->data);
+
+		blob_path(i->data, sha256, "", blob);
+		if(!other || stat(blob, &st) != 0) {
+			continue;
+		}
+		if((fd = index_open(other, O_WRONLY | O_APPEND)) < 0) {
+			continue;
+		}
+		/* another root may have removed the contents in the meantime */
+		if(stat(blob, &st) == 0
+				&& hashcache_append(other, fd, sha256, filename) == 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "%s is already cached as %s\n",
+					filename, blob);
+			unlink(flat);
+			adopt_sig(hc->cachedir, filename, blob);
+			close(fd);
+			STRDUP(ret, blob, goto cleanup);
+			goto cleanup;
+		}
+		close(fd);
+	}
+
+	blob_path(hc->cachedir, sha256, "", blob);
+	*strrchr(blob, '/') = '\0';
+	if(_alpm_makepath(blob) != 0) {
+		goto cleanup;
+	}
+	blob[strlen(blob)] = '/';
+	if((fd = index_open(hc, O_WRONLY | O_APPEND)) < 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not open cache index in %s: %s\n",
+				hc->cachedir, strerror(errno));
+		goto cleanup;
+	}
+	if(rename(flat, blob) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not move %s to %s: %s\n",
+				flat, blob, strerror(errno));
+		close(fd);
+		goto cleanup;
+	}
+	if(hashcache_append(hc, fd, sha256, filename) != 0) {
+		rename(blob, flat);
+		close(fd);
+		goto cleanup;
+	}
+	adopt_sig(hc->cachedir, filename, blob);
+	close(fd);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "moved %s to %s\n", flat, blob);
+	STRDUP(ret, blob, goto cleanup);
+
+cleanup:
+	free(sha256);
+	return ret;
+}
+
+/** Look up a file in a hashed cache directory.
+ * A signature is found by the name of its package.
+ * @param handle the context handle
+ * @param cachedir the cache directory to look in
+ * @param filename name of the package or signature file
+ * @return malloced path of the file, NULL if it is not in the hashed layout
+ */
+char *_alpm_hashcache_find(alpm_handle_t *handle, const char *cachedir,
+		const char *filename)
+{
+	struct hashcache *hc = hashcache_get(handle, cachedir);
+	struct hashcache_entry *e;
+	char path[PATH_MAX], *pkgname;
+	size_t len = strlen(filename);
+	int sig = len > 4 && strcmp(filename + len - 4, ".sig") == 0;
+	struct stat st;
+
+	if(!hc) {
+		return NULL;
+	}
+
+	STRNDUP(pkgname, filename, sig ? len - 4 : len, return NULL);
+	if((e = entry_find(hc, pkgname)) != NULL) {
+		blob_path(cachedir, e->sha256, "", path);
+		if(stat(path, &st) != 0) {
+			/* contents are gone, the name may be stored flat again */
+			free(pkgname);
+			return NULL;
+		}
+		adopt_sig(cachedir, pkgname, path);
+		free(pkgname);
+		if(sig) {
+			strcat(path, ".sig");
+			if(stat(path, &st) != 0) {
+				return NULL;
+			}
+		}
+		return strdup(path);
+	}
+	free(pkgname);
+	return NULL;
+}
+
+/** Move a package file stored under its own name into the hashed layout.
+ * The first cache directory holding the file stores it; contents already
+ * stored in any cache directory are only given the new name.
+ * @param handle the context handle
+ * @param filename name of the package file
+ * @return 0 on success or if there was nothing to move, -1 on error
+ */
+int _alpm_hashcache_store(alpm_handle_t *handle, const char *filename)
+{
+	alpm_list_t *i;
+
+	if(!is_pkgfile(filename)) {
+		return 0;
+	}
+	for(i = handle->cachedirs; i; i = i->next) {
+		struct hashcache *hc;
+		char path[PATH_MAX], *blob;
+		struct stat st;
+
+		snprintf(path, PATH_MAX, "%s%s", (char *)i->data, filename);
+		if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if((hc = hashcache_get(handle, i->data)) == NULL
+				|| (blob = hashcache_add(handle, hc, filename)) == NULL) {
+			return -1;
+		}
+		free(blob);
+		return 0;
+	}
+	return 0;
+}
+
+void _alpm_hashcache_free(alpm_handle_t *handle)
+{
+	alpm_list_t *i;
+	for(i = handle->hashcaches; i; i = i->next) {
+		struct hashcache *hc = i->data;
+		hashcache_clear(hc);
+		free(hc->cachedir);
+		free(hc);
+	}
+	alpm_list_free(handle->hashcaches);
+	handle->hashcaches = NULL;
+}
+
+/** Get the package files in a cache directory.
+ * Both files stored under their own name and, for hashed cache directories,
+ * the names in the index are listed. Name and version are taken from the
+ * file names, no package is opened.
+ * @param handle the context handle
+ * @param cachedir a cache directory as returned by alpm_option_get_cachedirs()
+ * @return a list of alpm_cachefile_t owned by the handle; it stays valid until
+ * the next call or until the cache is modified
+ */
+alpm_list_t SYMEXPORT *alpm_cache_get_files(alpm_handle_t *handle,
+		const char *cachedir)
+{
+	struct hashcache *hc;
+	struct dirent *ent;
+	DIR *dir;
+	size_t i;
+
+	CHECK_HANDLE(handle, return NULL);
+	ASSERT(cachedir != NULL, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, NULL));
+
+	if((hc = hashcache_get(handle, cachedir)) == NULL) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+	}
+	free_files(hc);
+
+	if((dir = opendir(cachedir)) != NULL) {
+		while((ent = readdir(dir)) != NULL) {
+			char path[PATH_MAX];
+
+			if(!is_pkgfile(ent->d_name)) {
+				continue;
+			}
+			snprintf(path, PATH_MAX, "%s%s", cachedir, ent->d_name);
+			if(add_file(hc, ent->d_name, path, 0) != 0) {
+				closedir(dir);
+				goto error;
+			}
+		}
+		closedir(dir);
+	}
+
+	for(i = 0; i < hc->nbuckets; i++) {
+		struct hashcache_entry *e;
+		for(e = hc->buckets[i]; e; e = e->next) {
+			char path[PATH_MAX];
+
+			blob_path(cachedir, e->sha256, "", path);
+			if(add_file(hc, e->filename, path, 1) != 0) {
+				goto error;
+			}
+		}
+	}
+	return hc->files;
+
+error:
+	free_files(hc);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+}
+
+/** Remove package files from a hashed cache directory.
+ * Stored contents and signatures no longer referred to by any name are
+ * deleted as well.
+ * @param handle the context handle
+ * @param cachedir a cache directory as returned by alpm_option_get_cachedirs()
+ * @param filenames names of the files to remove
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int SYMEXPORT alpm_cache_remove_files(alpm_handle_t *handle,
+		const char *cachedir, alpm_list_t *filenames)
+{
+	struct hashcache *hc;
+	char path[PATH_MAX], tmppath[PATH_MAX];
+	alpm_list_t *i, *names = NULL, *removed = NULL;
+	const char **kept = NULL;
+	size_t b;
+	FILE *fp = NULL;
+	int fd, ret = -1;
+
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(cachedir != NULL, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	if((hc = hashcache_get(handle, cachedir)) == NULL) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	/* the names may belong to the file list, which changes below */
+	names = alpm_list_strdup(filenames);
+	if((fd = index_open(hc, O_RDWR)) < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s%s: %s\n"),
+				cachedir, HASHCACHE_INDEX, strerror(errno));
+		FREELIST(names);
+		RET_ERR(handle, ALPM_ERR_SYSTEM, -1);
+	}
+
+	/* pick up names other roots sharing the cache added since it was read */
+	if((fp = fdopen(dup(fd), "r")) != NULL) {
+		hashcache_read(hc, fp);
+		fclose(fp);
+	}
+
+	for(i = names; i; i = i->next) {
+		struct hashcache_entry *e = entry_find(hc, i->data);
+		if(e) {
+			char *sha256;
+			STRDUP(sha256, e->sha256, goto cleanup);
+			removed = alpm_list_add(removed, sha256);
+			entry_unset(hc, i->data);
+		}
+	}
+	free_files(hc);
+
+	snprintf(path, PATH_MAX, "%s%s", cachedir, HASHCACHE_INDEX);
+	snprintf(tmppath, PATH_MAX, "%s%s.tmp", cachedir, HASHCACHE_INDEX);
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				tmppath, strerror(errno));
+		handle->pm_errno = ALPM_ERR_SYSTEM;
+		goto cleanup;
+	}
+	for(b = 0; b < hc->nbuckets; b++) {
+		struct hashcache_entry *e;
+		for(e = hc->buckets[b]; e; e = e->next) {
+			fprintf(fp, "%s %s\n", e->sha256, e->filename);
+		}
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not write %s: %s\n"),
+				path, strerror(errno));
+		unlink(tmppath);
+		handle->pm_errno = ALPM_ERR_SYSTEM;
+		goto cleanup;
+	}
+
+	/* drop contents no name refers to anymore */
+	if(removed) {
+		size_t n = 0;
+		CALLOC(kept, hc->count + 1, sizeof(char *), goto cleanup);
+		for(b = 0; b < hc->nbuckets; b++) {
+			struct hashcache_entry *e;
+			for(e = hc->buckets[b]; e; e = e->next) {
+				kept[n++] = e->sha256;
+			}
+		}
+		qsort(kept, n, sizeof(char *), sha256_cmp);
+		removed = alpm_list_msort(removed, alpm_list_count(removed), _alpm_str_cmp);
+		for(i = removed; i; i = i->next) {
+			const char *sha256 = i->data;
+			if((i->next && strcmp(sha256, i->next->data) == 0)
+					|| bsearch(&sha256, kept, n, sizeof(char *), sha256_cmp)) {
+				continue;
+			}
+			blob_path(cachedir, sha256, "", path);
+			_alpm_log(handle, ALPM_LOG_DEBUG, "removing %s\n", path);
+			unlink(path);
+			strcat(path, ".sig");
+			unlink(path);
+			*strrchr(path, '/') = '\0';
+			rmdir(path);
+		}
+	}
+	ret = 0;
+
+cleanup:
+	close(fd);
+	free(kept);
+	FREELIST(names);
+	FREELIST(removed);
+	return ret;
+}
+
+/* vim: set noet: */
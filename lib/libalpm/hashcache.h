@@ -0,0 +1,32 @@
+/*
+ *  hashcache.h
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALPM_HASHCACHE_H
+#define _ALPM_HASHCACHE_H
+
+#include "alpm.h"
+
+char *_alpm_hashcache_find(alpm_handle_t *handle, const char *cachedir,
+		const char *filename);
+int _alpm_hashcache_store(alpm_handle_t *handle, const char *filename);
+void _alpm_hashcache_free(alpm_handle_t *handle);
+
+#endif /* _ALPM_HASHCACHE_H */
+
+/* vim: set noet: */
@@ -68,6 +68,17 @@ static inline int _alpm_archive_read_support_filter_all(struct archive *archive)
 #endif
 }
 
+static inline int _alpm_archive_entry_is_sparse(struct archive_entry *entry)
+{
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+	return archive_entry_sparse_count(entry) > 0;
+#else
+	/* sparse information is not available, assume the worst */
+	(void)entry;
+	return 1;
+#endif
+}
+
 #endif /* _LIBARCHIVE_COMPAT_H */
 
 /* vim: set noet: */
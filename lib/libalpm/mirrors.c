@@ -0,0 +1,414 @@
+/*
+ *  mirrors.c
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
+#include <stdint.h> /* intmax_t */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libalpm */
+#include "mirrors.h"
+#include "alpm_list.h"
+#include "handle.h"
+#include "dload.h"
+#include "log.h"
+#include "util.h"
+
+/*
+ * Mirror statistics remember how each server performed on recent downloads,
+ * so the servers of a repository can be tried fastest first instead of in
+ * configured order. They are kept in the database directory as a text file
+ * with one line per server:
+ *
+ *   <last used> <samples> <seconds to first byte> <bytes/s> <failure share> <url>
+ *
+ * Servers without recent statistics are tried first, in configured order,
+ * so every server gets measured; the rest follow by expected download time.
+ * The failure share of a server decays while it is not used, so a server
+ * that failed once is eventually tried again rather than written off until
+ * its statistics go stale.
+ */
+
+#define MIRRORS_FILE "mirrorstats"
+
+/* weight of the newest sample in the running averages */
+#define MIRROR_WEIGHT 0.3
+/* statistics older than this are measured afresh */
+#define MIRROR_STALE (14 * 24 * 60 * 60)
+/* the failure share of an unused server halves after this long */
+#define MIRROR_FAILURE_HALFLIFE (6 * 60 * 60)
+/* smaller transfers say too little about throughput */
+#define MIRROR_MIN_RATE_BYTES (64 * 1024)
+/* size used for ranking when the size of a file is not known */
+#define MIRROR_DEFAULT_SIZE (1024 * 1024)
+
+struct mirror_stat {
+	char *server;
+	alpm_time_t last;     /* when the server was last used */
+	unsigned int samples;
+	double ttfb;          /* seconds until the first byte, -1 if unknown */
+	double rate;          /* bytes per second, 0 if unknown */
+	double failures;      /* share of recent downloads that failed */
+};
+
+struct mirror_rank {
+	const char *server;
+	double cost;
+	size_t pos;
+};
+
+static void mirror_stat_free(struct mirror_stat *stat)
+{
+	free(stat->server);
+	free(stat);
+}
+
+static struct mirror_stat *mirrors_find(alpm_handle_t *handle,
+		const char *server)
+{
+	alpm_list_t *i;
+
+	for(i = handle->mirrorstats; i; i = i->next) {
+		struct mirror_stat *stat = i->data;
+		if(strcmp(stat->server, server) == 0) {
+			return stat;
+		}
+	}
+	return NULL;
+}
+
+static char *mirrors_path(alpm_handle_t *handle)
+{
+	size_t len = strlen(handle->dbpath) + strlen(MIRRORS_FILE) + 1;
+	char *path;
+
+	MALLOC(path, len, return NULL);
+	snprintf(path, len, "%s%s", handle->dbpath, MIRRORS_FILE);
+	return path;
+}
+
+/**
+ * Read the statistics file, once per handle.
+ * @param handle the context handle
+ */
+static void mirrors_load(alpm_handle_t *handle)
+{
+	char line[PATH_MAX + 128];
+	char *path;
+	FILE *fp;
+
+	if(handle->mirrorstats_loaded) {
+		return;
+	}
+	handle->mirrorstats_loaded = 1;
+
+	if((path = mirrors_path(handle)) == NULL) {
+		return;
+	}
+	fp = fopen(path, "r");
+	free(path);
+	if(fp == NULL) {
+		return;
+	}
+
+	while(safe_fgets(line, sizeof(line), fp)) {
+		struct mirror_stat *stat;
+		intmax_t last;
+		unsigned int samples;
+		double ttfb, rate, failures;
+		int pos = 0;
+
+		if(_alpm_strip_newline(line, 0) == 0) {
+			continue;
+		}
+		if(sscanf(line, "%jd %u %lf %lf %lf %n", &last, &samples, &ttfb,
+					&rate, &failures, &pos) != 5 || pos == 0 || line[pos] == '\0'
+				|| mirrors_find(handle, line + pos)) {
+			continue;
+		}
+		CALLOC(stat, 1, sizeof(struct mirror_stat), break);
+		STRDUP(stat->server, line + pos, free(stat); break);
+		stat->last = (alpm_time_t)last;
+		stat->samples = samples;
+		stat->ttfb = ttfb;
+		stat->rate = rate;
+		stat->failures = failures;
+		handle->mirrorstats = alpm_list_add(handle->mirrorstats, stat);
+	}
+	fclose(fp);
+}
+
+/**
+ * Estimate how long downloading a file from a server takes, allowing for
+ * the retries its failures cost.
+ * @param stat statistics of the server
+ * @param size size of the file to download
+ * @param fallback_ttfb time to first byte to assume if the server's is not
+ * known
+ * @param fallback_rate throughput to assume if the server's is not known
+ * @param now the current time
+ * @return the expected number of seconds
+ */
+static double mirror_cost(const struct mirror_stat *stat, double size,
+		double fallback_ttfb, double fallback_rate, alpm_time_t now)
+{
+	double cost, rate, failures = stat->failures;
+	alpm_time_t age;
+
+	/* forgive old failures, so servers that failed get another chance */
+	for(age = now - stat->last; age >= MIRROR_FAILURE_HALFLIFE && failures > 0.001;
+			age -= MIRROR_FAILURE_HALFLIFE) {
+		failures /= 2;
+	}
+
+	/* a server that never delivered anything is assumed to be average */
+	cost = stat->ttfb >= 0 ? stat->ttfb : fallback_ttfb;
+	rate = stat->rate > 0 ? stat->rate : fallback_rate;
+	if(rate > 0) {
+		cost += size / rate;
+	}
+	failures = failures < 0.95 ? failures : 0.95;
+	return cost / (1.0 - failures);
+}
+
+static int mirror_rank_cmp(const void *p1, const void *p2)
+{
+	const struct mirror_rank *r1 = p1;
+	const struct mirror_rank *r2 = p2;
+
+	if(r1->cost < r2->cost) {
+		return -1;
+	} else if(r1->cost > r2->cost) {
+		return 1;
+	}
+	return r1->pos < r2->pos ? -1 : (r1->pos > r2->pos);
+}
+
+/**
+ * Order servers by how fast they are expected to deliver a file.
+ * Without ScoreMirrors, or if anything fails, the configured order is kept.
+ * @param handle the context handle
+ * @param servers the configured servers of a repository
+ * @param size size of the file to download, 0 if unknown
+ * @return a new list of the same server strings; free with alpm_list_free()
+ */
+alpm_list_t *_alpm_mirrors_sort(alpm_handle_t *handle, alpm_list_t *servers,
+		off_t size)
+{
+	struct mirror_rank *ranks;
+	const struct mirror_stat **stats;
+	alpm_list_t *i, *sorted = NULL;
+	size_t count, known = 0, responsive = 0, idx;
+	double rate_sum = 0, ttfb_sum = 0, fallback_rate, fallback_ttfb;
+	alpm_time_t now;
+
+	count = alpm_list_count(servers);
+	if(!handle->scoremirrors || count < 2) {
+		return alpm_list_copy(servers);
+	}
+	mirrors_load(handle);
+
+	CALLOC(ranks, count, sizeof(struct mirror_rank), return alpm_list_copy(servers));
+	CALLOC(stats, count, sizeof(struct mirror_stat *),
+			free(ranks); return alpm_list_copy(servers));
+
+	now = time(NULL);
+	for(i = servers, idx = 0; i; i = i->next, idx++) {
+		const struct mirror_stat *stat = mirrors_find(handle, i->data);
+		if(stat && stat->samples > 0 && now - stat->last <= MIRROR_STALE) {
+			stats[idx] = stat;
+			if(stat->rate > 0) {
+				rate_sum += stat->rate;
+				known++;
+			}
+			if(stat->ttfb >= 0) {
+				ttfb_sum += stat->ttfb;
+				responsive++;
+			}
+		}
+	}
+	fallback_rate = known ? rate_sum / known : 0;
+	fallback_ttfb = responsive ? ttfb_sum / responsive : 0;
+
+	for(i = servers, idx = 0; i; i = i->next, idx++) {
+		ranks[idx].server = i->data;
+		ranks[idx].pos = idx;
+		/* unmeasured servers go first so they get measured */
+		ranks[idx].cost = stats[idx] ? mirror_cost(stats[idx],
+				size > 0 ? (double)size : MIRROR_DEFAULT_SIZE, fallback_ttfb,
+				fallback_rate, now) : -1;
+	}
+	qsort(ranks, count, sizeof(struct mirror_rank), mirror_rank_cmp);
+
+	for(idx = 0; idx < count; idx++) {
+		if(ranks[idx].cost < 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "mirror %s: not measured yet\n",
+					ranks[idx].server);
+		} else {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "mirror %s: expected %.3fs\n",
+					ranks[idx].server, ranks[idx].cost);
+		}
+		sorted = alpm_list_add(sorted, (void *)ranks[idx].server);
+	}
+	free(stats);
+	free(ranks);
+	return sorted;
+}
+
+/**
+ * Account a transfer to the server it was made from.
+ * @param handle the context handle
+ * @param server the server the transfer was made from
+ * @param failed whether the transfer failed
+ * @param ttfb seconds until the first byte arrived, -1 if unknown
+ * @param bytes number of bytes transferred
+ * @param seconds duration of the whole transfer
+ */
+void _alpm_mirrors_sample(alpm_handle_t *handle, const char *server,
+		int failed, double ttfb, off_t bytes, double seconds)
+{
+	struct mirror_stat *stat;
+	alpm_time_t now;
+	double weight;
+
+	if(!handle->scoremirrors) {
+		return;
+	}
+	mirrors_load(handle);
+
+	now = time(NULL);
+	stat = mirrors_find(handle, server);
+	if(stat == NULL) {
+		CALLOC(stat, 1, sizeof(struct mirror_stat), return);
+		STRDUP(stat->server, server, free(stat); return);
+		stat->ttfb = -1;
+		handle->mirrorstats = alpm_list_add(handle->mirrorstats, stat);
+	} else if(now - stat->last > MIRROR_STALE) {
+		stat->samples = 0;
+		stat->ttfb = -1;
+		stat->rate = 0;
+		stat->failures = 0;
+	}
+
+	weight = stat->samples ? MIRROR_WEIGHT : 1.0;
+	stat->failures += weight * ((failed ? 1.0 : 0.0) - stat->failures);
+
+	if(!failed && ttfb >= 0) {
+		if(stat->ttfb < 0) {
+			stat->ttfb = ttfb;
+		} else {
+			stat->ttfb += MIRROR_WEIGHT * (ttfb - stat->ttfb);
+		}
+		if(bytes >= MIRROR_MIN_RATE_BYTES && seconds > ttfb) {
+			double rate = bytes / (seconds - ttfb);
+			if(stat->rate <= 0) {
+				stat->rate = rate;
+			} else {
+				stat->rate += MIRROR_WEIGHT * (rate - stat->rate);
+			}
+		}
+	}
+
+	stat->samples++;
+	stat->last = now;
+	handle->mirrorstats_dirty = 1;
+}
+
+/**
+ * Account a download attempt to the server it was made from.
+ * @param handle the context handle
+ * @param server the server the file was requested from
+ * @param payload the payload of the download
+ * @param ret the return value of _alpm_download()
+ */
+void _alpm_mirrors_record(alpm_handle_t *handle, const char *server,
+		const struct dload_payload *payload, int ret)
+{
+	if(ret == -1 && payload->errors_ok) {
+		/* optional files going missing says nothing about the server */
+		return;
+	}
+	_alpm_mirrors_sample(handle, server, ret == -1, payload->ttfb,
+			payload->xfer_bytes, payload->xfer_time);
+}
+
+/**
+ * Write the statistics back if they changed. Callers must hold the
+ * database lock.
+ * @param handle the context handle
+ */
+void _alpm_mirrors_save(alpm_handle_t *handle)
+{
+	char *path, *tmppath;
+	alpm_list_t *i;
+	size_t len;
+	FILE *fp;
+
+	if(!handle->mirrorstats_dirty) {
+		return;
+	}
+	if((path = mirrors_path(handle)) == NULL) {
+		return;
+	}
+	len = strlen(path) + 5;
+	MALLOC(tmppath, len, free(path); return);
+	snprintf(tmppath, len, "%s.tmp", path);
+
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write %s: %s\n",
+				tmppath, strerror(errno));
+		goto cleanup;
+	}
+	for(i = handle->mirrorstats; i; i = i->next) {
+		const struct mirror_stat *stat = i->data;
+		fprintf(fp, "%jd %u %.6f %.0f %.4f %s\n", (intmax_t)stat->last,
+				stat->samples, stat->ttfb, stat->rate, stat->failures,
+				stat->server);
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write %s: %s\n",
+				path, strerror(errno));
+		unlink(tmppath);
+		goto cleanup;
+	}
+	handle->mirrorstats_dirty = 0;
+
+cleanup:
+	free(tmppath);
+	free(path);
+}
+
+/**
+ * Forget the in-memory statistics.
+ * @param handle the context handle
+ */
+void _alpm_mirrors_free(alpm_handle_t *handle)
+{
+	alpm_list_free_inner(handle->mirrorstats, (alpm_list_fn_free)mirror_stat_free);
+	alpm_list_free(handle->mirrorstats);
+	handle->mirrorstats = NULL;
+	handle->mirrorstats_loaded = 0;
+	handle->mirrorstats_dirty = 0;
+}
+
+/* vim: set noet: */
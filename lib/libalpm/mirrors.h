@@ -0,0 +1,38 @@
+/*
+ *  mirrors.h
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALPM_MIRRORS_H
+#define _ALPM_MIRRORS_H
+
+#include "alpm.h"
+
+struct dload_payload;
+
+alpm_list_t *_alpm_mirrors_sort(alpm_handle_t *handle, alpm_list_t *servers,
+		off_t size);
+void _alpm_mirrors_sample(alpm_handle_t *handle, const char *server,
+		int failed, double ttfb, off_t bytes, double seconds);
+void _alpm_mirrors_record(alpm_handle_t *handle, const char *server,
+		const struct dload_payload *payload, int ret);
+void _alpm_mirrors_save(alpm_handle_t *handle);
+void _alpm_mirrors_free(alpm_handle_t *handle);
+
+#endif /* _ALPM_MIRRORS_H */
+
+/* vim: set noet: */
@@ -105,6 +105,12 @@ static alpm_list_t *_pkg_get_replaces(alpm_pkg_t *pkg)   { return pkg->replaces;
 static alpm_filelist_t *_pkg_get_files(alpm_pkg_t *pkg)  { return &(pkg->files); }
 static alpm_list_t *_pkg_get_backup(alpm_pkg_t *pkg)     { return pkg->backup; }
 
+static const alpm_filestamp_t *_pkg_get_filestamp(alpm_pkg_t UNUSED *pkg,
+		const char UNUSED *path)
+{
+	return NULL;
+}
+
 static void *_pkg_changelog_open(alpm_pkg_t UNUSED *pkg)
 {
 	return NULL;
@@ -166,6 +172,7 @@ struct pkg_operations default_pkg_ops = {
 	.get_replaces    = _pkg_get_replaces,
 	.get_files       = _pkg_get_files,
 	.get_backup      = _pkg_get_backup,
+	.get_filestamp   = _pkg_get_filestamp,
 
 	.changelog_open  = _pkg_changelog_open,
 	.changelog_read  = _pkg_changelog_read,
@@ -377,6 +384,15 @@ alpm_list_t SYMEXPORT *alpm_pkg_get_backup(alpm_pkg_t *pkg)
 	return pkg->ops->get_backup(pkg);
 }
 
+const alpm_filestamp_t SYMEXPORT *alpm_pkg_get_filestamp(alpm_pkg_t *pkg,
+		const char *path)
+{
+	ASSERT(pkg != NULL, return NULL);
+	ASSERT(path != NULL, RET_ERR(pkg->handle, ALPM_ERR_WRONG_ARGS, NULL));
+	pkg->handle->pm_errno = 0;
+	return pkg->ops->get_filestamp(pkg, path);
+}
+
 alpm_db_t SYMEXPORT *alpm_pkg_get_db(alpm_pkg_t *pkg)
 {
 	/* Sanity checks */
@@ -447,28 +463,17 @@ int SYMEXPORT alpm_pkg_has_scriptlet(alpm_pkg_t *pkg)
 static void find_requiredby(alpm_pkg_t *pkg, alpm_db_t *db, alpm_list_t **reqs,
 		int optional)
 {
-	const alpm_list_t *i;
+	alpm_list_t *i, *found;
 	pkg->handle->pm_errno = 0;
 
-	for(i = _alpm_db_get_pkgcache(db); i; i = i->next) {
-		alpm_pkg_t *cachepkg = i->data;
-		alpm_list_t *j;
-
-		if(optional == 0) {
-			j = alpm_pkg_get_depends(cachepkg);
-		} else {
-			j = alpm_pkg_get_optdepends(cachepkg);
-		}
-
-		for(; j; j = j->next) {
-			if(_alpm_depcmp(pkg, j->data)) {
-				const char *cachepkgname = cachepkg->name;
-				if(alpm_list_find_str(*reqs, cachepkgname) == NULL) {
-					*reqs = alpm_list_add(*reqs, strdup(cachepkgname));
-				}
-			}
+	found = _alpm_db_find_requiredby(db, pkg, optional);
+	for(i = found; i; i = i->next) {
+		const char *cachepkgname = ((alpm_pkg_t *)i->data)->name;
+		if(alpm_list_find_str(*reqs, cachepkgname) == NULL) {
+			*reqs = alpm_list_add(*reqs, strdup(cachepkgname));
 		}
 	}
+	alpm_list_free(found);
 }
 
 static alpm_list_t *compute_requiredby(alpm_pkg_t *pkg, int optional)
@@ -620,7 +625,8 @@ int _alpm_pkg_dup(alpm_pkg_t *pkg, alpm_pkg_t **new_ptr)
 	}
 
 	/* internal */
-	newpkg->infolevel = pkg->infolevel;
+	/* recorded stamps are not copied, they are reloaded on request */
+	newpkg->infolevel = pkg->infolevel & ~INFRQ_STAMPS;
 	newpkg->origin = pkg->origin;
 	if(newpkg->origin == ALPM_PKG_FROM_FILE) {
 		STRDUP(newpkg->origin_data.file, pkg->origin_data.file, goto cleanup);
@@ -672,6 +678,13 @@ void _alpm_pkg_free(alpm_pkg_t *pkg)
 		}
 		free(pkg->files.files);
 	}
+	if(pkg->stamps_count) {
+		size_t i;
+		for(i = 0; i < pkg->stamps_count; i++) {
+			FREE(pkg->stamps[i].name);
+		}
+	}
+	FREE(pkg->stamps);
 	alpm_list_free_inner(pkg->backup, (alpm_list_fn_free)_alpm_backup_free);
 	alpm_list_free(pkg->backup);
 	free_deplist(pkg->depends);
@@ -64,6 +64,7 @@ struct pkg_operations {
 	alpm_list_t *(*get_replaces) (alpm_pkg_t *);
 	alpm_filelist_t *(*get_files) (alpm_pkg_t *);
 	alpm_list_t *(*get_backup) (alpm_pkg_t *);
+	const alpm_filestamp_t *(*get_filestamp) (alpm_pkg_t *, const char *);
 
 	void *(*changelog_open) (alpm_pkg_t *);
 	size_t (*changelog_read) (void *, size_t, const alpm_pkg_t *, void *);
@@ -122,6 +123,8 @@ struct __alpm_pkg_t {
 	struct pkg_operations *ops;
 
 	alpm_filelist_t files;
+	alpm_filestamp_t *stamps;
+	size_t stamps_count;
 
 	/* origin == PKG_FROM_FILE, use pkg->origin_data.file
 	 * origin == PKG_FROM_*DB, use pkg->origin_data.db */
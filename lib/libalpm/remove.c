@@ -29,6 +29,7 @@
 #include <dirent.h>
 #include <regex.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -278,25 +279,25 @@ int _alpm_remove_prepare(alpm_handle_t *handle, alpm_list_t **data)
  * @brief Test if a directory is being used as a mountpoint.
  *
  * @param handle context handle
- * @param directory path to test, must be absolute and include trailing '/'
- * @param stbuf stat result for @a directory, may be NULL
+ * @param dirfd descriptor of the directory containing @a name
+ * @param name name of the directory to test, relative to @a dirfd
+ * @param stbuf stat result for @a name, may be NULL
  *
- * @return 0 if @a directory is not a mountpoint or on error, 1 if @a directory
+ * @return 0 if @a name is not a mountpoint or on error, 1 if @a name
  * is a mountpoint
  */
-static int dir_is_mountpoint(alpm_handle_t *handle, const char *directory,
-		const struct stat *stbuf)
+static int dir_is_mountpoint(alpm_handle_t *handle, int dirfd,
+		const char *name, const struct stat *stbuf)
 {
-	char parent_dir[PATH_MAX];
 	struct stat parent_stbuf;
 	dev_t dir_st_dev;
 
 	if(stbuf == NULL) {
 		struct stat dir_stbuf;
-		if(stat(directory, &dir_stbuf) < 0) {
+		if(fstatat(dirfd, name, &dir_stbuf, 0) < 0) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"failed to stat directory %s: %s\n",
-					directory, strerror(errno));
+					name, strerror(errno));
 			return 0;
 		}
 		dir_st_dev = dir_stbuf.st_dev;
@@ -304,11 +305,10 @@ static int dir_is_mountpoint(alpm_handle_t *handle, const char *directory,
 		dir_st_dev = stbuf->st_dev;
 	}
 
-	snprintf(parent_dir, PATH_MAX, "%s..", directory);
-	if(stat(parent_dir, &parent_stbuf) < 0) {
+	if(fstat(dirfd, &parent_stbuf) < 0) {
 		_alpm_log(handle, ALPM_LOG_DEBUG,
-				"failed to stat parent of %s: %s: %s\n",
-				directory, parent_dir, strerror(errno));
+				"failed to stat parent of %s: %s\n",
+				name, strerror(errno));
 		return 0;
 	}
 
@@ -319,30 +319,44 @@ static int dir_is_mountpoint(alpm_handle_t *handle, const char *directory,
  * @brief Check if alpm can delete a file.
  *
  * @param handle the context handle
+ * @param ds directory stack rooted at the handle root
  * @param file file to be removed
  *
  * @return 1 if the file can be deleted, 0 if it cannot be deleted
  */
-static int can_remove_file(alpm_handle_t *handle, const alpm_file_t *file)
+static int can_remove_file(alpm_handle_t *handle, alpm_dirstack_t *ds,
+		const alpm_file_t *file)
 {
-	char filepath[PATH_MAX];
-
-	snprintf(filepath, PATH_MAX, "%s%s", handle->root, file->name);
+	char name[PATH_MAX];
+	int dirfd, err;
+
+	dirfd = _alpm_dirstack_parent(ds, file->name, name, PATH_MAX);
+	if(dirfd < 0) {
+		/* the parent directory is gone or unreadable, nothing to remove */
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not open parent of %s%s: %s\n",
+				handle->root, file->name, strerror(errno));
+		return 1;
+	}
 
 	if(file->name[strlen(file->name) - 1] == '/' &&
-			dir_is_mountpoint(handle, filepath, NULL)) {
+			dir_is_mountpoint(handle, dirfd, name, NULL)) {
 		/* we do not remove mountpoints */
 		return 1;
 	}
 
 	/* If we fail write permissions due to a read-only filesystem, abort.
 	 * Assume all other possible failures are covered somewhere else */
-	if(_alpm_access(handle, NULL, filepath, W_OK) == -1) {
-		if(errno != EACCES && errno != ETXTBSY && access(filepath, F_OK) == 0) {
+	if(faccessat(dirfd, name, W_OK, 0) == -1) {
+		err = errno;
+		_alpm_log(handle, ALPM_LOG_DEBUG, "\"%s%s\" is not writable: %s\n",
+				handle->root, file->name, strerror(err));
+		if(err != EACCES && err != ETXTBSY && faccessat(dirfd, name, F_OK, 0) == 0) {
 			/* only return failure if the file ACTUALLY exists and we can't write to
 			 * it - ignore "chmod -w" simple permission failures */
+			char filepath[PATH_MAX];
+			snprintf(filepath, PATH_MAX, "%s%s", handle->root, file->name);
 			_alpm_log(handle, ALPM_LOG_ERROR, _("cannot remove file '%s': %s\n"),
-					filepath, strerror(errno));
+					filepath, strerror(err));
 			return 0;
 		}
 	}
@@ -430,25 +444,32 @@ cleanup:
  * @param newpkg the package replacing \a oldpkg
  * @param fileobj file to remove
  * @param nosave whether files should be backed up
+ * @param ds directory stack rooted at the handle root
  *
  * @return 0 on success, -1 if there was an error unlinking the file, 1 if the
  * file was skipped or did not exist
  */
 static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
-		alpm_pkg_t *newpkg, const alpm_file_t *fileobj, int nosave)
+		alpm_pkg_t *newpkg, const alpm_file_t *fileobj, int nosave,
+		alpm_dirstack_t *ds)
 {
 	struct stat buf;
+	char name[PATH_MAX];
 	char file[PATH_MAX];
+	int dirfd;
 
-	snprintf(file, PATH_MAX, "%s%s", handle->root, fileobj->name);
-
-	if(llstat(file, &buf)) {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "file %s does not exist\n", file);
+	dirfd = _alpm_dirstack_parent(ds, fileobj->name, name, PATH_MAX);
+	if(dirfd < 0 || fstatat(dirfd, name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "file %s%s does not exist\n",
+				handle->root, fileobj->name);
 		return 1;
 	}
 
 	if(S_ISDIR(buf.st_mode)) {
-		ssize_t files = _alpm_files_in_directory(handle, file, 0);
+		ssize_t files;
+
+		snprintf(file, PATH_MAX, "%s%s", handle->root, fileobj->name);
+		files = _alpm_files_in_directory(handle, file, 0);
 		/* if we have files, no need to remove the directory */
 		if(files > 0) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "keeping directory %s (contains files)\n",
@@ -460,7 +481,7 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 					fileobj->name)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"keeping directory %s (in new package)\n", file);
-		} else if(dir_is_mountpoint(handle, file, &buf)) {
+		} else if(dir_is_mountpoint(handle, dirfd, name, &buf)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"keeping directory %s (mountpoint)\n", file);
 		} else {
@@ -486,7 +507,7 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 				}
 			}
 			if(!found) {
-				if(rmdir(file)) {
+				if(unlinkat(dirfd, name, AT_REMOVEDIR)) {
 					_alpm_log(handle, ALPM_LOG_DEBUG,
 							"directory removal of %s failed: %s\n", file, strerror(errno));
 					return -1;
@@ -499,6 +520,8 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 	} else {
 		/* if the file needs backup and has been modified, back it up to .pacsave */
 		alpm_backup_t *backup = _alpm_needbackup(fileobj->name, oldpkg);
+
+		snprintf(file, PATH_MAX, "%s%s", handle->root, fileobj->name);
 		if(backup) {
 			if(nosave) {
 				_alpm_log(handle, ALPM_LOG_DEBUG, "transaction is set to NOSAVE, not backing up '%s'\n", file);
@@ -537,7 +560,7 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 
 		_alpm_log(handle, ALPM_LOG_DEBUG, "unlinking %s\n", file);
 
-		if(unlink(file) == -1) {
+		if(unlinkat(dirfd, name, 0) == -1) {
 			_alpm_log(handle, ALPM_LOG_ERROR, _("cannot remove %s (%s)\n"),
 					file, strerror(errno));
 			alpm_logaction(handle, ALPM_CALLER_PREFIX,
@@ -584,18 +607,26 @@ static int remove_package_files(alpm_handle_t *handle,
 		size_t targ_count, size_t pkg_count)
 {
 	alpm_filelist_t *filelist;
+	alpm_dirstack_t ds;
 	size_t i;
-	int err = 0;
+	int err = 0, last_percent = 0;
 	int nosave = handle->trans->flags & ALPM_TRANS_FLAG_NOSAVE;
 
+	if(_alpm_dirstack_open(&ds, handle->root, 0) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open directory: %s: %s\n"),
+				handle->root, strerror(errno));
+		RET_ERR(handle, ALPM_ERR_PKG_CANT_REMOVE, -1);
+	}
+
 	filelist = alpm_pkg_get_files(oldpkg);
 	for(i = 0; i < filelist->count; i++) {
 		alpm_file_t *file = filelist->files + i;
 		if(!should_skip_file(handle, newpkg, file->name)
-				&& !can_remove_file(handle, file)) {
+				&& !can_remove_file(handle, &ds, file)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"not removing package '%s', can't remove all files\n",
 					oldpkg->name);
+			_alpm_dirstack_close(&ds);
 			RET_ERR(handle, ALPM_ERR_PKG_CANT_REMOVE, -1);
 		}
 	}
@@ -608,7 +639,9 @@ static int remove_package_files(alpm_handle_t *handle,
 				pkg_count, targ_count);
 	}
 
-	/* iterate through the list backwards, unlinking files */
+	/* iterate through the list backwards, unlinking files; the list is sorted,
+	 * so the contents of a directory are visited before the directory itself
+	 * and neighbouring entries share their open parent directories */
 	for(i = filelist->count; i > 0; i--) {
 		alpm_file_t *file = filelist->files + i - 1;
 
@@ -621,18 +654,23 @@ static int remove_package_files(alpm_handle_t *handle,
 			continue;
 		}
 
-		if(unlink_file(handle, oldpkg, newpkg, file, nosave) < 0) {
+		if(unlink_file(handle, oldpkg, newpkg, file, nosave, &ds) < 0) {
 			err++;
 		}
 
 		if(!newpkg) {
-			/* update progress bar after each file */
+			/* update progress bar whenever the percentage changes */
 			int percent = ((filelist->count - i) * 100) / filelist->count;
-			PROGRESS(handle, ALPM_PROGRESS_REMOVE_START, oldpkg->name,
-					percent, pkg_count, targ_count);
+			if(percent != last_percent) {
+				PROGRESS(handle, ALPM_PROGRESS_REMOVE_START, oldpkg->name,
+						percent, pkg_count, targ_count);
+				last_percent = percent;
+			}
 		}
 	}
 
+	_alpm_dirstack_close(&ds);
+
 	if(!newpkg) {
 		/* set progress to 100% after we finish unlinking files */
 		PROGRESS(handle, ALPM_PROGRESS_REMOVE_START, oldpkg->name, 100,
@@ -720,6 +758,12 @@ int _alpm_remove_single_package(alpm_handle_t *handle,
 				pkgname);
 	}
 
+	handle->trans->sync_pending = 1;
+	if(!newpkg) {
+		/* an upgrade is flushed once its new entry has been written */
+		_alpm_trans_flush(handle, ALPM_DURABILITY_PACKAGE);
+	}
+
 	/* TODO: useful return values */
 	return 0;
 }
@@ -0,0 +1,447 @@
+/*
+ *  sigcache.c
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h> /* intmax_t, uintmax_t */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* libalpm */
+#include "sigcache.h"
+#include "alpm_list.h"
+#include "handle.h"
+#include "log.h"
+#include "signing.h"
+#include "util.h"
+
+/*
+ * The signature cache remembers package files whose signatures passed a full
+ * check, so installing the same file again can skip gpgme. It is stored in
+ * the first cache directory as a text file: the first line is a stamp of the
+ * keyring state, and every following line holds the sha256 of a package file,
+ * the sha256 of its signature and the time the signature expires (0 if it
+ * never does). A file whose stamp does not match the current keyring is
+ * ignored and replaced on the next write.
+ *
+ * Entries are kept sorted in memory so lookups are a binary search. Key
+ * expiry is not recorded: a signature made by an expired key is accepted
+ * like a valid one, so it cannot change the outcome of a check.
+ */
+
+#ifdef HAVE_LIBGPGME
+#define SIGCACHE_FILE ".sigcache"
+
+/* length of the "<pkg sha256> <sig sha256>" key starting each entry */
+#define SIGCACHE_KEY_LEN (64 + 1 + 64)
+
+/* keyring files whose contents can change the outcome of a check */
+static const char *const keyring_files[] = {
+	"pubring.gpg", "pubring.kbx", "trustdb.gpg", "gpg.conf"
+};
+
+/**
+ * Describe the current state of the keyring by the identity, size and
+ * modification times of its files.
+ * @param handle the context handle
+ * @return a newly allocated stamp, or NULL on error
+ */
+static char *keyring_stamp(alpm_handle_t *handle)
+{
+	char stamp[1024];
+	size_t i, len = 0;
+
+	if(!handle->gpgdir) {
+		return NULL;
+	}
+
+	for(i = 0; i < ARRAYSIZE(keyring_files); i++) {
+		char path[PATH_MAX];
+		struct stat st;
+		int ret;
+
+		snprintf(path, PATH_MAX, "%s%s", handle->gpgdir, keyring_files[i]);
+		if(stat(path, &st) != 0) {
+			ret = snprintf(stamp + len, sizeof(stamp) - len, "-;");
+		} else {
+			ret = snprintf(stamp + len, sizeof(stamp) - len,
+					"%ju:%ju:%jd:%jd:%jd;", (uintmax_t)st.st_dev,
+					(uintmax_t)st.st_ino, (intmax_t)st.st_size,
+					(intmax_t)st.st_mtime, (intmax_t)st.st_ctime);
+		}
+		if(ret < 0 || (size_t)ret >= sizeof(stamp) - len) {
+			return NULL;
+		}
+		len += ret;
+	}
+
+	return strdup(stamp);
+}
+
+/**
+ * Build the path of the signature cache file.
+ * @param handle the context handle
+ * @param path storage for the path, PATH_MAX bytes long
+ * @return 0 on success, -1 if there is no cache directory
+ */
+static int sigcache_path(alpm_handle_t *handle, char *path)
+{
+	if(!handle->cachedirs) {
+		return -1;
+	}
+	snprintf(path, PATH_MAX, "%s%s", (const char *)handle->cachedirs->data,
+			SIGCACHE_FILE);
+	return 0;
+}
+
+static int entry_cmp(const void *p1, const void *p2)
+{
+	return strncmp(*(char * const *)p1, *(char * const *)p2, SIGCACHE_KEY_LEN);
+}
+
+/**
+ * Find the position of key in the sorted cache, or where it would be
+ * inserted.
+ * @param handle the context handle
+ * @param key the key to look for
+ * @param found set to 1 if the key is cached, 0 otherwise
+ * @return the index of the key or of its insertion point
+ */
+static size_t sigcache_search(alpm_handle_t *handle, const char *key, int *found)
+{
+	size_t lo = 0, hi = handle->sigcache_count;
+
+	*found = 0;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strncmp(handle->sigcache[mid], key, SIGCACHE_KEY_LEN);
+		if(cmp == 0) {
+			*found = 1;
+			return mid;
+		} else if(cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Check that a line read from the cache file is a well-formed entry.
+ * @param line the line without its newline
+ * @param len the length of line
+ * @return 1 if the entry is usable, 0 otherwise
+ */
+static int entry_valid(const char *line, size_t len)
+{
+	size_t i;
+
+	if(len <= SIGCACHE_KEY_LEN + 1 || line[64] != ' '
+			|| line[SIGCACHE_KEY_LEN] != ' ') {
+		return 0;
+	}
+	for(i = SIGCACHE_KEY_LEN + 1; i < len; i++) {
+		if(line[i] < '0' || line[i] > '9') {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Check whether the signature recorded by a cache entry has expired.
+ * @param entry the cache entry
+ * @return 1 if the signature has expired, 0 otherwise
+ */
+static int entry_expired(const char *entry)
+{
+	long long expires = strtoll(entry + SIGCACHE_KEY_LEN + 1, NULL, 10);
+	return expires != 0 && expires <= (long long)time(NULL);
+}
+
+/**
+ * Read the cached keys from disk if they were recorded under stamp.
+ * The file is only trusted if nobody but the current user could have
+ * written it; otherwise an unprivileged user sharing the cache directory
+ * could vouch for packages of their choosing.
+ * @param handle the context handle
+ * @param stamp the current keyring stamp
+ */
+static void sigcache_load(alpm_handle_t *handle, const char *stamp)
+{
+	char path[PATH_MAX], line[1024];
+	struct stat st;
+	FILE *fp;
+
+	if(sigcache_path(handle, path) != 0 || (fp = fopen(path, "r")) == NULL) {
+		return;
+	}
+
+	if(fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)
+			|| st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"ignoring signature cache %s, unsafe permissions\n", path);
+		fclose(fp);
+		return;
+	}
+
+	if(!fgets(line, sizeof(line), fp) || _alpm_strip_newline(line, 0) == 0
+			|| strcmp(line, stamp) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"signature cache %s is stale, keyring has changed\n", path);
+		fclose(fp);
+		return;
+	}
+
+	while(fgets(line, sizeof(line), fp)) {
+		char *entry;
+		if(!entry_valid(line, _alpm_strip_newline(line, 0))) {
+			continue;
+		}
+		if(!_alpm_greedy_grow((void **)&handle->sigcache, &handle->sigcache_size,
+					(handle->sigcache_count + 1) * sizeof(char *))) {
+			break;
+		}
+		STRDUP(entry, line, break);
+		handle->sigcache[handle->sigcache_count++] = entry;
+	}
+	fclose(fp);
+	qsort(handle->sigcache, handle->sigcache_count, sizeof(char *), entry_cmp);
+	handle->sigcache_current = 1;
+}
+
+/**
+ * Make sure the in-memory cache matches the current keyring, discarding it
+ * if the keyring has changed since it was loaded.
+ * @param handle the context handle
+ * @return 0 on success, -1 if the keyring state could not be determined
+ */
+static int sigcache_sync(alpm_handle_t *handle)
+{
+	char *stamp = keyring_stamp(handle);
+
+	if(!stamp) {
+		return -1;
+	}
+	if(handle->sigcache_stamp && strcmp(stamp, handle->sigcache_stamp) == 0) {
+		free(stamp);
+		return 0;
+	}
+
+	_alpm_sigcache_free(handle);
+	handle->sigcache_stamp = stamp;
+	sigcache_load(handle, stamp);
+	return 0;
+}
+
+/**
+ * Write the whole cache out under the current stamp, replacing any stale
+ * file atomically.
+ * @param handle the context handle
+ * @return 0 on success, -1 on error
+ */
+static int sigcache_rewrite(alpm_handle_t *handle)
+{
+	char path[PATH_MAX], tmppath[PATH_MAX + 4];
+	size_t i;
+	FILE *fp;
+
+	if(sigcache_path(handle, path) != 0) {
+		return -1;
+	}
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		return -1;
+	}
+	fprintf(fp, "%s\n", handle->sigcache_stamp);
+	for(i = 0; i < handle->sigcache_count; i++) {
+		fprintf(fp, "%s\n", handle->sigcache[i]);
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		unlink(tmppath);
+		return -1;
+	}
+	handle->sigcache_current = 1;
+	return 0;
+}
+
+/**
+ * Look up a package file in the signature cache.
+ * The key identifying the file and signature is returned in key whether or
+ * not it was found, so a successful check can be recorded without digesting
+ * the file again.
+ * @param handle the context handle
+ * @param pkgfile the package file to look up
+ * @param base64_sig signature from the sync database, or NULL to use the
+ * detached signature next to pkgfile
+ * @param key storage for the cache key; must be freed by the caller
+ * @return 1 if the signature is known to be good, 0 otherwise
+ */
+int _alpm_sigcache_check(alpm_handle_t *handle, const char *pkgfile,
+		const char *base64_sig, char **key)
+{
+	char *pkgsum, *sigsum;
+	size_t idx;
+	int found;
+
+	*key = NULL;
+	if(sigcache_sync(handle) != 0) {
+		return 0;
+	}
+
+	if(base64_sig) {
+		sigsum = _alpm_compute_sha256sum_buffer(base64_sig, strlen(base64_sig));
+	} else {
+		char *sigpath = _alpm_sigpath(handle, pkgfile);
+		sigsum = sigpath ? _alpm_file_sha256sum(handle, sigpath) : NULL;
+		free(sigpath);
+	}
+	if(!sigsum) {
+		return 0;
+	}
+	/* usually already digested when the sync checksum was verified */
+	if((pkgsum = _alpm_file_sha256sum(handle, pkgfile)) == NULL) {
+		free(sigsum);
+		return 0;
+	}
+
+	MALLOC(*key, SIGCACHE_KEY_LEN + 1, free(pkgsum); free(sigsum); return 0);
+	snprintf(*key, SIGCACHE_KEY_LEN + 1, "%s %s", pkgsum, sigsum);
+	free(pkgsum);
+	free(sigsum);
+
+	idx = sigcache_search(handle, *key, &found);
+	if(!found) {
+		return 0;
+	}
+	if(entry_expired(handle->sigcache[idx])) {
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"cached signature for %s has expired\n", pkgfile);
+		return 0;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG,
+			"signature for %s found in signature cache\n", pkgfile);
+	return 1;
+}
+
+/**
+ * Record a successful signature check in the cache.
+ * Only signatures that would pass under any signature level, i.e. good
+ * signatures from fully trusted keys, are recorded.
+ * @param handle the context handle
+ * @param key the key returned by _alpm_sigcache_check()
+ * @param siglist the results of the signature check
+ */
+void _alpm_sigcache_add(alpm_handle_t *handle, const char *key,
+		alpm_siglist_t *siglist)
+{
+	char path[PATH_MAX];
+	char *entry;
+	size_t num, idx;
+	int found, len;
+	FILE *fp;
+
+	if(!key || !handle->sigcache_stamp || !siglist || siglist->count == 0) {
+		return;
+	}
+	for(num = 0; num < siglist->count; num++) {
+		alpm_sigresult_t *result = siglist->results + num;
+		if((result->status != ALPM_SIGSTATUS_VALID
+					&& result->status != ALPM_SIGSTATUS_KEY_EXPIRED)
+				|| result->validity != ALPM_SIGVALIDITY_FULL) {
+			return;
+		}
+	}
+
+	len = snprintf(NULL, 0, "%s %jd", key, (intmax_t)handle->sig_expires);
+	MALLOC(entry, len + 1, return);
+	snprintf(entry, len + 1, "%s %jd", key, (intmax_t)handle->sig_expires);
+
+	idx = sigcache_search(handle, key, &found);
+	if(found) {
+		free(handle->sigcache[idx]);
+		handle->sigcache[idx] = entry;
+	} else {
+		if(!_alpm_greedy_grow((void **)&handle->sigcache, &handle->sigcache_size,
+					(handle->sigcache_count + 1) * sizeof(char *))) {
+			free(entry);
+			return;
+		}
+		memmove(handle->sigcache + idx + 1, handle->sigcache + idx,
+				(handle->sigcache_count - idx) * sizeof(char *));
+		handle->sigcache[idx] = entry;
+		handle->sigcache_count++;
+	}
+
+	/* a failed write only costs a full check next time */
+	if(!handle->sigcache_current) {
+		if(sigcache_rewrite(handle) != 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"could not write signature cache: %s\n", strerror(errno));
+		}
+		return;
+	}
+	if(sigcache_path(handle, path) == 0 && (fp = fopen(path, "a")) != NULL) {
+		fprintf(fp, "%s\n", entry);
+		fclose(fp);
+	}
+}
+
+/**
+ * Forget the in-memory signature cache.
+ * @param handle the context handle
+ */
+void _alpm_sigcache_free(alpm_handle_t *handle)
+{
+	size_t i;
+
+	for(i = 0; i < handle->sigcache_count; i++) {
+		free(handle->sigcache[i]);
+	}
+	FREE(handle->sigcache);
+	handle->sigcache_count = 0;
+	handle->sigcache_size = 0;
+	FREE(handle->sigcache_stamp);
+	handle->sigcache_current = 0;
+}
+
+#else /* HAVE_LIBGPGME */
+int _alpm_sigcache_check(alpm_handle_t UNUSED *handle,
+		const char UNUSED *pkgfile, const char UNUSED *base64_sig, char **key)
+{
+	*key = NULL;
+	return 0;
+}
+
+void _alpm_sigcache_add(alpm_handle_t UNUSED *handle, const char UNUSED *key,
+		alpm_siglist_t UNUSED *siglist)
+{
+}
+
+void _alpm_sigcache_free(alpm_handle_t UNUSED *handle)
+{
+}
+#endif /* HAVE_LIBGPGME */
+
+/* vim: set noet: */
@@ -0,0 +1,33 @@
+/*
+ *  sigcache.h
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALPM_SIGCACHE_H
+#define _ALPM_SIGCACHE_H
+
+#include "alpm.h"
+
+int _alpm_sigcache_check(alpm_handle_t *handle, const char *pkgfile,
+		const char *base64_sig, char **key);
+void _alpm_sigcache_add(alpm_handle_t *handle, const char *key,
+		alpm_siglist_t *siglist);
+void _alpm_sigcache_free(alpm_handle_t *handle);
+
+#endif /* _ALPM_SIGCACHE_H */
+
+/* vim: set noet: */
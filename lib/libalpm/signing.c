@@ -22,6 +22,8 @@
 #include <string.h>
 
 #ifdef HAVE_LIBGPGME
+#include <errno.h>
+#include <unistd.h> /* close() */
 #include <locale.h> /* setlocale() */
 #include <gpgme.h>
 #endif
@@ -208,6 +210,150 @@ gpg_error:
 	RET_ERR(handle, ALPM_ERR_GPGME, -1);
 }
 
+/**
+ * A key lookup cached for the length of a verification session.
+ * key is NULL if the fingerprint was not found in the keyring.
+ */
+struct session_key {
+	char *fpr;
+	gpgme_key_t key;
+};
+
+/**
+ * Start a verification session.
+ * Until the matching _alpm_gpgme_session_end() is called, all signature
+ * checks share a single GPGME context and cache their key lookups. The
+ * context is only created once the first check needs it. Sessions nest; the
+ * context lives until the outermost session ends.
+ * @param handle the context handle
+ */
+void _alpm_gpgme_session_begin(alpm_handle_t *handle)
+{
+	handle->gpgme_session++;
+}
+
+/**
+ * Forget all key lookups cached by the current session.
+ * @param handle the context handle
+ */
+static void free_session_keys(alpm_handle_t *handle)
+{
+	alpm_list_t *i;
+
+	for(i = handle->gpgme_keys; i; i = i->next) {
+		struct session_key *skey = i->data;
+		if(skey->key) {
+			gpgme_key_unref(skey->key);
+		}
+		free(skey->fpr);
+		free(skey);
+	}
+	alpm_list_free(handle->gpgme_keys);
+	handle->gpgme_keys = NULL;
+}
+
+/**
+ * End a verification session. Ending the outermost session releases the
+ * shared context and cached keys. This is safe to call when no session is
+ * open.
+ * @param handle the context handle
+ */
+void _alpm_gpgme_session_end(alpm_handle_t *handle)
+{
+	if(handle->gpgme_session > 1) {
+		handle->gpgme_session--;
+		return;
+	}
+
+	free_session_keys(handle);
+
+	if(handle->gpgme_ctx) {
+		gpgme_release(handle->gpgme_ctx);
+		handle->gpgme_ctx = NULL;
+	}
+	handle->gpgme_session = 0;
+}
+
+/**
+ * Get a GPGME context to work with, reusing the session context if a
+ * verification session is open. Release it with release_ctx().
+ * @param handle the context handle
+ * @param ctx storage for the context
+ * @return a GPGME error code
+ */
+static gpgme_error_t acquire_ctx(alpm_handle_t *handle, gpgme_ctx_t *ctx)
+{
+	gpgme_error_t gpg_err;
+
+	if(handle->gpgme_ctx) {
+		*ctx = handle->gpgme_ctx;
+		return GPG_ERR_NO_ERROR;
+	}
+
+	gpg_err = gpgme_new(ctx);
+	if(gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR && handle->gpgme_session) {
+		handle->gpgme_ctx = *ctx;
+	}
+	return gpg_err;
+}
+
+static void release_ctx(alpm_handle_t *handle, gpgme_ctx_t ctx)
+{
+	if(ctx != handle->gpgme_ctx) {
+		gpgme_release(ctx);
+	}
+}
+
+/**
+ * Look up a key by fingerprint, consulting the session cache first.
+ * The returned key holds its own reference and must be unreferenced by the
+ * caller.
+ * @param handle the context handle
+ * @param ctx the GPGME context to perform the lookup with
+ * @param fpr the fingerprint to look up
+ * @param key storage for the key
+ * @return a GPGME error code; GPG_ERR_EOF if the key is unknown
+ */
+static gpgme_error_t session_get_key(alpm_handle_t *handle, gpgme_ctx_t ctx,
+		const char *fpr, gpgme_key_t *key)
+{
+	gpgme_error_t gpg_err;
+	struct session_key *skey;
+	alpm_list_t *i;
+
+	*key = NULL;
+	if(handle->gpgme_session) {
+		for(i = handle->gpgme_keys; i; i = i->next) {
+			skey = i->data;
+			if(strcmp(skey->fpr, fpr) == 0) {
+				if(!skey->key) {
+					return gpg_error(GPG_ERR_EOF);
+				}
+				gpgme_key_ref(skey->key);
+				*key = skey->key;
+				return GPG_ERR_NO_ERROR;
+			}
+		}
+	}
+
+	gpg_err = gpgme_get_key(ctx, fpr, key, 0);
+	if(!handle->gpgme_session || (gpg_err_code(gpg_err) != GPG_ERR_NO_ERROR
+				&& gpg_err_code(gpg_err) != GPG_ERR_EOF)) {
+		return gpg_err;
+	}
+
+	/* failing to cache a lookup only costs us a repeated lookup later */
+	MALLOC(skey, sizeof(struct session_key), return gpg_err);
+	STRDUP(skey->fpr, fpr, free(skey); return gpg_err);
+	skey->key = NULL;
+	if(gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR) {
+		gpgme_key_ref(*key);
+		skey->key = *key;
+	}
+	handle->gpgme_keys = alpm_list_add(handle->gpgme_keys, skey);
+	return gpg_err;
+}
+
 /**
  * Determine if we have a key is known in our local keyring.
  * @param handle the context handle
@@ -232,12 +378,12 @@ int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 	}
 
 	memset(&ctx, 0, sizeof(ctx));
-	gpg_err = gpgme_new(&ctx);
+	gpg_err = acquire_ctx(handle, &ctx);
 	CHECK_ERR();
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "looking up key %s locally\n", fpr);
 
-	gpg_err = gpgme_get_key(ctx, fpr, &key, 0);
+	gpg_err = session_get_key(handle, ctx, fpr, &key);
 	if(gpg_err_code(gpg_err) == GPG_ERR_EOF) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, unknown key\n");
 		ret = 0;
@@ -251,7 +397,7 @@ int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 	gpgme_key_unref(key);
 
 gpg_error:
-	gpgme_release(ctx);
+	release_ctx(handle, ctx);
 
 error:
 	return ret;
@@ -418,6 +564,8 @@ static int key_import(alpm_handle_t *handle, alpm_pgpkey_t *key)
 		_alpm_log(handle, ALPM_LOG_DEBUG, "gpg error: %s\n", gpgme_strerror(gpg_err));
 		ret = -1;
 	} else {
+		/* the key may have been cached as unknown earlier in the session */
+		free_session_keys(handle);
 		ret = 0;
 	}
 
@@ -499,7 +647,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 	gpgme_signature_t gpgsig;
 	char *sigpath = NULL;
 	unsigned char *decoded_sigdata = NULL;
-	FILE *file = NULL, *sigfile = NULL;
+	int fd = -1, sigfd = -1;
 
 	if(!path || _alpm_access(handle, NULL, path, R_OK) != 0) {
 		RET_ERR(handle, ALPM_ERR_NOT_A_FILE, -1);
@@ -509,11 +657,14 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1);
 	}
 	siglist->count = 0;
+	handle->sig_expires = 0;
 
 	if(!base64_sig) {
 		sigpath = _alpm_sigpath(handle, path);
-		if(_alpm_access(handle, NULL, sigpath, R_OK) != 0
-				|| (sigfile = fopen(sigpath, "rb")) == NULL) {
+		if(_alpm_access(handle, NULL, sigpath, R_OK) == 0) {
+			OPEN(sigfd, sigpath, O_RDONLY | O_CLOEXEC);
+		}
+		if(sigfd < 0) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "sig path %s could not be opened\n",
 					sigpath);
 			handle->pm_errno = ALPM_ERR_SIG_MISSING;
@@ -522,8 +673,8 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 	}
 
 	/* does the file we are verifying exist? */
-	file = fopen(path, "rb");
-	if(file == NULL) {
+	OPEN(fd, path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
 		handle->pm_errno = ALPM_ERR_NOT_A_FILE;
 		goto error;
 	}
@@ -539,11 +690,12 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 	memset(&sigdata, 0, sizeof(sigdata));
 	memset(&filedata, 0, sizeof(filedata));
 
-	gpg_err = gpgme_new(&ctx);
+	gpg_err = acquire_ctx(handle, &ctx);
 	CHECK_ERR();
 
-	/* create our necessary data objects to verify the signature */
-	gpg_err = gpgme_data_new_from_stream(&filedata, file);
+	/* create our necessary data objects to verify the signature; reading the
+	 * descriptors directly avoids a round trip through stdio buffers */
+	gpg_err = gpgme_data_new_from_fd(&filedata, fd);
 	CHECK_ERR();
 
 	/* next create data object for the signature */
@@ -560,7 +712,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 				(char *)decoded_sigdata, data_len, 0);
 	} else {
 		/* file-based, it is on disk */
-		gpg_err = gpgme_data_new_from_stream(&sigdata, sigfile);
+		gpg_err = gpgme_data_new_from_fd(&sigdata, sigfd);
 	}
 	CHECK_ERR();
 
@@ -605,12 +757,16 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 		}
 
 		_alpm_log(handle, ALPM_LOG_DEBUG, "exp_timestamp: %lu\n", gpgsig->exp_timestamp);
+		if(gpgsig->exp_timestamp && (!handle->sig_expires
+					|| (alpm_time_t)gpgsig->exp_timestamp < handle->sig_expires)) {
+			handle->sig_expires = gpgsig->exp_timestamp;
+		}
 		_alpm_log(handle, ALPM_LOG_DEBUG, "validity: %s; reason: %s\n",
 				string_validity(gpgsig->validity),
 				gpgme_strerror(gpgsig->validity_reason));
 
 		result = siglist->results + sigcount;
-		gpg_err = gpgme_get_key(ctx, gpgsig->fpr, &key, 0);
+		gpg_err = session_get_key(handle, ctx, gpgsig->fpr, &key);
 		if(gpg_err_code(gpg_err) == GPG_ERR_EOF) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, unknown key\n");
 			gpg_err = GPG_ERR_NO_ERROR;
@@ -686,14 +842,14 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 gpg_error:
 	gpgme_data_release(sigdata);
 	gpgme_data_release(filedata);
-	gpgme_release(ctx);
+	release_ctx(handle, ctx);
 
 error:
-	if(sigfile) {
-		fclose(sigfile);
+	if(sigfd >= 0) {
+		close(sigfd);
 	}
-	if(file) {
-		fclose(file);
+	if(fd >= 0) {
+		close(fd);
 	}
 	FREE(sigpath);
 	FREE(decoded_sigdata);
@@ -705,6 +861,14 @@ error:
 }
 
 #else /* HAVE_LIBGPGME */
+void _alpm_gpgme_session_begin(alpm_handle_t UNUSED *handle)
+{
+}
+
+void _alpm_gpgme_session_end(alpm_handle_t UNUSED *handle)
+{
+}
+
 int _alpm_key_in_keychain(alpm_handle_t UNUSED *handle, const char UNUSED *fpr)
 {
 	return -1;
@@ -31,6 +31,9 @@ int _alpm_check_pgp_helper(alpm_handle_t *handle, const char *path,
 int _alpm_process_siglist(alpm_handle_t *handle, const char *identifier,
 		alpm_siglist_t *siglist, int optional, int marginal, int unknown);
 
+void _alpm_gpgme_session_begin(alpm_handle_t *handle);
+void _alpm_gpgme_session_end(alpm_handle_t *handle);
+
 int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr);
 int _alpm_key_import(alpm_handle_t *handle, const char *fpr);
 
@@ -0,0 +1,404 @@
+/*
+ *  store.c
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <archive_entry.h>
+#if defined(HAVE_SYS_IOCTL_H)
+#include <sys/ioctl.h>
+#endif
+#if defined(HAVE_LINUX_FS_H)
+#include <linux/fs.h>
+#endif
+
+/* libalpm */
+#include "store.h"
+#include "alpm_list.h"
+#include "db.h"
+#include "handle.h"
+#include "log.h"
+#include "util.h"
+
+/* The store holds one fully extracted tree per package, named after the
+ * sha256sum of the package file, so it never has to be invalidated. Package
+ * metadata is kept under its archive name next to the files. */
+static const char *metafiles[][2] = {
+	{ ".INSTALL", "install" },
+	{ ".CHANGELOG", "changelog" },
+	{ ".MTREE", "mtree" },
+};
+
+/* Archive metadata of a directory that already existed in the root, whose
+ * mode and owner on disk need not be those of the package. */
+struct storedir {
+	char *name;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+};
+
+static int clone_fd(int dst, int src)
+{
+#ifdef FICLONE
+	return ioctl(dst, FICLONE, src);
+#else
+	(void)dst;
+	(void)src;
+	errno = EOPNOTSUPP;
+	return -1;
+#endif
+}
+
+/**
+ * Recreate a file, directory or symlink in another tree, sharing the data
+ * extents of regular files instead of copying them.
+ * @param srcdir directory fd the source name is relative to
+ * @param srcname name of the source
+ * @param dstdir directory fd the destination name is relative to
+ * @param dstname name of the destination, which must not exist
+ * @param st lstat() result of the source
+ * @return 0 on success, -1 on error with errno set
+ */
+static int clone_entry(int srcdir, const char *srcname, int dstdir,
+		const char *dstname, const struct stat *st)
+{
+	struct timespec times[2];
+	int src, dst, ret = -1;
+
+	times[0] = st->st_atim;
+	times[1] = st->st_mtim;
+
+	if(S_ISDIR(st->st_mode)) {
+		if(mkdirat(dstdir, dstname, 0700) != 0
+				|| fchownat(dstdir, dstname, st->st_uid, st->st_gid, 0) != 0
+				|| fchmodat(dstdir, dstname, st->st_mode & 07777, 0) != 0) {
+			return -1;
+		}
+		return 0;
+	} else if(S_ISLNK(st->st_mode)) {
+		char target[PATH_MAX];
+		ssize_t len = readlinkat(srcdir, srcname, target, PATH_MAX - 1);
+		if(len < 0) {
+			return -1;
+		}
+		target[len] = '\0';
+		if(symlinkat(target, dstdir, dstname) != 0
+				|| fchownat(dstdir, dstname, st->st_uid, st->st_gid,
+					AT_SYMLINK_NOFOLLOW) != 0
+				|| utimensat(dstdir, dstname, times, AT_SYMLINK_NOFOLLOW) != 0) {
+			return -1;
+		}
+		return 0;
+	} else if(!S_ISREG(st->st_mode)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	do {
+		src = openat(srcdir, srcname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	} while(src == -1 && errno == EINTR);
+	if(src < 0) {
+		return -1;
+	}
+	do {
+		dst = openat(dstdir, dstname, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW
+				| O_CLOEXEC | O_BINARY, 0600);
+	} while(dst == -1 && errno == EINTR);
+	if(dst < 0) {
+		close(src);
+		return -1;
+	}
+
+	/* ownership first, as changing it drops setuid/setgid bits */
+	if(clone_fd(dst, src) == 0 && fchown(dst, st->st_uid, st->st_gid) == 0
+			&& fchmod(dst, st->st_mode & 07777) == 0 && futimens(dst, times) == 0) {
+		ret = 0;
+	}
+	close(src);
+	if(close(dst) != 0) {
+		ret = -1;
+	}
+	if(ret != 0) {
+		int err = errno;
+		unlinkat(dstdir, dstname, 0);
+		errno = err;
+	}
+	return ret;
+}
+
+/**
+ * Install the files of a package by reflinking them from the store.
+ * Only existing directories may already be present in the root; on any
+ * error the caller is expected to fall back to extracting the archive,
+ * which replaces whatever was created here.
+ * @param handle the context handle
+ * @param pkg the package to install
+ * @param hash sha256sum of the package file
+ * @param dirs directory stack opened on the root
+ * @return 0 on success, -1 if the package has to be extracted normally
+ */
+int _alpm_store_install(alpm_handle_t *handle, alpm_pkg_t *pkg,
+		const char *hash, alpm_dirstack_t *dirs)
+{
+	alpm_filelist_t *filelist = alpm_pkg_get_files(pkg);
+	char path[PATH_MAX], name[PATH_MAX];
+	struct stat st;
+	size_t i;
+	int storefd;
+
+	if(snprintf(path, PATH_MAX, "%s%s", handle->storedir, hash) >= PATH_MAX) {
+		return -1;
+	}
+	OPEN(storefd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(storefd < 0) {
+		/* not in the store yet */
+		return -1;
+	}
+
+	for(i = 0; i < filelist->count; i++) {
+		const char *entryname = filelist->files[i].name;
+		int dirfd;
+
+		if(_alpm_fnmatch_patterns(handle->noextract, entryname) == 0) {
+			continue;
+		}
+		if(fstatat(storefd, entryname, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			goto error;
+		}
+		dirfd = _alpm_dirstack_parent(dirs, entryname, name, PATH_MAX);
+		if(dirfd < 0) {
+			goto error;
+		}
+		if(S_ISDIR(st.st_mode)) {
+			struct stat rootst;
+			if(fstatat(dirfd, name, &rootst, AT_SYMLINK_NOFOLLOW) == 0) {
+				if(S_ISDIR(rootst.st_mode)) {
+					continue;
+				}
+				errno = EEXIST;
+				goto error;
+			}
+		}
+		if(clone_entry(storefd, entryname, dirfd, name, &st) != 0) {
+			goto error;
+		}
+	}
+
+	for(i = 0; i < sizeof(metafiles) / sizeof(metafiles[0]); i++) {
+		char *dest;
+		int err;
+
+		snprintf(path, PATH_MAX, "%s%s/%s", handle->storedir, hash, metafiles[i][0]);
+		if(access(path, F_OK) != 0) {
+			continue;
+		}
+		dest = _alpm_local_db_pkgpath(handle->db_local, pkg, metafiles[i][1]);
+		err = dest == NULL || _alpm_copyfile(path, dest) != 0;
+		free(dest);
+		if(err) {
+			goto error;
+		}
+	}
+
+	close(storefd);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "installed %s from the package store\n",
+			pkg->name);
+	return 0;
+
+error:
+	_alpm_log(handle, ALPM_LOG_DEBUG, "could not install %s from the package store: %s\n",
+			pkg->name, strerror(errno));
+	close(storefd);
+	return -1;
+}
+
+/**
+ * Remember the archive metadata of a directory entry that was not extracted
+ * because the directory already existed.
+ * @param olddirs list to add the directory to
+ * @param entry the directory entry
+ * @return 0 on success, -1 on error
+ */
+int _alpm_storedir_add(alpm_list_t **olddirs, struct archive_entry *entry)
+{
+	struct storedir *dir;
+
+	CALLOC(dir, 1, sizeof(struct storedir), return -1);
+	STRDUP(dir->name, archive_entry_pathname(entry), free(dir); return -1);
+	dir->mode = archive_entry_mode(entry);
+	dir->uid = archive_entry_uid(entry);
+	dir->gid = archive_entry_gid(entry);
+	*olddirs = alpm_list_add(*olddirs, dir);
+	return 0;
+}
+
+/** Free a directory added by _alpm_storedir_add().
+ * @param ptr the directory
+ */
+void _alpm_storedir_free(void *ptr)
+{
+	struct storedir *dir = ptr;
+	free(dir->name);
+	free(dir);
+}
+
+static const struct storedir *storedir_find(alpm_list_t *olddirs,
+		const char *name)
+{
+	size_t len = strlen(name);
+
+	/* archives may or may not carry a trailing slash on directories */
+	if(len > 0 && name[len - 1] == '/') {
+		len--;
+	}
+	for(; olddirs; olddirs = olddirs->next) {
+		const struct storedir *dir = olddirs->data;
+		if(strncmp(dir->name, name, len) == 0
+				&& (dir->name[len] == '\0' || strcmp(dir->name + len, "/") == 0)) {
+			return dir;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Add a freshly installed package to the store by reflinking its files
+ * back out of the root. Every file and symlink must have been created by
+ * the extraction that just finished; directories which already existed
+ * are recreated with the metadata from the archive instead of their
+ * current one. The tree is assembled under a temporary name and renamed
+ * into place once complete.
+ * @param handle the context handle
+ * @param pkg the package that was just extracted
+ * @param hash sha256sum of the package file
+ * @param olddirs directories of the package which already existed, as
+ * added by _alpm_storedir_add()
+ * @return 0 on success, -1 on error
+ */
+int _alpm_store_add(alpm_handle_t *handle, alpm_pkg_t *pkg, const char *hash,
+		alpm_list_t *olddirs)
+{
+	alpm_filelist_t *filelist = alpm_pkg_get_files(pkg);
+	char tmpdir[PATH_MAX], path[PATH_MAX];
+	struct stat st;
+	size_t i, done = 0;
+	int rootfd = -1, tmpfd = -1;
+
+	/* a tree missing NoExtract files is no use to anyone else */
+	if(handle->noextract) {
+		return -1;
+	}
+
+	if(snprintf(tmpdir, PATH_MAX, "%s.%s.XXXXXX", handle->storedir, hash) >= PATH_MAX) {
+		return -1;
+	}
+	if(mkdtemp(tmpdir) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not create %s: %s\n",
+				tmpdir, strerror(errno));
+		return -1;
+	}
+	OPEN(tmpfd, tmpdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	OPEN(rootfd, handle->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(tmpfd < 0 || rootfd < 0) {
+		goto error;
+	}
+
+	for(; done < filelist->count; done++) {
+		const char *entryname = filelist->files[done].name;
+
+		if(fstatat(rootfd, entryname, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			goto error;
+		}
+		if(S_ISDIR(st.st_mode)) {
+			const struct storedir *dir = storedir_find(olddirs, entryname);
+			if(dir) {
+				st.st_mode = dir->mode;
+				st.st_uid = dir->uid;
+				st.st_gid = dir->gid;
+			}
+		}
+		if(S_ISREG(st.st_mode) && st.st_nlink > 1) {
+			/* hardlinks would turn into independent copies */
+			errno = EMLINK;
+			goto error;
+		}
+		if(clone_entry(rootfd, entryname, tmpfd, entryname, &st) != 0) {
+			goto error;
+		}
+	}
+
+	for(i = 0; i < sizeof(metafiles) / sizeof(metafiles[0]); i++) {
+		char *src = _alpm_local_db_pkgpath(handle->db_local, pkg, metafiles[i][1]);
+		int err = 0;
+
+		if(src && access(src, F_OK) == 0) {
+			err = snprintf(path, PATH_MAX, "%s/%s", tmpdir, metafiles[i][0]) >= PATH_MAX
+				|| _alpm_copyfile(src, path) != 0;
+		}
+		free(src);
+		if(err) {
+			goto error;
+		}
+	}
+
+	snprintf(path, PATH_MAX, "%s%s", handle->storedir, hash);
+	if(rename(tmpdir, path) != 0) {
+		goto error;
+	}
+
+	close(rootfd);
+	close(tmpfd);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "added %s to the package store\n", pkg->name);
+	return 0;
+
+error:
+	_alpm_log(handle, ALPM_LOG_DEBUG, "could not add %s to the package store: %s\n",
+			pkg->name, strerror(errno));
+	if(tmpfd >= 0) {
+		for(i = 0; i < sizeof(metafiles) / sizeof(metafiles[0]); i++) {
+			unlinkat(tmpfd, metafiles[i][0], 0);
+		}
+		/* walking the sorted file list backwards removes children first */
+		for(i = done + 1; i > 0; i--) {
+			const char *entryname;
+			size_t len;
+
+			if(i > filelist->count) {
+				continue;
+			}
+			entryname = filelist->files[i - 1].name;
+			len = strlen(entryname);
+			unlinkat(tmpfd, entryname,
+					entryname[len - 1] == '/' ? AT_REMOVEDIR : 0);
+		}
+		close(tmpfd);
+	}
+	if(rootfd >= 0) {
+		close(rootfd);
+	}
+	rmdir(tmpdir);
+	return -1;
+}
+
+/* vim: set noet: */
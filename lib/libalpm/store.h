@@ -0,0 +1,37 @@
+/*
+ *  store.h
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALPM_STORE_H
+#define _ALPM_STORE_H
+
+#include "alpm.h"
+#include "util.h"
+
+struct archive_entry;
+
+int _alpm_store_install(alpm_handle_t *handle, alpm_pkg_t *pkg,
+		const char *hash, alpm_dirstack_t *dirs);
+int _alpm_storedir_add(alpm_list_t **olddirs, struct archive_entry *entry);
+void _alpm_storedir_free(void *ptr);
+int _alpm_store_add(alpm_handle_t *handle, alpm_pkg_t *pkg, const char *hash,
+		alpm_list_t *olddirs);
+
+#endif /* _ALPM_STORE_H */
+
+/* vim: set noet: */
@@ -43,10 +43,12 @@
 #include "handle.h"
 #include "alpm.h"
 #include "dload.h"
+#include "mirrors.h"
 #include "delta.h"
 #include "remove.h"
 #include "diskspace.h"
 #include "signing.h"
+#include "hashcache.h"
 
 /** Check for new version of pkg in sync repos
  * (only the first occurrence is considered in sync)
@@ -124,82 +126,94 @@ static int check_literal(alpm_handle_t *handle, alpm_pkg_t *lpkg,
 }
 
 static alpm_list_t *check_replacers(alpm_handle_t *handle, alpm_pkg_t *lpkg,
-		alpm_db_t *sdb)
+		alpm_db_t *sdb, alpm_pkghash_t *targets)
 {
 	/* 2. search for replacers in sdb */
 	alpm_list_t *replacers = NULL;
-	alpm_list_t *k;
+	alpm_list_t *candidates, *k;
 	_alpm_log(handle, ALPM_LOG_DEBUG,
 			"searching for replacements for %s in %s\n",
 			lpkg->name, sdb->treename);
-	for(k = _alpm_db_get_pkgcache(sdb); k; k = k->next) {
-		int found = 0;
+	/* we only want to consider literal matches at this point. */
+	candidates = _alpm_db_find_replacers(sdb, lpkg);
+	for(k = candidates; k; k = k->next) {
 		alpm_pkg_t *spkg = k->data;
-		alpm_list_t *l;
-		for(l = alpm_pkg_get_replaces(spkg); l; l = l->next) {
-			alpm_depend_t *replace = l->data;
-			/* we only want to consider literal matches at this point. */
-			if(_alpm_depcmp_literal(lpkg, replace)) {
-				found = 1;
-				break;
-			}
+		alpm_question_replace_t question = {
+			.type = ALPM_QUESTION_REPLACE_PKG,
+			.replace = 0,
+			.oldpkg = lpkg,
+			.newpkg = spkg,
+			.newdb = sdb
+		};
+		alpm_pkg_t *tpkg;
+		/* check IgnorePkg/IgnoreGroup */
+		if(alpm_pkg_should_ignore(handle, spkg)
+				|| alpm_pkg_should_ignore(handle, lpkg)) {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("ignoring package replacement (%s-%s => %s-%s)\n"),
+					lpkg->name, lpkg->version, spkg->name, spkg->version);
+			continue;
 		}
-		if(found) {
-			alpm_question_replace_t question = {
-				.type = ALPM_QUESTION_REPLACE_PKG,
-				.replace = 0,
-				.oldpkg = lpkg,
-				.newpkg = spkg,
-				.newdb = sdb
-			};
-			alpm_pkg_t *tpkg;
-			/* check IgnorePkg/IgnoreGroup */
-			if(alpm_pkg_should_ignore(handle, spkg)
-					|| alpm_pkg_should_ignore(handle, lpkg)) {
-				_alpm_log(handle, ALPM_LOG_WARNING,
-						_("ignoring package replacement (%s-%s => %s-%s)\n"),
-						lpkg->name, lpkg->version, spkg->name, spkg->version);
-				continue;
-			}
 
-			QUESTION(handle, &question);
-			if(!question.replace) {
+		QUESTION(handle, &question);
+		if(!question.replace) {
+			continue;
+		}
+
+		/* If spkg is already in the target list, we append lpkg to spkg's
+		 * removes list */
+		tpkg = _alpm_pkghash_find(targets, spkg->name);
+		if(tpkg) {
+			/* sanity check, multiple repos can contain spkg->name */
+			if(tpkg->origin_data.db != sdb) {
+				_alpm_log(handle, ALPM_LOG_WARNING, _("cannot replace %s by %s\n"),
+						lpkg->name, spkg->name);
 				continue;
 			}
-
-			/* If spkg is already in the target list, we append lpkg to spkg's
-			 * removes list */
-			tpkg = alpm_pkg_find(handle->trans->add, spkg->name);
-			if(tpkg) {
-				/* sanity check, multiple repos can contain spkg->name */
-				if(tpkg->origin_data.db != sdb) {
-					_alpm_log(handle, ALPM_LOG_WARNING, _("cannot replace %s by %s\n"),
-							lpkg->name, spkg->name);
-					continue;
-				}
-				_alpm_log(handle, ALPM_LOG_DEBUG, "appending %s to the removes list of %s\n",
-						lpkg->name, tpkg->name);
-				tpkg->removes = alpm_list_add(tpkg->removes, lpkg);
-				/* check the to-be-replaced package's reason field */
-				if(alpm_pkg_get_reason(lpkg) == ALPM_PKG_REASON_EXPLICIT) {
-					tpkg->reason = ALPM_PKG_REASON_EXPLICIT;
-				}
-			} else {
-				/* add spkg to the target list */
-				/* copy over reason */
-				spkg->reason = alpm_pkg_get_reason(lpkg);
-				spkg->removes = alpm_list_add(NULL, lpkg);
-				_alpm_log(handle, ALPM_LOG_DEBUG,
-						"adding package %s-%s to the transaction targets\n",
-						spkg->name, spkg->version);
-				replacers = alpm_list_add(replacers, spkg);
+			_alpm_log(handle, ALPM_LOG_DEBUG, "appending %s to the removes list of %s\n",
+					lpkg->name, tpkg->name);
+			tpkg->removes = alpm_list_add(tpkg->removes, lpkg);
+			/* check the to-be-replaced package's reason field */
+			if(alpm_pkg_get_reason(lpkg) == ALPM_PKG_REASON_EXPLICIT) {
+				tpkg->reason = ALPM_PKG_REASON_EXPLICIT;
 			}
+		} else {
+			/* add spkg to the target list */
+			/* copy over reason */
+			spkg->reason = alpm_pkg_get_reason(lpkg);
+			spkg->removes = alpm_list_add(NULL, lpkg);
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"adding package %s-%s to the transaction targets\n",
+					spkg->name, spkg->version);
+			replacers = alpm_list_add(replacers, spkg);
 		}
 	}
+	alpm_list_free(candidates);
 	return replacers;
 }
 
-/** Search for packages to upgrade and add them to the transaction. */
+/* Add a package to the transaction targets and their name lookup. */
+static void add_upgrade_target(alpm_trans_t *trans, alpm_pkghash_t **targets,
+		alpm_pkg_t *spkg)
+{
+	trans->add = alpm_list_add(trans->add, spkg);
+	*targets = _alpm_pkghash_add(*targets, spkg);
+}
+
+/* Advance a cursor over a list sorted by name to the first package not
+ * sorting before name, and return it if it has that name. */
+static alpm_pkg_t *merge_find(alpm_list_t **cursor, const char *name)
+{
+	int cmp = -1;
+	while(*cursor && (cmp = strcmp(((alpm_pkg_t *)(*cursor)->data)->name, name)) < 0) {
+		*cursor = (*cursor)->next;
+	}
+	return cmp == 0 ? (*cursor)->data : NULL;
+}
+
+/** Search for packages to upgrade and add them to the transaction.
+ * The local and sync package caches are all sorted by name, so they are
+ * walked together in a single pass. */
 #ifdef __MSYS__
 static
 int SYMEXPORT do_alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade, int core_update)
@@ -208,13 +222,36 @@ int SYMEXPORT alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade)
 #endif
 {
 	alpm_list_t *i, *j;
+	alpm_list_t *removes, *remcursor, **synccursors;
+	alpm_pkghash_t *targets;
 	alpm_trans_t *trans;
+	size_t k;
 
 	CHECK_HANDLE(handle, return -1);
 	trans = handle->trans;
 	ASSERT(trans != NULL, RET_ERR(handle, ALPM_ERR_TRANS_NULL, -1));
 	ASSERT(trans->state == STATE_INITIALIZED, RET_ERR(handle, ALPM_ERR_TRANS_NOT_INITIALIZED, -1));
 
+	CALLOC(synccursors, alpm_list_count(handle->dbs_sync) + 1,
+			sizeof(alpm_list_t *), RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	targets = _alpm_pkghash_create(alpm_list_count(trans->add) + 1);
+	if(targets == NULL) {
+		free(synccursors);
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	for(i = trans->add; i; i = i->next) {
+		targets = _alpm_pkghash_add(targets, i->data);
+	}
+	removes = alpm_list_msort(alpm_list_copy(trans->remove),
+			alpm_list_count(trans->remove), _alpm_pkg_cmp);
+	remcursor = removes;
+	for(k = 0, j = handle->dbs_sync; j; j = j->next, k++) {
+		alpm_db_t *sdb = j->data;
+		if(sdb->usage & ALPM_DB_USAGE_UPGRADE) {
+			synccursors[k] = _alpm_db_get_pkgcache(sdb);
+		}
+	}
+
 	_alpm_log(handle, ALPM_LOG_DEBUG, "checking for package upgrades\n");
 	for(i = _alpm_db_get_pkgcache(handle->db_local); i; i = i->next) {
 		alpm_pkg_t *lpkg = i->data;
@@ -226,44 +263,53 @@ int SYMEXPORT alpm_sync_sysupgrade(alpm_handle_t *handle, int enable_downgrade)
 		}
 #endif
 
-		if(alpm_pkg_find(trans->remove, lpkg->name)) {
+		if(merge_find(&remcursor, lpkg->name)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "%s is marked for removal -- skipping\n", lpkg->name);
 			continue;
 		}
 
-		if(alpm_pkg_find(trans->add, lpkg->name)) {
+		if(_alpm_pkghash_find(targets, lpkg->name)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "%s is already in the target list -- skipping\n", lpkg->name);
 			continue;
 		}
 
 		/* Search for replacers then literal (if no replacer) in each sync database. */
-		for(j = handle->dbs_sync; j; j = j->next) {
+		for(k = 0, j = handle->dbs_sync; j; j = j->next, k++) {
 			alpm_db_t *sdb = j->data;
 			alpm_list_t *replacers;
+			alpm_pkg_t *spkg;
 
 			if(!(sdb->usage & ALPM_DB_USAGE_UPGRADE)) {
 				continue;
 			}
 
 			/* Check sdb */
-			replacers = check_replacers(handle, lpkg, sdb);
+			replacers = check_replacers(handle, lpkg, sdb, targets);
 			if(replacers) {
-				trans->add = alpm_list_join(trans->add, replacers);
+				alpm_list_t *r;
+				for(r = replacers; r; r = r->next) {
+					add_upgrade_target(trans, &targets, r->data);
+				}
+				alpm_list_free(replacers);
 				/* jump to next local package */
 				break;
-			} else {
-				alpm_pkg_t *spkg = _alpm_db_get_pkgfromcache(sdb, lpkg->name);
-				if(spkg) {
-					if(check_literal(handle, lpkg, spkg, enable_downgrade)) {
-						trans->add = alpm_list_add(trans->add, spkg);
-					}
-					/* jump to next local package */
-					break;
+			}
+
+			spkg = merge_find(&synccursors[k], lpkg->name);
+			if(spkg) {
+				if(check_literal(handle, lpkg, spkg, enable_downgrade)) {
+					add_upgrade_target(trans, &targets, spkg);
 				}
+				/* jump to next local package */
+				break;
 			}
 		}
 	}
 
+	_alpm_pkghash_free(targets);
+	alpm_list_free(removes);
+	free(synccursors);
+
 	return 0;
 }
 
@@ -436,6 +482,7 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		alpm_list_t *resolved = NULL;
 		alpm_list_t *remove = alpm_list_copy(trans->remove);
 		alpm_list_t *localpkgs;
+		alpm_depcheck_t *check;
 
 		/* Build up list by repeatedly resolving each transaction package */
 		/* Resolve targets dependencies */
@@ -455,18 +502,26 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		 * phonon/qt issue) */
 		localpkgs = alpm_list_diff(_alpm_db_get_pkgcache(handle->db_local),
 				trans->add, _alpm_pkg_cmp);
+		/* index them once for all the targets */
+		check = _alpm_depcheck_new(handle, localpkgs, remove);
+		if(check == NULL) {
+			alpm_list_free(localpkgs);
+			alpm_list_free(remove);
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+		}
 
 		/* Resolve packages in the transaction one at a time, in addition
 		   building up a list of packages which could not be resolved. */
 		for(i = trans->add; i; i = i->next) {
 			alpm_pkg_t *pkg = i->data;
-			if(_alpm_resolvedeps(handle, localpkgs, pkg, trans->add,
+			if(_alpm_resolvedeps(handle, check, pkg, trans->add,
 						&resolved, remove, data) == -1) {
 				unresolvable = alpm_list_add(unresolvable, pkg);
 			}
 			/* Else, [resolved] now additionally contains [pkg] and all of its
 			   dependencies not already on the list */
 		}
+		_alpm_depcheck_free(check);
 		alpm_list_free(localpkgs);
 		alpm_list_free(remove);
 
@@ -924,6 +979,7 @@ static int find_dl_candidates(alpm_db_t *repo, alpm_list_t **files, alpm_list_t
 						struct dload_payload *payload = build_payload(
 								handle, delta->delta, delta->delta_size, repo->servers);
 						ASSERT(payload, return -1);
+						payload->md5sum = delta->delta_md5;
 						*files = alpm_list_add(*files, payload);
 					}
 					/* keep a list of all the delta files for md5sums */
@@ -935,6 +991,8 @@ static int find_dl_candidates(alpm_db_t *repo, alpm_list_t **files, alpm_list_t
 				ASSERT(spkg->filename != NULL, RET_ERR(handle, ALPM_ERR_PKG_INVALID_NAME, -1));
 				payload = build_payload(handle, spkg->filename, spkg->size, repo->servers);
 				ASSERT(payload, return -1);
+				payload->md5sum = spkg->md5sum;
+				payload->sha256sum = spkg->sha256sum;
 				*files = alpm_list_add(*files, payload);
 			}
 		}
@@ -943,6 +1001,102 @@ static int find_dl_candidates(alpm_db_t *repo, alpm_list_t **files, alpm_list_t
 	return 0;
 }
 
+/** Check that a file from a cache peer is the one the database describes.
+ * @param handle the context handle
+ * @param payload payload of the downloaded file
+ * @return 0 if size and checksums match, -1 otherwise
+ */
+static int check_peer_file(alpm_handle_t *handle, struct dload_payload *payload)
+{
+	const char *path = payload->destfile_name;
+	struct stat st;
+
+	if(stat(path, &st) != 0) {
+		return -1;
+	}
+	if(payload->max_size > 0 && st.st_size != payload->max_size) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s has size %jd, expected %jd\n",
+				path, (intmax_t)st.st_size, (intmax_t)payload->max_size);
+		return -1;
+	}
+	if(payload->sha256sum && _alpm_test_checksum(path, payload->sha256sum,
+				ALPM_PKG_VALIDATION_SHA256SUM) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s: SHA256 checksum mismatch\n", path);
+		return -1;
+	}
+	if(!payload->sha256sum && payload->md5sum && _alpm_test_checksum(path,
+				payload->md5sum, ALPM_PKG_VALIDATION_MD5SUM) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s: MD5 checksum mismatch\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/** Try to fetch a package from the cache peers before any real mirror.
+ * Peers are expected to be close by, so each one gets a short timeout and
+ * failures are only logged at debug level. Peers are not trusted: their
+ * files are downloaded whole into a tempfile of their own, so a partial
+ * download from a mirror is left alone, and are only kept if size and
+ * checksum match the database.
+ * @param handle the context handle
+ * @param payload payload of the package to fetch
+ * @param cachedir directory to download into
+ * @return 0 if a peer delivered the file, -1 otherwise
+ */
+static int download_from_peers(alpm_handle_t *handle,
+		struct dload_payload *payload, const char *cachedir)
+{
+	const alpm_list_t *i;
+	int errors_ok = payload->errors_ok;
+	int allow_resume = payload->allow_resume;
+	int ret = -1;
+
+	payload->errors_ok = 1;
+	payload->quick = 1;
+	/* a partial file from a mirror is never completed from a peer, and
+	 * what a peer left behind is never completed from a mirror */
+	payload->tempfile_suffix = ".peer.part";
+	payload->allow_resume = 0;
+	payload->unlink_on_fail = 1;
+	for(i = handle->cachepeers; i && ret == -1; i = i->next) {
+		const char *peer = i->data;
+		size_t len;
+
+		len = strlen(peer) + strlen(payload->remote_name) + 2;
+		MALLOC(payload->fileurl, len, goto cleanup);
+		snprintf(payload->fileurl, len, "%s/%s", peer, payload->remote_name);
+
+		ret = _alpm_download(payload, cachedir, NULL, NULL) == -1 ? -1 : 0;
+		if(ret == 0 && check_peer_file(handle, payload) != 0) {
+			_alpm_log(handle, ALPM_LOG_WARNING,
+					_("%s from cache peer %s does not match the database, discarding it\n"),
+					payload->remote_name, peer);
+			unlink(payload->destfile_name);
+			ret = -1;
+		} else if(ret == 0) {
+			char partial[PATH_MAX];
+
+			_alpm_log(handle, ALPM_LOG_DEBUG, "retrieved %s from cache peer %s\n",
+					payload->remote_name, peer);
+			/* the file is complete, a partial download from a mirror is no
+			 * longer needed */
+			snprintf(partial, PATH_MAX, "%s.part", payload->destfile_name);
+			unlink(partial);
+		}
+		FREE(payload->fileurl);
+		payload->unlink_on_fail = 1;
+	}
+
+cleanup:
+	payload->errors_ok = errors_ok;
+	payload->quick = 0;
+	payload->tempfile_suffix = NULL;
+	payload->allow_resume = allow_resume;
+	payload->unlink_on_fail = 0;
+
+	return ret;
+}
+
 static int download_single_file(alpm_handle_t *handle, struct dload_payload *payload,
 		const char *cachedir)
 {
@@ -950,22 +1104,45 @@ static int download_single_file(alpm_handle_t *handle, struct dload_payload *pay
 		.type = ALPM_EVENT_PKGDOWNLOAD_START,
 		.file = payload->remote_name
 	};
+	alpm_list_t *servers;
 	const alpm_list_t *server;
 
 	payload->handle = handle;
 	payload->allow_resume = 1;
 
 	EVENT(handle, &event);
-	for(server = payload->servers; server; server = server->next) {
+
+	if(download_from_peers(handle, payload, cachedir) == 0) {
+		event.type = ALPM_EVENT_PKGDOWNLOAD_DONE;
+		EVENT(handle, &event);
+		return 0;
+	}
+
+	servers = _alpm_mirrors_sort(handle, payload->servers, payload->max_size);
+
+	/* large packages may be fetched in ranges from several servers at once */
+	if(_alpm_download_segmented(payload, cachedir, servers) == 0) {
+		alpm_list_free(servers);
+		event.type = ALPM_EVENT_PKGDOWNLOAD_DONE;
+		EVENT(handle, &event);
+		return 0;
+	}
+
+	for(server = servers; server; server = server->next) {
 		const char *server_url = server->data;
 		size_t len;
+		int ret;
 
 		/* print server + filename into a buffer */
 		len = strlen(server_url) + strlen(payload->remote_name) + 2;
-		MALLOC(payload->fileurl, len, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+		MALLOC(payload->fileurl, len, alpm_list_free(servers);
+				RET_ERR(handle, ALPM_ERR_MEMORY, -1));
 		snprintf(payload->fileurl, len, "%s/%s", server_url, payload->remote_name);
 
-		if(_alpm_download(payload, cachedir, NULL, NULL) != -1) {
+		ret = _alpm_download(payload, cachedir, NULL, NULL);
+		_alpm_mirrors_record(handle, server_url, payload, ret);
+		if(ret != -1) {
+			alpm_list_free(servers);
 			event.type = ALPM_EVENT_PKGDOWNLOAD_DONE;
 			EVENT(handle, &event);
 			return 0;
@@ -974,6 +1151,7 @@ static int download_single_file(alpm_handle_t *handle, struct dload_payload *pay
 		FREE(payload->fileurl);
 		payload->unlink_on_fail = 0;
 	}
+	alpm_list_free(servers);
 
 	event.type = ALPM_EVENT_PKGDOWNLOAD_FAILED;
 	EVENT(handle, &event);
@@ -1043,6 +1221,7 @@ static int download_files(alpm_handle_t *handle, alpm_list_t **deltas)
 				_alpm_log(handle, ALPM_LOG_WARNING, _("failed to retrieve some files\n"));
 			}
 		}
+		_alpm_mirrors_save(handle);
 		EVENT(handle, &event);
 	}
 
@@ -1316,6 +1495,7 @@ static int load_packages(alpm_handle_t *handle, alpm_list_t **data,
 int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 {
 	alpm_list_t *i, *deltas = NULL;
+	int ret;
 	size_t total = 0;
 	uint64_t total_bytes = 0;
 	alpm_trans_t *trans = handle->trans;
@@ -1336,9 +1516,13 @@ int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 		return -1;
 	}
 
+	/* verify every package against one shared gpgme context and key cache */
+	_alpm_gpgme_session_begin(handle);
+
 #ifdef HAVE_LIBGPGME
 	/* make sure all required signatures are in keyring */
 	if(check_keyring(handle)) {
+		_alpm_gpgme_session_end(handle);
 		return -1;
 	}
 #endif
@@ -1355,10 +1539,23 @@ int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 	/* this can only happen maliciously */
 	total_bytes = total_bytes ? total_bytes : 1;
 
-	if(check_validity(handle, total, total_bytes) != 0) {
+	ret = check_validity(handle, total, total_bytes);
+	_alpm_gpgme_session_end(handle);
+	if(ret != 0) {
 		return -1;
 	}
 
+	/* only files known to be valid are stored by their contents; one that
+	 * cannot be moved is still found under its own name */
+	if(handle->hashedcache) {
+		for(i = trans->add; i; i = i->next) {
+			alpm_pkg_t *spkg = i->data;
+			if(spkg->origin != ALPM_PKG_FROM_FILE) {
+				_alpm_hashcache_store(handle, spkg->filename);
+			}
+		}
+	}
+
 	if(trans->flags & ALPM_TRANS_FLAG_DOWNLOADONLY) {
 		return 0;
 	}
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <limits.h>
 
@@ -41,6 +42,7 @@
 #include "alpm.h"
 #include "deps.h"
 #include "hook.h"
+#include "signing.h"
 
 /** \addtogroup alpm_trans Transaction Functions
  * @brief Functions to manipulate libalpm transactions
@@ -69,6 +71,10 @@ int SYMEXPORT alpm_trans_init(alpm_handle_t *handle, alpm_transflag_t flags)
 
 	handle->trans = trans;
 
+	/* packages loaded for the transaction (-U) and databases validated while
+	 * it is open share one gpgme context and key cache */
+	_alpm_gpgme_session_begin(handle);
+
 	return 0;
 }
 
@@ -142,11 +148,20 @@ int SYMEXPORT alpm_trans_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		if(trans->add) {
 			alpm_list_t *add_orig = trans->add;
 			trans->add = _alpm_sortbydeps(handle, add_orig, trans->remove, 0);
+			if(trans->add == NULL) {
+				/* pm_errno is set by _alpm_sortbydeps() */
+				trans->add = add_orig;
+				return -1;
+			}
 			alpm_list_free(add_orig);
 		}
 		if(trans->remove) {
 			alpm_list_t *rem_orig = trans->remove;
 			trans->remove = _alpm_sortbydeps(handle, rem_orig, NULL, 1);
+			if(trans->remove == NULL) {
+				trans->remove = rem_orig;
+				return -1;
+			}
 			alpm_list_free(rem_orig);
 		}
 	}
@@ -205,6 +220,7 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 		if(_alpm_remove_packages(handle, 1) == -1) {
 			/* pm_errno is set by _alpm_remove_packages() */
 			alpm_errno_t save = handle->pm_errno;
+			_alpm_trans_flush(handle, ALPM_DURABILITY_TRANSACTION);
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction failed\n");
 			handle->pm_errno = save;
 			return -1;
@@ -213,12 +229,15 @@ int SYMEXPORT alpm_trans_commit(alpm_handle_t *handle, alpm_list_t **data)
 		if(_alpm_sync_commit(handle) == -1) {
 			/* pm_errno is set by _alpm_sync_commit() */
 			alpm_errno_t save = handle->pm_errno;
+			_alpm_trans_flush(handle, ALPM_DURABILITY_TRANSACTION);
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction failed\n");
 			handle->pm_errno = save;
 			return -1;
 		}
 	}
 
+	_alpm_trans_flush(handle, ALPM_DURABILITY_TRANSACTION);
+
 	if(trans->state == STATE_INTERRUPTED) {
 		alpm_logaction(handle, ALPM_CALLER_PREFIX, "transaction interrupted\n");
 	} else {
@@ -270,6 +289,8 @@ int SYMEXPORT alpm_trans_release(alpm_handle_t *handle)
 	_alpm_trans_free(trans);
 	handle->trans = NULL;
 
+	_alpm_gpgme_session_end(handle);
+
 	/* unlock db */
 	if(!nolock_flag) {
 		_alpm_handle_unlock(handle);
@@ -299,6 +320,46 @@ void _alpm_trans_free(alpm_trans_t *trans)
 	FREE(trans);
 }
 
+/** Flush pending transaction writes if the durability policy asks for it.
+ * Package files are flushed before the local database so that an entry on
+ * disk never refers to files that are not.
+ * @param handle the context handle
+ * @param point the commit point being reached
+ * @return 0 on success or if nothing needed flushing, -1 on error
+ */
+int _alpm_trans_flush(alpm_handle_t *handle, alpm_durability_t point)
+{
+	alpm_trans_t *trans = handle->trans;
+	struct stat rootbuf, dbbuf;
+	int ret = 0;
+
+	if(!trans->sync_pending || handle->durability < point) {
+		return 0;
+	}
+	trans->sync_pending = 0;
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "flushing %s changes to disk\n",
+			point == ALPM_DURABILITY_PACKAGE ? "package" : "transaction");
+	if(_alpm_syncfs(handle->root) != 0) {
+		_alpm_log(handle, ALPM_LOG_WARNING, _("could not sync filesystem %s: %s\n"),
+				handle->root, strerror(errno));
+		ret = -1;
+	}
+
+	/* the database usually shares a filesystem with the root */
+	if(stat(handle->root, &rootbuf) == 0 && stat(handle->dbpath, &dbbuf) == 0
+			&& rootbuf.st_dev == dbbuf.st_dev) {
+		return ret;
+	}
+	if(_alpm_syncfs(handle->dbpath) != 0) {
+		_alpm_log(handle, ALPM_LOG_WARNING, _("could not sync filesystem %s: %s\n"),
+				handle->dbpath, strerror(errno));
+		ret = -1;
+	}
+
+	return ret;
+}
+
 /* A cheap grep for text files, returns 1 if a substring
  * was found in the text file fn, 0 if it wasn't
  */
@@ -43,10 +43,12 @@ struct __alpm_trans_t {
 	alpm_list_t *add;           /* list of (alpm_pkg_t *) */
 	alpm_list_t *remove;        /* list of (alpm_pkg_t *) */
 	alpm_list_t *skip_remove;   /* list of (char *) */
+	int sync_pending;           /* changes were written that still need a sync */
 };
 
 void _alpm_trans_free(alpm_trans_t *trans);
 int _alpm_trans_init(alpm_trans_t *trans, alpm_transflag_t flags);
+int _alpm_trans_flush(alpm_handle_t *handle, alpm_durability_t point);
 int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 		const char *script, const char *ver, const char *oldver, int is_archive);
 
@@ -27,6 +27,7 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <time.h>
+#include <sys/time.h>
 #include <errno.h>
 #include <limits.h>
 #include <sys/wait.h>
@@ -53,6 +54,7 @@
 #include "alpm_list.h"
 #include "handle.h"
 #include "trans.h"
+#include "hashcache.h"
 
 #ifndef HAVE_STRSEP
 /** Extracts tokens from a string.
@@ -446,6 +448,151 @@ ssize_t _alpm_files_in_directory(alpm_handle_t *handle, const char *path,
 	return files;
 }
 
+/** Open the root directory of a directory stack.
+ * @param ds the directory stack to initialize
+ * @param root the directory all paths given to the stack are relative to
+ * @param flags extra open() flags for the directories below @a root, such as
+ * O_NOFOLLOW to refuse traversing symlinks
+ * @return 0 on success, -1 on error with errno set
+ */
+int _alpm_dirstack_open(alpm_dirstack_t *ds, const char *root, int flags)
+{
+	ds->depth = 0;
+	ds->flags = flags;
+	ds->lens[0] = 0;
+	ds->path[0] = '\0';
+	OPEN(ds->fds[0], root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return ds->fds[0] < 0 ? -1 : 0;
+}
+
+/** Get a descriptor for the parent directory of a path.
+ * Directories shared with the previously requested parent stay open, so
+ * consecutive entries of a sorted filelist only open what changed.
+ * @param ds the directory stack
+ * @param path a path relative to the stack root; a trailing slash denotes a
+ * directory
+ * @param basename buffer receiving the last path component without any
+ * trailing slash
+ * @param basename_size size of the basename buffer
+ * @return a directory descriptor owned by the stack, or -1 on error with
+ * errno set
+ */
+int _alpm_dirstack_parent(alpm_dirstack_t *ds, const char *path,
+		char *basename, size_t basename_size)
+{
+	size_t len = strlen(path), parent_len;
+	const char *slash;
+
+	while(len > 1 && path[len - 1] == '/') {
+		len--;
+	}
+	for(slash = path + len; slash > path && *(slash - 1) != '/'; slash--);
+	parent_len = slash - path;
+
+	if(len - parent_len >= basename_size || len >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memcpy(basename, slash, len - parent_len);
+	basename[len - parent_len] = '\0';
+
+	/* close directories which are not a prefix of the wanted parent; the
+	 * last level is always reopened unless it is the parent itself */
+	while(ds->depth > 0 && (ds->lens[ds->depth] > parent_len
+				|| strncmp(ds->path, path, ds->lens[ds->depth]) != 0
+				|| (ds->depth == ALPM_DIRSTACK_DEPTH
+					&& ds->lens[ds->depth] != parent_len))) {
+		close(ds->fds[ds->depth]);
+		ds->depth--;
+	}
+
+	/* and open the remaining components one level at a time */
+	while(ds->lens[ds->depth] < parent_len) {
+		size_t start = ds->lens[ds->depth], end = start, stop;
+		int dirfd = ds->fds[ds->depth], fd;
+
+		/* out of levels, the last one holds the remainder of the path; its
+		 * components are still opened one by one so that ds->flags, e.g.
+		 * O_NOFOLLOW, applies to each of them */
+		stop = ds->depth == ALPM_DIRSTACK_DEPTH - 1 ? parent_len : start + 1;
+
+		do {
+			size_t cur = end;
+			int err;
+
+			if(path[cur] == '/') {
+				/* never let an empty component turn into an absolute path */
+				fd = -1;
+				errno = EINVAL;
+			} else {
+				for(end = cur; path[end] != '/'; end++);
+				end++;
+				memcpy(ds->path + cur, path + cur, end - cur);
+				ds->path[end] = '\0';
+				do {
+					fd = openat(dirfd, ds->path + cur,
+							O_RDONLY | O_DIRECTORY | O_CLOEXEC | ds->flags);
+				} while(fd == -1 && errno == EINTR);
+			}
+			if(dirfd != ds->fds[ds->depth]) {
+				err = errno;
+				close(dirfd);
+				errno = err;
+			}
+			if(fd < 0) {
+				ds->path[start] = '\0';
+				return -1;
+			}
+			dirfd = fd;
+		} while(end < stop);
+
+		ds->depth++;
+		ds->fds[ds->depth] = fd;
+		ds->lens[ds->depth] = end;
+	}
+	ds->path[parent_len] = '\0';
+
+	return ds->fds[ds->depth];
+}
+
+/** Close all descriptors held by a directory stack.
+ * @param ds the directory stack
+ */
+void _alpm_dirstack_close(alpm_dirstack_t *ds)
+{
+	for(; ds->depth > 0; ds->depth--) {
+		close(ds->fds[ds->depth]);
+	}
+	if(ds->fds[0] >= 0) {
+		close(ds->fds[0]);
+		ds->fds[0] = -1;
+	}
+}
+
+/** Flush all pending writes of the filesystem containing a path.
+ * Falls back to a global sync() where syncfs() is not available.
+ * @param path a directory on the filesystem to flush
+ * @return 0 on success, -1 on error with errno set
+ */
+int _alpm_syncfs(const char *path)
+{
+#ifdef HAVE_SYNCFS
+	int fd, ret;
+
+	OPEN(fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		return -1;
+	}
+	ret = syncfs(fd);
+	close(fd);
+	return ret;
+#else
+	(void)path;
+	sync();
+	return 0;
+#endif
+}
+
 static int should_retry(int errnum)
 {
 	return errnum == EAGAIN
@@ -797,6 +944,11 @@ char *_alpm_filecache_find(alpm_handle_t *handle, const char *filename)
 
 	/* Loop through the cache dirs until we find a matching file */
 	for(i = handle->cachedirs; i; i = i->next) {
+		if(handle->hashedcache
+				&& (retpath = _alpm_hashcache_find(handle, i->data, filename))) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "found cached pkg: %s\n", retpath);
+			return retpath;
+		}
 		snprintf(path, PATH_MAX, "%s%s", (char *)i->data,
 				filename);
 		if(stat(path, &buf) == 0 && S_ISREG(buf.st_mode)) {
@@ -1019,6 +1171,110 @@ char SYMEXPORT *alpm_compute_sha256sum(const char *filename)
 	return hex_representation(output, 32);
 }
 
+/* sha256sum of a file, valid for as long as the file is not replaced or
+ * modified. */
+struct filesum {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	char sum[65];
+};
+
+static int filesum_matches(const struct filesum *fs, const struct stat *st)
+{
+	return fs->dev == st->st_dev && fs->ino == st->st_ino
+		&& fs->size == st->st_size
+		&& fs->mtime.tv_sec == st->st_mtim.tv_sec
+		&& fs->mtime.tv_nsec == st->st_mtim.tv_nsec
+		&& fs->ctime.tv_sec == st->st_ctim.tv_sec
+		&& fs->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static void filesum_free(void *ptr)
+{
+	struct filesum *fs = ptr;
+	free(fs->path);
+	free(fs);
+}
+
+/** Get the sha256 sum of a file, reusing the result of an earlier call for
+ * the same unchanged file. Verifying, signature caching, the package store
+ * and the hashed cache all need the sum of the same package file, which
+ * should only be read once per session.
+ * @param handle the context handle
+ * @param path path of the file
+ * @return the checksum on success, NULL on error. This string must be freed.
+ */
+char *_alpm_file_sha256sum(alpm_handle_t *handle, const char *path)
+{
+	struct filesum *fs = NULL;
+	struct stat st;
+	alpm_list_t *i;
+	char *sum;
+
+	if(stat(path, &st) != 0) {
+		return NULL;
+	}
+	for(i = handle->filesums; i; i = i->next) {
+		struct filesum *f = i->data;
+		if(strcmp(f->path, path) == 0) {
+			fs = f;
+			break;
+		}
+	}
+	if(fs && filesum_matches(fs, &st)) {
+		STRDUP(sum, fs->sum, return NULL);
+		return sum;
+	}
+
+	if((sum = alpm_compute_sha256sum(path)) == NULL) {
+		return NULL;
+	}
+	if(!fs) {
+		CALLOC(fs, 1, sizeof(struct filesum), return sum);
+		STRDUP(fs->path, path, free(fs); return sum);
+		handle->filesums = alpm_list_add(handle->filesums, fs);
+	}
+	fs->dev = st.st_dev;
+	fs->ino = st.st_ino;
+	fs->size = st.st_size;
+	fs->mtime = st.st_mtim;
+	fs->ctime = st.st_ctim;
+	memcpy(fs->sum, sum, sizeof(fs->sum));
+	return sum;
+}
+
+/** Forget all file sums remembered by _alpm_file_sha256sum().
+ * @param handle the context handle
+ */
+void _alpm_filesums_free(alpm_handle_t *handle)
+{
+	alpm_list_free_inner(handle->filesums, filesum_free);
+	alpm_list_free(handle->filesums);
+	handle->filesums = NULL;
+}
+
+/** Get the sha256 sum of a memory buffer.
+ * @param data the bytes to digest
+ * @param len number of bytes in data
+ * @return the checksum on success, NULL on error
+ */
+char *_alpm_compute_sha256sum_buffer(const void *data, size_t len)
+{
+	unsigned char output[32];
+
+#ifdef HAVE_LIBSSL
+	SHA256(data, len, output);
+#else
+	sha2(data, len, output, 0);
+#endif
+
+	return hex_representation(output, 32);
+}
+
 /** Calculates a file's MD5 or SHA-2 digest and compares it to an expected value.
  * @param filepath path of the file to check
  * @param expected hash value to compare against
@@ -1293,6 +1549,56 @@ alpm_time_t _alpm_parsedate(const char *line)
 	return (alpm_time_t)result;
 }
 
+/** Read a monotonic clock, for measuring intervals.
+ * @return milliseconds since an unspecified point in the past
+ */
+uint64_t _alpm_time_ms(void)
+{
+#if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0) && defined(CLOCK_MONOTONIC)
+	struct timespec ts = {0, 0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+	/* darwin doesn't support clock_gettime, fallback to gettimeofday */
+	struct timeval tv = {0, 0};
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+/** Decide whether an operation progress report is passed on to the front
+ * end. The first and last report of an operation, and reports for another
+ * package, always are; others only once the progress interval has passed.
+ * Operations that cannot tell how far they are report 0 throughout, so only
+ * the first of those counts as the start.
+ * @param handle the context handle
+ * @param event the operation being reported
+ * @param percent how far the operation is
+ * @param current number of the package the operation is at
+ * @return 1 if the report should be made, 0 otherwise
+ */
+int _alpm_progress_due(alpm_handle_t *handle, alpm_progress_t event,
+		int percent, size_t current)
+{
+	uint64_t now;
+
+	if(handle->progressinterval == 0) {
+		return 1;
+	}
+	now = _alpm_time_ms();
+	if(percent != 100 && (percent != 0 || handle->progress_percent == 0)
+			&& event == handle->progress_event
+			&& current == handle->progress_current
+			&& now - handle->progress_last < handle->progressinterval) {
+		return 0;
+	}
+	handle->progress_last = now;
+	handle->progress_event = event;
+	handle->progress_current = current;
+	handle->progress_percent = percent;
+	return 1;
+}
+
 /** Wrapper around access() which takes a dir and file argument
  * separately and generates an appropriate error message.
  * If dir is NULL file will be treated as the whole path.
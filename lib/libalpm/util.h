@@ -38,6 +38,7 @@
 #include <math.h> /* fabs */
 #include <float.h> /* DBL_EPSILON */
 #include <fcntl.h> /* open, close */
+#include <limits.h> /* PATH_MAX */
 
 #include <archive.h> /* struct archive */
 
@@ -92,6 +93,27 @@ void _alpm_alloc_fail(size_t size);
 
 #define OPEN(fd, path, flags) do { fd = open(path, flags | O_BINARY); } while(fd == -1 && errno == EINTR)
 
+/** Maximum number of directory levels held open by an alpm_dirstack_t;
+ * deeper parents are opened as a whole in the last level. */
+#define ALPM_DIRSTACK_DEPTH 32
+
+/**
+ * Open file descriptors for each directory component of the most recently
+ * used parent path below a root. Walking a sorted filelist through it allows
+ * files to be handled with *at() calls relative to their parent directory
+ * instead of resolving their full path from the root every time.
+ */
+typedef struct _alpm_dirstack_t {
+	/* path of the innermost open directory relative to the root */
+	char path[PATH_MAX];
+	/* lens[n] is the length of the prefix of path opened as fds[n] */
+	size_t lens[ALPM_DIRSTACK_DEPTH + 1];
+	int fds[ALPM_DIRSTACK_DEPTH + 1];
+	size_t depth;
+	/* extra flags used when opening directories, e.g. O_NOFOLLOW */
+	int flags;
+} alpm_dirstack_t;
+
 /**
  * Used as a buffer/state holder for _alpm_archive_fgets().
  */
@@ -123,6 +145,12 @@ int _alpm_unpack(alpm_handle_t *handle, const char *archive, const char *prefix,
 
 ssize_t _alpm_files_in_directory(alpm_handle_t *handle, const char *path, int full_count);
 
+int _alpm_dirstack_open(alpm_dirstack_t *ds, const char *root, int flags);
+int _alpm_dirstack_parent(alpm_dirstack_t *ds, const char *path,
+		char *basename, size_t basename_size);
+void _alpm_dirstack_close(alpm_dirstack_t *ds);
+int _alpm_syncfs(const char *path);
+
 typedef ssize_t (*_alpm_cb_io)(void *buf, ssize_t len, void *ctx);
 
 int _alpm_run_chroot(alpm_handle_t *handle, const char *cmd, char *const argv[],
@@ -131,6 +159,9 @@ int _alpm_ldconfig(alpm_handle_t *handle);
 int _alpm_str_cmp(const void *s1, const void *s2);
 char *_alpm_filecache_find(alpm_handle_t *handle, const char *filename);
 const char *_alpm_filecache_setup(alpm_handle_t *handle);
+char *_alpm_compute_sha256sum_buffer(const void *data, size_t len);
+char *_alpm_file_sha256sum(alpm_handle_t *handle, const char *path);
+void _alpm_filesums_free(alpm_handle_t *handle);
 int _alpm_test_checksum(const char *filepath, const char *expected, alpm_pkgvalidation_t type);
 int _alpm_archive_fgets(struct archive *a, struct archive_read_buffer *b);
 int _alpm_splitname(const char *target, char **name, char **version,
@@ -138,6 +169,9 @@ int _alpm_splitname(const char *target, char **name, char **version,
 unsigned long _alpm_hash_sdbm(const char *str);
 off_t _alpm_strtoofft(const char *line);
 alpm_time_t _alpm_parsedate(const char *line);
+uint64_t _alpm_time_ms(void);
+int _alpm_progress_due(alpm_handle_t *handle, alpm_progress_t event,
+		int percent, size_t current);
 int _alpm_raw_cmp(const char *first, const char *second);
 int _alpm_raw_ncmp(const char *first, const char *second, size_t max);
 int _alpm_access(alpm_handle_t *handle, const char *dir, const char *file, int amode);
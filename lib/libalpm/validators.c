@@ -0,0 +1,274 @@
+/*
+ *  validators.c
+ *
+ *  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
+#include <stdint.h> /* intmax_t */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* libalpm */
+#include "validators.h"
+#include "alpm_list.h"
+#include "handle.h"
+#include "log.h"
+#include "util.h"
+
+/*
+ * Validators remember the ETag a server sent along with a sync database or
+ * its signature, so the next update can ask with If-None-Match whether the
+ * file changed at all. They are kept in the database directory as a text
+ * file with one line per downloaded file:
+ *
+ *   <size> <mtime> <url> <etag>
+ *
+ * Size and modification time are those of the local copy when the ETag was
+ * received; a validator is only sent while the local copy still matches
+ * them, so a file replaced by other means is never mistaken for the one the
+ * server tagged.
+ */
+
+#define VALIDATORS_FILE "validators"
+
+struct validator {
+	char *url;
+	char *etag;
+	off_t size;
+	alpm_time_t mtime;
+};
+
+static void validator_free(struct validator *v)
+{
+	free(v->url);
+	free(v->etag);
+	free(v);
+}
+
+static alpm_list_t *validators_find(alpm_handle_t *handle, const char *url)
+{
+	alpm_list_t *i;
+
+	for(i = handle->validators; i; i = i->next) {
+		struct validator *v = i->data;
+		if(strcmp(v->url, url) == 0) {
+			return i;
+		}
+	}
+	return NULL;
+}
+
+static char *validators_path(alpm_handle_t *handle)
+{
+	size_t len = strlen(handle->dbpath) + strlen(VALIDATORS_FILE) + 1;
+	char *path;
+
+	MALLOC(path, len, return NULL);
+	snprintf(path, len, "%s%s", handle->dbpath, VALIDATORS_FILE);
+	return path;
+}
+
+/**
+ * Read the validators file, once per handle.
+ * @param handle the context handle
+ */
+static void validators_load(alpm_handle_t *handle)
+{
+	char line[PATH_MAX + 256];
+	char *path;
+	FILE *fp;
+
+	if(handle->validators_loaded) {
+		return;
+	}
+	handle->validators_loaded = 1;
+
+	if((path = validators_path(handle)) == NULL) {
+		return;
+	}
+	fp = fopen(path, "r");
+	free(path);
+	if(fp == NULL) {
+		return;
+	}
+
+	while(safe_fgets(line, sizeof(line), fp)) {
+		struct validator *v;
+		intmax_t size, mtime;
+		char *url, *etag;
+		int pos = 0;
+
+		if(_alpm_strip_newline(line, 0) == 0) {
+			continue;
+		}
+		if(sscanf(line, "%jd %jd %n", &size, &mtime, &pos) != 2 || pos == 0) {
+			continue;
+		}
+		url = line + pos;
+		if((etag = strchr(url, ' ')) == NULL || etag[1] == '\0') {
+			continue;
+		}
+		*etag++ = '\0';
+		if(validators_find(handle, url)) {
+			continue;
+		}
+		CALLOC(v, 1, sizeof(struct validator), break);
+		STRDUP(v->url, url, free(v); break);
+		STRDUP(v->etag, etag, validator_free(v); break);
+		v->size = (off_t)size;
+		v->mtime = (alpm_time_t)mtime;
+		handle->validators = alpm_list_add(handle->validators, v);
+	}
+	fclose(fp);
+}
+
+/**
+ * Look up the ETag to revalidate a local copy of a file with.
+ * @param handle the context handle
+ * @param url the URL the file is downloaded from
+ * @param path the local copy of the file
+ * @return the ETag, or NULL if there is none for this copy
+ */
+const char *_alpm_validators_get(alpm_handle_t *handle, const char *url,
+		const char *path)
+{
+	alpm_list_t *item;
+	struct validator *v;
+	struct stat st;
+
+	validators_load(handle);
+	if((item = validators_find(handle, url)) == NULL || stat(path, &st) != 0) {
+		return NULL;
+	}
+	v = item->data;
+	if(st.st_size != v->size || (alpm_time_t)st.st_mtime != v->mtime) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s changed since its ETag was stored\n",
+				path);
+		return NULL;
+	}
+	return v->etag;
+}
+
+/**
+ * Remember the ETag a server sent for a file that is now in place.
+ * @param handle the context handle
+ * @param url the URL the file was downloaded from
+ * @param path the local copy of the file
+ * @param etag the ETag, or NULL to forget any stored one
+ */
+void _alpm_validators_set(alpm_handle_t *handle, const char *url,
+		const char *path, const char *etag)
+{
+	alpm_list_t *item;
+	struct validator *v;
+	struct stat st;
+
+	validators_load(handle);
+	item = validators_find(handle, url);
+
+	if(etag == NULL || *etag == '\0' || strchr(url, ' ') || stat(path, &st) != 0) {
+		if(item) {
+			handle->validators = alpm_list_remove_item(handle->validators, item);
+			validator_free(item->data);
+			free(item);
+			handle->validators_dirty = 1;
+		}
+		return;
+	}
+
+	if(item) {
+		v = item->data;
+		if(strcmp(v->etag, etag) != 0) {
+			char *copy;
+			STRDUP(copy, etag, return);
+			free(v->etag);
+			v->etag = copy;
+		}
+	} else {
+		CALLOC(v, 1, sizeof(struct validator), return);
+		STRDUP(v->url, url, free(v); return);
+		STRDUP(v->etag, etag, validator_free(v); return);
+		handle->validators = alpm_list_add(handle->validators, v);
+	}
+	v->size = st.st_size;
+	v->mtime = st.st_mtime;
+	handle->validators_dirty = 1;
+}
+
+/**
+ * Write the validators back if they changed. Callers must hold the
+ * database lock.
+ * @param handle the context handle
+ */
+void _alpm_validators_save(alpm_handle_t *handle)
+{
+	char *path, *tmppath;
+	alpm_list_t *i;
+	size_t len;
+	FILE *fp;
+
+	if(!handle->validators_dirty) {
+		return;
+	}
+	if((path = validators_path(handle)) == NULL) {
+		return;
+	}
+	len = strlen(path) + 5;
+	MALLOC(tmppath, len, free(path); return);
+	snprintf(tmppath, len, "%s.tmp", path);
+
+	if((fp = fopen(tmppath, "w")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write %s: %s\n",
+				tmppath, strerror(errno));
+		goto cleanup;
+	}
+	for(i = handle->validators; i; i = i->next) {
+		const struct validator *v = i->data;
+		fprintf(fp, "%jd %jd %s %s\n", (intmax_t)v->size, (intmax_t)v->mtime,
+				v->url, v->etag);
+	}
+	if(fclose(fp) != 0 || rename(tmppath, path) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write %s: %s\n",
+				path, strerror(errno));
+		unlink(tmppath);
+		goto cleanup;
+	}
+	handle->validators_dirty = 0;
+
+cleanup:
+	free(tmppath);
+	free(path);
+}
+
+/**
+ * Forget the in-memory validators.
+ * @param handle the context handle
+ */
+void _alpm_validators_free(alpm_handle_t *handle)
+{
+	alpm_list_free_inner(handle->validators, (alpm_list_fn_free)validator_free);
+	alpm_list_free(handle->validators);
+	handle->validators = NULL;
+	handle->validators_loaded = 0;
+	handle->validators_dirty = 0;
+}
+
+/* vim: set noet: */
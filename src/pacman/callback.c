@@ -40,14 +40,12 @@
 /* download progress bar */
 static off_t list_xfered = 0.0;
 static off_t list_total = 0.0;
+static int64_t list_start = 0;
 
 /* delayed output during progress bar */
 static int on_progress = 0;
 static alpm_list_t *output = NULL;
 
-/* update speed for the fill_progress based functions */
-#define UPDATE_SPEED_MS 200
-
 #if !defined(CLOCK_MONOTONIC_COARSE) && defined(CLOCK_MONOTONIC)
 #define CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
 #endif
@@ -66,34 +64,6 @@ static int64_t get_time_ms(void)
 #endif
 }
 
-/**
- * Silly little helper function, determines if the caller needs a visual update
- * since the last time this function was called.
- * This is made for the two progress bar functions, to prevent flicker.
- * @param first_call 1 on first call for initialization purposes, 0 otherwise
- * @return number of milliseconds since last call
- */
-static int64_t get_update_timediff(int first_call)
-{
-	int64_t retval = 0;
-	static int64_t last_time = 0;
-
-	/* on first call, simply set the last time and return */
-	if(first_call) {
-		last_time = get_time_ms();
-	} else {
-		int64_t this_time = get_time_ms();
-		retval = this_time - last_time;
-
-		/* do not update last_time if interval was too short */
-		if(retval < 0 || retval >= UPDATE_SPEED_MS) {
-			last_time = this_time;
-		}
-	}
-
-	return retval;
-}
-
 /* refactored from cb_trans_progress */
 static void fill_progress(const int bar_percent, const int disp_percent,
 		const int proglen)
@@ -519,23 +489,18 @@ void cb_progress(alpm_progress_t event, const char *pkgname, int percent,
 		return;
 	}
 
-	if(percent == 0) {
-		get_update_timediff(1);
-	} else if(percent == 100) {
-		/* no need for timediff update, but unconditionally continue unless we
-		 * already completed on a previous call */
+	if(percent == 100) {
+		/* unconditionally continue unless we already completed on a
+		 * previous call */
 		if(prevpercent == 100) {
 			return;
 		}
-	} else {
-		if(current != prevcurrent) {
-			/* update always */
-		} else if(!pkgname || percent == prevpercent ||
-				get_update_timediff(0) < UPDATE_SPEED_MS) {
-			/* only update the progress bar when we have a package name, the
-			 * percentage has changed, and it has been long enough. */
-			return;
-		}
+	} else if(percent != 0 && current == prevcurrent
+			&& (!pkgname || percent == prevpercent)) {
+		/* only update the progress bar when we have a package name and the
+		 * percentage has changed; libalpm already limits how often reports
+		 * come in, see ProgressInterval */
+		return;
 	}
 
 	prevpercent = percent;
@@ -655,25 +620,124 @@ void cb_dl_total(off_t total)
 	 * so clear out our list_xfered as well */
 	if(total == 0) {
 		list_xfered = 0;
+	} else {
+		list_start = get_time_ms();
+	}
+}
+
+/* Shorten a download file name to fit the room left for it on the line.
+ * Returns the name as wide characters, and in padwid the columns it leaves
+ * free, or NULL if memory ran out. */
+static wchar_t *fit_dl_filename(const char *filename, int filenamelen,
+		int *padwid)
+{
+	int len, wclen, wcwid;
+	char *fname, *p;
+	wchar_t *wcfname;
+
+	len = strlen(filename);
+	fname = malloc(len + 1);
+	if(fname == NULL) {
+		return NULL;
+	}
+	memcpy(fname, filename, len);
+	/* strip package or DB extension for cleaner look */
+	if((p = strstr(fname, ".pkg")) || (p = strstr(fname, ".db")) || (p = strstr(fname, ".files"))) {
+		/* tack on a .sig suffix for signatures */
+		if(memcmp(&filename[len - 4], ".sig", 4) == 0) {
+			memcpy(p, ".sig", 4);
+
+			/* adjust length for later calculations */
+			len = p - fname + 4;
+		} else {
+			len = p - fname;
+		}
+	}
+	fname[len] = '\0';
+
+	/* In order to deal with characters from all locales, we have to worry
+	 * about wide characters and their column widths. A lot of stuff is
+	 * done here to figure out the actual number of screen columns used
+	 * by the output, and then pad it accordingly so we fill the terminal.
+	 */
+	/* len = filename len + null */
+	wcfname = calloc(len + 1, sizeof(wchar_t));
+	if(wcfname == NULL) {
+		free(fname);
+		return NULL;
+	}
+	wclen = mbstowcs(wcfname, fname, len);
+	wcwid = wcswidth(wcfname, wclen);
+	*padwid = filenamelen - wcwid;
+	/* if padwid is < 0, we need to trim the string so padwid = 0 */
+	if(*padwid < 0) {
+		int i = filenamelen - 3;
+		wchar_t *wcp = wcfname;
+		/* grab the max number of char columns we can fill */
+		while(i > 0 && wcwidth(*wcp) < i) {
+			i -= wcwidth(*wcp);
+			wcp++;
+		}
+		/* then add the ellipsis and fill out any extra padding */
+		wcscpy(wcp, L"...");
+		*padwid = i;
+
+	}
+
+	free(fname);
+	return wcfname;
+}
+
+/* Draw the bar of a download split into byte ranges, each range filling
+ * its own share of the bar. */
+static void fill_ranges(const alpm_download_progress_t *progress,
+		const int disp_percent, const int proglen)
+{
+	/* 9 = 1 space + 1 [ + 1 ] + 5 for percent + 1 blank */
+	const int hashlen = proglen > 9 ? proglen - 9 : 0;
+	size_t r;
+
+	if(hashlen > 0) {
+		fputs(" [", stdout);
+		for(r = 0; r < progress->nranges; r++) {
+			const alpm_download_range_t *range = progress->ranges + r;
+			const int start = r * hashlen / progress->nranges;
+			const int end = (r + 1) * hashlen / progress->nranges;
+			int i, hash = 0;
+
+			if(range->total > 0) {
+				hash = (int)((end - start) * range->downloaded / range->total);
+			}
+			for(i = start; i < end; i++) {
+				putchar(i - start < hash ? '#' : '-');
+			}
+		}
+		putchar(']');
+	}
+	/* 5 = 1 space + 3 digits + 1 % */
+	if(proglen >= 5) {
+		printf(" %3d%%", disp_percent);
 	}
+	putchar('\r');
+	fflush(stdout);
 }
 
 /* callback to handle display of download progress */
-void cb_dl_progress(const char *filename, off_t file_xfered, off_t file_total)
+void cb_dl_progress(const alpm_download_progress_t *progress)
 {
-	static double rate_last;
-	static off_t xfered_last;
-	static int64_t initial_time = 0;
+	/* the shortened name only changes with the file and the room for it */
+	static char *lastname = NULL;
+	static wchar_t *wcfname = NULL;
+	static int lastlen = -1, padwid;
+	const char *filename = progress->filename;
+	const off_t file_xfered = progress->downloaded;
+	const off_t file_total = progress->total;
 	int infolen;
 	int filenamelen;
-	char *fname, *p;
-	/* used for wide character width determination and printing */
-	int len, wclen, wcwid, padwid;
-	wchar_t *wcfname;
 
 	int totaldownload = 0;
-	off_t xfered, total;
-	double rate = 0.0;
+	off_t xfered, total, rate = progress->rate;
+	int64_t elapsed = progress->elapsed;
 	unsigned int eta_h = 0, eta_m = 0, eta_s = 0;
 	double rate_human, xfered_human;
 	const char *rate_label, *xfered_label;
@@ -718,45 +782,26 @@ void cb_dl_progress(const char *filename, off_t file_xfered, off_t file_total)
 		return;
 	}
 
-	/* this is basically a switch on xfered: 0, total, and
-	 * anything else */
-	if(file_xfered == 0) {
-		/* set default starting values, ensure we only call this once
-		 * if TotalDownload is enabled */
-		if(!totaldownload || (totaldownload && list_xfered == 0)) {
-			initial_time = get_time_ms();
-			xfered_last = (off_t)0;
-			rate_last = 0.0;
-			get_update_timediff(1);
+	if(totaldownload && progress->done) {
+		/* the bar shows the whole list, so the time and average rate
+		 * shown at the end of a file cover everything downloaded so far */
+		elapsed = get_time_ms() - list_start;
+		if(elapsed > 0) {
+			rate = xfered * 1000 / elapsed;
 		}
-	} else if(file_xfered == file_total) {
-		/* compute final values */
-		int64_t timediff = get_time_ms() - initial_time;
-		if(timediff > 0) {
-			rate = (double)xfered / (timediff / 1000.0);
-			/* round elapsed time (in ms) to the nearest second */
-			eta_s = (unsigned int)(timediff + 500) / 1000;
-		} else {
-			eta_s = 0;
-		}
-	} else {
-		/* compute current average values */
-		int64_t timediff = get_update_timediff(0);
+	}
 
-		if(timediff < UPDATE_SPEED_MS) {
-			/* return if the calling interval was too short */
-			return;
-		}
-		rate = (double)(xfered - xfered_last) / (timediff / 1000.0);
-		/* average rate to reduce jumpiness */
-		rate = (rate + 2 * rate_last) / 3;
-		if(rate > 0.0) {
-			eta_s = (total - xfered) / rate;
-		} else {
-			eta_s = UINT_MAX;
-		}
-		rate_last = rate;
-		xfered_last = xfered;
+	/* libalpm keeps the rate; this is basically a switch on xfered: 0, total,
+	 * and anything else */
+	if(file_xfered == 0) {
+		eta_s = 0;
+	} else if(progress->done) {
+		/* round elapsed time (in ms) to the nearest second */
+		eta_s = (unsigned int)((elapsed + 500) / 1000);
+	} else if(rate > 0) {
+		eta_s = (total - xfered) / rate;
+	} else {
+		eta_s = UINT_MAX;
 	}
 
 	if(file_total) {
@@ -781,23 +826,6 @@ void cb_dl_progress(const char *filename, off_t file_xfered, off_t file_total)
 	eta_m = eta_s / 60;
 	eta_s -= eta_m * 60;
 
-	len = strlen(filename);
-	fname = malloc(len + 1);
-	memcpy(fname, filename, len);
-	/* strip package or DB extension for cleaner look */
-	if((p = strstr(fname, ".pkg")) || (p = strstr(fname, ".db")) || (p = strstr(fname, ".files"))) {
-		/* tack on a .sig suffix for signatures */
-		if(memcmp(&filename[len - 4], ".sig", 4) == 0) {
-			memcpy(p, ".sig", 4);
-
-			/* adjust length for later calculations */
-			len = p - fname + 4;
-		} else {
-			len = p - fname;
-		}
-	}
-	fname[len] = '\0';
-
 	/* 1 space + filenamelen + 1 space + 6 for size + 1 space + 3 for label +
 	 * + 2 spaces + 4 for rate + 1 for label + 2 for /s + 1 space +
 	 * 8 for eta, gives us the magic 30 */
@@ -807,32 +835,22 @@ void cb_dl_progress(const char *filename, off_t file_xfered, off_t file_total)
 		filenamelen += 3;
 	}
 
-	/* In order to deal with characters from all locales, we have to worry
-	 * about wide characters and their column widths. A lot of stuff is
-	 * done here to figure out the actual number of screen columns used
-	 * by the output, and then pad it accordingly so we fill the terminal.
-	 */
-	/* len = filename len + null */
-	wcfname = calloc(len + 1, sizeof(wchar_t));
-	wclen = mbstowcs(wcfname, fname, len);
-	wcwid = wcswidth(wcfname, wclen);
-	padwid = filenamelen - wcwid;
-	/* if padwid is < 0, we need to trim the string so padwid = 0 */
-	if(padwid < 0) {
-		int i = filenamelen - 3;
-		wchar_t *wcp = wcfname;
-		/* grab the max number of char columns we can fill */
-		while(i > 0 && wcwidth(*wcp) < i) {
-			i -= wcwidth(*wcp);
-			wcp++;
+	if(lastname == NULL || filenamelen != lastlen || strcmp(lastname, filename) != 0) {
+		free(lastname);
+		free(wcfname);
+		lastname = strdup(filename);
+		wcfname = fit_dl_filename(filename, filenamelen, &padwid);
+		lastlen = filenamelen;
+		if(lastname == NULL || wcfname == NULL) {
+			free(lastname);
+			free(wcfname);
+			lastname = NULL;
+			wcfname = NULL;
+			return;
 		}
-		/* then add the ellipsis and fill out any extra padding */
-		wcscpy(wcp, L"...");
-		padwid = i;
-
 	}
 
-	rate_human = humanize_size((off_t)rate, '\0', -1, &rate_label);
+	rate_human = humanize_size(rate, '\0', -1, &rate_label);
 	xfered_human = humanize_size(xfered, '\0', -1, &xfered_label);
 
 	printf(" %ls%-*s ", wcfname, padwid, "");
@@ -855,10 +873,10 @@ void cb_dl_progress(const char *filename, off_t file_xfered, off_t file_total)
 		fputs("--:--", stdout);
 	}
 
-	free(fname);
-	free(wcfname);
-
-	if(totaldownload) {
+	if(progress->nranges > 1 && !progress->done) {
+		fill_ranges(progress, totaldownload ? total_percent : file_percent,
+				cols - infolen);
+	} else if(totaldownload) {
 		fill_progress(file_percent, total_percent, cols - infolen);
 	} else {
 		fill_progress(file_percent, file_percent, cols - infolen);
@@ -20,17 +20,41 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 /* pacman */
 #include "check.h"
 #include "conf.h"
 #include "util.h"
 
-static int check_file_exists(const char *pkgname, char *filepath, size_t rootlen,
-		struct stat *st)
+/* A file listed in a package's mtree and what was found for it on disk. */
+struct file_check {
+	char *filepath;
+	char *warning;                /* reported instead of checking the file */
+	/* from the mtree */
+	mode_t type;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	time_t mtime;
+	off_t size;
+	char *symlink;
+	char *sha256;                 /* expected checksum, NULL if not recorded */
+	int backup;
+	/* from the local database */
+	const alpm_filestamp_t *stamp;  /* as installed, NULL if not recorded */
+	/* from the filesystem */
+	int err;                      /* errno of a failed lstat, 0 on success */
+	struct stat st;
+	char *link;                   /* symlink target, NULL if not read */
+	char *digest;                 /* checksum, NULL if the file was not hashed */
+};
+
+static int check_file_exists(const char *pkgname, const char *filepath,
+		size_t rootlen, int err)
 {
-	/* use lstat to prevent errors from symlinks */
-	if(llstat(filepath, st) != 0) {
+	if(err != 0) {
 		if(alpm_option_match_noextract(config->handle, filepath + rootlen) == 0) {
 			/* NoExtract */
 			return -1;
@@ -39,7 +63,7 @@ static int check_file_exists(const char *pkgname, char *filepath, size_t rootlen
 				printf("%s %s\n", pkgname, filepath);
 			} else {
 				pm_printf(ALPM_LOG_WARNING, "%s: %s (%s)\n",
-						pkgname, filepath, strerror(errno));
+						pkgname, filepath, strerror(err));
 			}
 			return 1;
 		}
@@ -48,20 +72,19 @@ static int check_file_exists(const char *pkgname, char *filepath, size_t rootlen
 	return 0;
 }
 
-static int check_file_type(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry)
+static int check_file_type(const char *pkgname, const struct file_check *file)
 {
-	mode_t archive_type = archive_entry_filetype(entry);
-	mode_t file_type = st->st_mode;
+	mode_t archive_type = file->type;
+	mode_t file_type = file->st.st_mode;
 
 	if((archive_type == AE_IFREG && !S_ISREG(file_type)) ||
 			(archive_type == AE_IFDIR && !S_ISDIR(file_type)) ||
 			(archive_type == AE_IFLNK && !S_ISLNK(file_type))) {
 		if(config->quiet) {
-			printf("%s %s\n", pkgname, filepath);
+			printf("%s %s\n", pkgname, file->filepath);
 		} else {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (File type mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 		return 1;
 	}
@@ -69,61 +92,60 @@ static int check_file_type(const char *pkgname, const char *filepath,
 	return 0;
 }
 
-static int check_file_permissions(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry)
+static int check_file_permissions(const char *pkgname,
+		const struct file_check *file)
 {
 	int errors = 0;
 	mode_t fsmode;
 
 #ifndef __MSYS__
 	/* uid */
-	if(st->st_uid != archive_entry_uid(entry)) {
+	if(file->st.st_uid != file->uid) {
 		errors++;
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (UID mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 	}
 
 	/* gid */
-	if(st->st_gid != archive_entry_gid(entry)) {
+	if(file->st.st_gid != file->gid) {
 		errors++;
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (GID mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 	}
 #endif
 
 	/* mode */
-	fsmode = st->st_mode & (S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO);
-	if(fsmode != (~AE_IFMT & archive_entry_mode(entry))) {
+	fsmode = file->st.st_mode & (S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO);
+	if(fsmode != file->mode) {
 		errors++;
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Permissions mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 	}
 
 	return (errors != 0 ? 1 : 0);
 }
 
-static int check_file_time(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry, int backup)
+static int check_file_time(const char *pkgname, const struct file_check *file)
 {
-	if(st->st_mtime != archive_entry_mtime(entry)) {
-		if(backup) {
+	if(file->st.st_mtime != file->mtime) {
+		if(file->backup) {
 			if(!config->quiet) {
 				printf("%s%s%s: ", config->colstr.title, _("backup file"),
 						config->colstr.nocolor);
 				printf(_("%s: %s (Modification time mismatch)\n"),
-						pkgname, filepath);
+						pkgname, file->filepath);
 			}
 			return 0;
 		}
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Modification time mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 		return 1;
 	}
@@ -131,23 +153,19 @@ static int check_file_time(const char *pkgname, const char *filepath,
 	return 0;
 }
 
-static int check_file_link(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry)
+static int check_file_link(const char *pkgname, const struct file_check *file)
 {
-	size_t length = st->st_size + 1;
-	char link[length];
-
-	if(readlink(filepath, link, length) != st->st_size) {
+	if(file->link == NULL) {
 		/* this should not happen */
-		pm_printf(ALPM_LOG_ERROR, _("unable to read symlink contents: %s\n"), filepath);
+		pm_printf(ALPM_LOG_ERROR, _("unable to read symlink contents: %s\n"),
+				file->filepath);
 		return 1;
 	}
-	link[length - 1] = '\0';
 
-	if(strcmp(link, archive_entry_symlink(entry)) != 0) {
+	if(strcmp(file->link, file->symlink) != 0) {
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Symlink path mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 		return 1;
 	}
@@ -155,22 +173,21 @@ static int check_file_link(const char *pkgname, const char *filepath,
 	return 0;
 }
 
-static int check_file_size(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry, int backup)
+static int check_file_size(const char *pkgname, const struct file_check *file)
 {
-	if(st->st_size != archive_entry_size(entry)) {
-		if(backup) {
+	if(file->st.st_size != file->size) {
+		if(file->backup) {
 			if(!config->quiet) {
 				printf("%s%s%s: ", config->colstr.title, _("backup file"),
 						config->colstr.nocolor);
 				printf(_("%s: %s (Size mismatch)\n"),
-						pkgname, filepath);
+						pkgname, file->filepath);
 			}
 			return 0;
 		}
 		if(!config->quiet) {
 			pm_printf(ALPM_LOG_WARNING, _("%s: %s (Size mismatch)\n"),
-					pkgname, filepath);
+					pkgname, file->filepath);
 		}
 		return 1;
 	}
@@ -178,19 +195,33 @@ static int check_file_size(const char *pkgname, const char *filepath,
 	return 0;
 }
 
-/* placeholders - libarchive currently does not read checksums from mtree files
-static int check_file_md5sum(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry, int backup)
+static int check_file_sha256sum(const char *pkgname,
+		const struct file_check *file)
 {
-	return 0;
-}
+	if(file->digest == NULL) {
+		/* not hashed, either unchanged since install or nothing to compare */
+		return 0;
+	}
+
+	if(strcmp(file->digest, file->sha256) != 0) {
+		if(file->backup) {
+			if(!config->quiet) {
+				printf("%s%s%s: ", config->colstr.title, _("backup file"),
+						config->colstr.nocolor);
+				printf(_("%s: %s (SHA256 checksum mismatch)\n"),
+						pkgname, file->filepath);
+			}
+			return 0;
+		}
+		if(!config->quiet) {
+			pm_printf(ALPM_LOG_WARNING, _("%s: %s (SHA256 checksum mismatch)\n"),
+					pkgname, file->filepath);
+		}
+		return 1;
+	}
 
-static int check_file_sha256sum(const char *pkgname, const char *filepath,
-		struct stat *st, struct archive_entry *entry, int backup)
-{
 	return 0;
 }
-*/
 
 /* Loop through the files of the package to check if they exist. */
 int check_pkg_fast(alpm_pkg_t *pkg)
@@ -216,7 +247,7 @@ int check_pkg_fast(alpm_pkg_t *pkg)
 	for(i = 0; i < filelist->count; i++) {
 		const alpm_file_t *file = filelist->files + i;
 		struct stat st;
-		int exists;
+		int exists, err;
 		const char *path = file->name;
 		size_t plen = strlen(path);
 
@@ -226,7 +257,9 @@ int check_pkg_fast(alpm_pkg_t *pkg)
 		}
 		strcpy(filepath + rootlen, path);
 
-		exists = check_file_exists(pkgname, filepath, rootlen, &st);
+		/* use lstat to prevent errors from symlinks */
+		err = llstat(filepath, &st) != 0 ? errno : 0;
+		exists = check_file_exists(pkgname, filepath, rootlen, err);
 		if(exists == 0) {
 			int expect_dir = path[plen - 1] == '/' ? 1 : 0;
 			int is_dir = S_ISDIR(st.st_mode) ? 1 : 0;
@@ -250,44 +283,116 @@ int check_pkg_fast(alpm_pkg_t *pkg)
 	return (errors != 0 ? 1 : 0);
 }
 
-/* Loop though files in a package and perform full file property checking. */
-int check_pkg_full(alpm_pkg_t *pkg)
+/* Number of files handed to a worker thread at a time. */
+#define CHECK_CHUNK 32
+
+/* A package queued for a full check. */
+struct pkg_check {
+	alpm_pkg_t *pkg;
+	struct file_check *files;
+	size_t count;
+	size_t next;                  /* first file not yet handed to a worker */
+	size_t pending;               /* files not yet looked up on disk */
+	int nomtree;
+};
+
+/* Worker threads looking up files on disk. Packages are queued into a fixed
+ * window and reported strictly in queue order by the main thread; only the
+ * main thread ever calls into libalpm or prints anything. */
+struct check_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;          /* files were queued, or quit was set */
+	pthread_cond_t done;          /* a package has no pending files left */
+	pthread_t *threads;
+	size_t nthreads;
+	struct pkg_check **window;
+	size_t size;                  /* number of slots in window */
+	size_t head;                  /* oldest package not yet reported */
+	size_t dispatch;              /* package files are being handed out from */
+	size_t tail;                  /* next package to be queued */
+	int quit;
+};
+
+static void pkg_check_free(struct pkg_check *check)
 {
-	const char *root, *pkgname;
-	size_t errors = 0;
-	size_t rootlen;
+	size_t i;
+
+	if(check == NULL) {
+		return;
+	}
+	for(i = 0; i < check->count; i++) {
+		struct file_check *file = check->files + i;
+		free(file->filepath);
+		free(file->warning);
+		free(file->symlink);
+		free(file->sha256);
+		free(file->link);
+		free(file->digest);
+	}
+	free(check->files);
+	free(check);
+}
+
+#ifdef ARCHIVE_ENTRY_DIGEST_SHA256
+/* The hex sha256 checksum of an mtree entry, NULL if it has none. */
+static char *entry_sha256(struct archive_entry *entry)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *digest;
+	char *str;
+	int i, set = 0;
+
+	digest = archive_entry_digest(entry, ARCHIVE_ENTRY_DIGEST_SHA256);
+	if(digest == NULL) {
+		return NULL;
+	}
+	for(i = 0; i < 32; i++) {
+		set |= digest[i];
+	}
+	if(!set) {
+		return NULL;
+	}
+
+	if((str = malloc(65)) == NULL) {
+		return NULL;
+	}
+	for(i = 0; i < 32; i++) {
+		str[2 * i] = hex[digest[i] >> 4];
+		str[2 * i + 1] = hex[digest[i] & 0x0f];
+	}
+	str[64] = '\0';
+	return str;
+}
+#endif
+
+/* Read the mtree of a package into a list of files to check. */
+static struct pkg_check *pkg_check_new(alpm_pkg_t *pkg, const char *root)
+{
+	struct pkg_check *check;
 	struct archive *mtree;
 	struct archive_entry *entry = NULL;
-	size_t file_count = 0;
-	const alpm_list_t *lp;
+	const char *pkgname = alpm_pkg_get_name(pkg);
+	size_t size = 0;
 
-	root = alpm_option_get_root(config->handle);
-	rootlen = strlen(root);
-	if(rootlen + 1 > PATH_MAX) {
-		/* we are in trouble here */
-		pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
-		return 1;
+	if((check = calloc(1, sizeof(struct pkg_check))) == NULL) {
+		return NULL;
 	}
+	check->pkg = pkg;
 
-	pkgname = alpm_pkg_get_name(pkg);
 	mtree = alpm_pkg_mtree_open(pkg);
 	if(mtree == NULL) {
 		/* TODO: check error to confirm failure due to no mtree file */
-		if(!config->quiet) {
-			printf(_("%s: no mtree file\n"), pkgname);
-		}
-		return 0;
+		check->nomtree = 1;
+		return check;
 	}
 
 	while(alpm_pkg_mtree_next(pkg, mtree, &entry) == ARCHIVE_OK) {
-		struct stat st;
 		const char *path = archive_entry_pathname(entry);
+		const alpm_list_t *lp;
+		struct file_check *file;
 		char filepath[PATH_MAX];
+		char *warning = NULL;
 		int filepath_len;
-		mode_t type;
-		size_t file_errors = 0;
-		int backup = 0;
-		int exists;
 
 		/* strip leading "./" from path entries */
 		if(path[0] == '.' && path[1] == '/') {
@@ -311,22 +416,163 @@ int check_pkg_full(alpm_pkg_t *pkg)
 					alpm_option_get_dbpath(config->handle),
 					pkgname, alpm_pkg_get_version(pkg), dbfile);
 			if(filepath_len >= PATH_MAX) {
-				pm_printf(ALPM_LOG_WARNING, _("path too long: %slocal/%s-%s/%s\n"),
+				pm_asprintf(&warning, _("path too long: %slocal/%s-%s/%s\n"),
 						alpm_option_get_dbpath(config->handle),
 						pkgname, alpm_pkg_get_version(pkg), dbfile);
-				continue;
 			}
 		} else {
 			filepath_len = snprintf(filepath, PATH_MAX, "%s%s", root, path);
 			if(filepath_len >= PATH_MAX) {
-				pm_printf(ALPM_LOG_WARNING, _("path too long: %s%s\n"), root, path);
-				continue;
+				pm_asprintf(&warning, _("path too long: %s%s\n"), root, path);
+			}
+		}
+
+		if(check->count == size) {
+			size_t newsize = size ? size * 2 : 64;
+			struct file_check *files = realloc(check->files,
+					newsize * sizeof(struct file_check));
+			if(files == NULL) {
+				free(warning);
+				goto error;
+			}
+			check->files = files;
+			size = newsize;
+		}
+
+		file = check->files + check->count++;
+		memset(file, 0, sizeof(struct file_check));
+		file->warning = warning;
+		if(warning) {
+			continue;
+		}
+
+		if((file->filepath = strdup(filepath)) == NULL) {
+			goto error;
+		}
+		file->type = archive_entry_filetype(entry);
+		file->mode = ~AE_IFMT & archive_entry_mode(entry);
+		file->uid = archive_entry_uid(entry);
+		file->gid = archive_entry_gid(entry);
+		file->mtime = archive_entry_mtime(entry);
+		file->size = archive_entry_size(entry);
+		if(file->type == AE_IFLNK) {
+			const char *target = archive_entry_symlink(entry);
+			if((file->symlink = strdup(target ? target : "")) == NULL) {
+				goto error;
+			}
+		}
+#ifdef ARCHIVE_ENTRY_DIGEST_SHA256
+		if(file->type == AE_IFREG && *path != '.') {
+			file->sha256 = entry_sha256(entry);
+			file->stamp = alpm_pkg_get_filestamp(pkg, path);
+		}
+#endif
+
+		/* the following checks are expected to fail if a backup file has been
+		   modified */
+		for(lp = alpm_pkg_get_backup(pkg); lp; lp = lp->next) {
+			alpm_backup_t *bl = lp->data;
+
+			if(strcmp(path, bl->name) == 0) {
+				file->backup = 1;
+				break;
 			}
 		}
+	}
+
+	alpm_pkg_mtree_close(pkg, mtree);
+	check->pending = check->count;
+	return check;
+
+error:
+	alpm_pkg_mtree_close(pkg, mtree);
+	pkg_check_free(check);
+	return NULL;
+}
+
+/* Whether a file may have been changed since its stamp was recorded. */
+static int check_file_stamp_changed(const struct file_check *file)
+{
+	const alpm_filestamp_t *stamp = file->stamp;
+
+	if(stamp == NULL) {
+		/* nothing to go by, only hash when asked to */
+		return config->op_q_full;
+	}
+	return config->op_q_full
+		|| stamp->dev != file->st.st_dev
+		|| stamp->ino != file->st.st_ino
+		|| stamp->size != file->st.st_size
+		|| stamp->mtime != file->st.st_mtime
+		|| stamp->ctime != file->st.st_ctime;
+}
+
+/* Look up a file on disk; this is all the I/O a full check does, and the
+ * only part run by worker threads. */
+static void check_file_lookup(struct file_check *file)
+{
+	if(file->warning) {
+		return;
+	}
+
+	/* use lstat to prevent errors from symlinks */
+	if(llstat(file->filepath, &file->st) != 0) {
+		file->err = errno;
+		return;
+	}
+
+	if(S_ISLNK(file->st.st_mode)) {
+		size_t length = file->st.st_size + 1;
+
+		if((file->link = malloc(length)) == NULL) {
+			return;
+		}
+		if(readlink(file->filepath, file->link, length) != file->st.st_size) {
+			free(file->link);
+			file->link = NULL;
+			return;
+		}
+		file->link[length - 1] = '\0';
+	}
+
+	/* a size mismatch is reported anyway, do not bother hashing then */
+	if(file->sha256 && S_ISREG(file->st.st_mode)
+			&& file->st.st_size == file->size
+			&& check_file_stamp_changed(file)) {
+		file->digest = alpm_compute_sha256sum(file->filepath);
+	}
+}
+
+/* Compare the looked up files of a package against its mtree and print
+ * the results. */
+static int pkg_check_report(struct pkg_check *check, const char *root,
+		size_t rootlen)
+{
+	const char *pkgname = alpm_pkg_get_name(check->pkg);
+	size_t errors = 0;
+	size_t file_count = 0;
+	size_t i;
+
+	if(check->nomtree) {
+		if(!config->quiet) {
+			printf(_("%s: no mtree file\n"), pkgname);
+		}
+		return 0;
+	}
+
+	for(i = 0; i < check->count; i++) {
+		struct file_check *file = check->files + i;
+		size_t file_errors = 0;
+		int exists;
+
+		if(file->warning) {
+			pm_printf(ALPM_LOG_WARNING, "%s", file->warning);
+			continue;
+		}
 
 		file_count++;
 
-		exists = check_file_exists(pkgname, filepath, rootlen, &st);
+		exists = check_file_exists(pkgname, file->filepath, rootlen, file->err);
 		if(exists == 1) {
 			errors++;
 			continue;
@@ -335,55 +581,41 @@ int check_pkg_full(alpm_pkg_t *pkg)
 			continue;
 		}
 
-		type = archive_entry_filetype(entry);
-
-		if(type != AE_IFDIR && type != AE_IFREG && type != AE_IFLNK) {
-			pm_printf(ALPM_LOG_WARNING, _("file type not recognized: %s%s\n"), root, path);
+		if(file->type != AE_IFDIR && file->type != AE_IFREG
+				&& file->type != AE_IFLNK) {
+			pm_printf(ALPM_LOG_WARNING, _("file type not recognized: %s%s\n"),
+					root, file->filepath + rootlen);
 			continue;
 		}
 
-		if(check_file_type(pkgname, filepath, &st, entry) == 1) {
+		if(check_file_type(pkgname, file) == 1) {
 			errors++;
 			continue;
 		}
 
-		file_errors += check_file_permissions(pkgname, filepath, &st, entry);
-
-		if(type == AE_IFLNK) {
-			file_errors += check_file_link(pkgname, filepath, &st, entry);
-		}
-
-		/* the following checks are expected to fail if a backup file has been
-		   modified */
-		for(lp = alpm_pkg_get_backup(pkg); lp; lp = lp->next) {
-			alpm_backup_t *bl = lp->data;
+		file_errors += check_file_permissions(pkgname, file);
 
-			if(strcmp(path, bl->name) == 0) {
-				backup = 1;
-				break;
-			}
+		if(file->type == AE_IFLNK) {
+			file_errors += check_file_link(pkgname, file);
 		}
 
-		if(type != AE_IFDIR) {
+		if(file->type != AE_IFDIR) {
 			/* file or symbolic link */
-			file_errors += check_file_time(pkgname, filepath, &st, entry, backup);
+			file_errors += check_file_time(pkgname, file);
 		}
 
-		if(type == AE_IFREG) {
-			/* TODO: these are expected to be changed with backup files */
-			file_errors += check_file_size(pkgname, filepath, &st, entry, backup);
-			/* file_errors += check_file_md5sum(pkgname, filepath, &st, entry, backup); */
+		if(file->type == AE_IFREG) {
+			file_errors += check_file_size(pkgname, file);
+			file_errors += check_file_sha256sum(pkgname, file);
 		}
 
 		if(config->quiet && file_errors) {
-			printf("%s %s\n", pkgname, filepath);
+			printf("%s %s\n", pkgname, file->filepath);
 		}
 
 		errors += (file_errors != 0 ? 1 : 0);
 	}
 
-	alpm_pkg_mtree_close(pkg, mtree);
-
 	if(!config->quiet) {
 		printf(_n("%s: %jd total file, ", "%s: %jd total files, ",
 					(unsigned long)file_count), pkgname, (intmax_t)file_count);
@@ -394,4 +626,225 @@ int check_pkg_full(alpm_pkg_t *pkg)
 	return (errors != 0 ? 1 : 0);
 }
 
+static void *check_worker(void *data)
+{
+	struct check_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		struct pkg_check *check = NULL;
+		size_t start, count, i;
+
+		/* skip packages whose files have all been handed out */
+		while(pool->dispatch < pool->tail) {
+			check = pool->window[pool->dispatch % pool->size];
+			if(check->next < check->count) {
+				break;
+			}
+			check = NULL;
+			pool->dispatch++;
+		}
+
+		if(check == NULL) {
+			if(pool->quit) {
+				break;
+			}
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+
+		start = check->next;
+		count = check->count - start;
+		if(count > CHECK_CHUNK) {
+			count = CHECK_CHUNK;
+		}
+		check->next += count;
+		pthread_mutex_unlock(&pool->lock);
+
+		for(i = start; i < start + count; i++) {
+			check_file_lookup(check->files + i);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		check->pending -= count;
+		if(check->pending == 0) {
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/* Wait for the oldest queued package and report it. Called, and returns,
+ * with the pool lock held. */
+static int check_pool_report(struct check_pool *pool, const char *root,
+		size_t rootlen)
+{
+	struct pkg_check *check = pool->window[pool->head % pool->size];
+	int ret;
+
+	while(check->pending > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pool->head++;
+	/* never let workers look at a slot that is about to be reused */
+	if(pool->dispatch < pool->head) {
+		pool->dispatch = pool->head;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	ret = pkg_check_report(check, root, rootlen);
+	pkg_check_free(check);
+
+	pthread_mutex_lock(&pool->lock);
+	return ret;
+}
+
+/* Decide how many files may be looked up concurrently. */
+static size_t check_thread_count(void)
+{
+	long cpus;
+
+	if(config->parallelchecks > 0) {
+		return config->parallelchecks;
+	}
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (size_t)cpus : 1;
+}
+
+static int check_pool_start(struct check_pool *pool, size_t nthreads)
+{
+	size_t i;
+
+	memset(pool, 0, sizeof(struct check_pool));
+	pool->size = nthreads * 4;
+	pool->window = calloc(pool->size, sizeof(struct pkg_check *));
+	pool->threads = calloc(nthreads, sizeof(pthread_t));
+	if(pool->window == NULL || pool->threads == NULL) {
+		free(pool->window);
+		free(pool->threads);
+		return -1;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for(i = 0; i < nthreads; i++) {
+		if(pthread_create(&pool->threads[i], NULL, check_worker, pool) != 0) {
+			break;
+		}
+	}
+	pool->nthreads = i;
+	if(i == 0) {
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->work);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->window);
+		free(pool->threads);
+		return -1;
+	}
+	return 0;
+}
+
+static void check_pool_stop(struct check_pool *pool)
+{
+	size_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->window);
+	free(pool->threads);
+}
+
+/* Loop though files in packages and perform full file property checking.
+ * Files are looked up on disk by a pool of threads, while the results are
+ * printed one package at a time in the order the packages were given. */
+int check_pkgs_full(alpm_list_t *pkgs)
+{
+	const char *root;
+	size_t rootlen, nthreads;
+	struct check_pool pool;
+	alpm_list_t *i;
+	int ret = 0;
+
+	root = alpm_option_get_root(config->handle);
+	rootlen = strlen(root);
+	if(rootlen + 1 > PATH_MAX) {
+		/* we are in trouble here */
+		pm_printf(ALPM_LOG_ERROR, _("path too long: %s%s\n"), root, "");
+		return 1;
+	}
+
+	nthreads = check_thread_count();
+	if(nthreads > 1 && check_pool_start(&pool, nthreads) != 0) {
+		nthreads = 1;
+	}
+
+	for(i = pkgs; i; i = alpm_list_next(i)) {
+		/* reading the mtree happens while the workers keep looking up files */
+		struct pkg_check *check = pkg_check_new(i->data, root);
+
+		if(check == NULL) {
+			pm_printf(ALPM_LOG_ERROR, _("memory exhausted\n"));
+			ret = 1;
+			break;
+		}
+
+		if(nthreads == 1) {
+			size_t j;
+			for(j = 0; j < check->count; j++) {
+				check_file_lookup(check->files + j);
+			}
+			ret |= pkg_check_report(check, root, rootlen);
+			pkg_check_free(check);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		while(pool.tail - pool.head == pool.size) {
+			ret |= check_pool_report(&pool, root, rootlen);
+		}
+		pool.window[pool.tail % pool.size] = check;
+		pool.tail++;
+		pthread_cond_broadcast(&pool.work);
+
+		/* print whatever has already been checked */
+		while(pool.head < pool.tail
+				&& pool.window[pool.head % pool.size]->pending == 0) {
+			ret |= check_pool_report(&pool, root, rootlen);
+		}
+		pthread_mutex_unlock(&pool.lock);
+	}
+	if(nthreads > 1) {
+		pthread_mutex_lock(&pool.lock);
+		while(pool.head < pool.tail) {
+			ret |= check_pool_report(&pool, root, rootlen);
+		}
+		pthread_mutex_unlock(&pool.lock);
+		check_pool_stop(&pool);
+	}
+
+	return ret;
+}
+
+/* Perform full file property checking on a single package. */
+int check_pkg_full(alpm_pkg_t *pkg)
+{
+	alpm_list_t pkgs = { pkg, NULL, NULL };
+	pkgs.prev = &pkgs;
+	return check_pkgs_full(&pkgs);
+}
+
 /* vim: set noet: */
@@ -24,6 +24,7 @@
 
 int check_pkg_fast(alpm_pkg_t *pkg);
 int check_pkg_full(alpm_pkg_t *pkg);
+int check_pkgs_full(alpm_list_t *pkgs);
 
 #endif /* _PM_CHECK_H */
 
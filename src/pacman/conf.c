@@ -105,6 +105,12 @@ config_t *config_new(void)
 	newconfig->logmask = ALPM_LOG_ERROR | ALPM_LOG_WARNING;
 	newconfig->configfile = strdup(CONFFILE);
 	newconfig->deltaratio = 0.0;
+#ifdef HAVE_SYNCFS
+	newconfig->durability = ALPM_DURABILITY_TRANSACTION;
+#else
+	newconfig->durability = ALPM_DURABILITY_NONE;
+#endif
+	newconfig->progressinterval = 200;
 	if(alpm_capabilities() & ALPM_CAPABILITY_SIGNATURES) {
 		newconfig->siglevel = ALPM_SIG_PACKAGE | ALPM_SIG_PACKAGE_OPTIONAL |
 			ALPM_SIG_DATABASE | ALPM_SIG_DATABASE_OPTIONAL;
@@ -148,8 +154,10 @@ int config_free(config_t *oldconfig)
 	free(oldconfig->dbpath);
 	free(oldconfig->logfile);
 	free(oldconfig->gpgdir);
+	free(oldconfig->storedir);
 	FREELIST(oldconfig->hookdirs);
 	FREELIST(oldconfig->cachedirs);
+	FREELIST(oldconfig->cachepeers);
 	free(oldconfig->xfercommand);
 	free(oldconfig->print_format);
 	free(oldconfig->arch);
@@ -494,6 +502,15 @@ static int _parse_options(const char *key, char *value,
 			pm_printf(ALPM_LOG_DEBUG, "config: totaldownload\n");
 		} else if(strcmp(key, "CheckSpace") == 0) {
 			config->checkspace = 1;
+		} else if(strcmp(key, "FileStamps") == 0) {
+			config->filestamps = 1;
+			pm_printf(ALPM_LOG_DEBUG, "config: filestamps\n");
+		} else if(strcmp(key, "ScoreMirrors") == 0) {
+			config->scoremirrors = 1;
+			pm_printf(ALPM_LOG_DEBUG, "config: scoremirrors\n");
+		} else if(strcmp(key, "HashedCache") == 0) {
+			config->hashedcache = 1;
+			pm_printf(ALPM_LOG_DEBUG, "config: hashedcache\n");
 		} else if(strcmp(key, "Color") == 0) {
 			if(config->color == PM_COLOR_UNSET) {
 				config->color = isatty(fileno(stdout)) ? PM_COLOR_ON : PM_COLOR_OFF;
@@ -518,6 +535,8 @@ static int _parse_options(const char *key, char *value,
 			setrepeatingoption(value, "HoldPkg", &(config->holdpkg));
 		} else if(strcmp(key, "CacheDir") == 0) {
 			setrepeatingoption(value, "CacheDir", &(config->cachedirs));
+		} else if(strcmp(key, "CachePeer") == 0) {
+			setrepeatingoption(value, "CachePeer", &(config->cachepeers));
 		} else if(strcmp(key, "HookDir") == 0) {
 			setrepeatingoption(value, "HookDir", &(config->hookdirs));
 		} else if(strcmp(key, "Architecture") == 0) {
@@ -544,6 +563,59 @@ static int _parse_options(const char *key, char *value,
 			}
 			config->deltaratio = ratio;
 			pm_printf(ALPM_LOG_DEBUG, "config: usedelta = %f\n", ratio);
+		} else if(strcmp(key, "Durability") == 0) {
+			if(strcmp(value, "None") == 0) {
+				config->durability = ALPM_DURABILITY_NONE;
+			} else if(strcmp(value, "Transaction") == 0) {
+				config->durability = ALPM_DURABILITY_TRANSACTION;
+			} else if(strcmp(value, "Package") == 0) {
+				config->durability = ALPM_DURABILITY_PACKAGE;
+			} else {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "Durability", value);
+				return 1;
+			}
+			pm_printf(ALPM_LOG_DEBUG, "config: durability: %s\n", value);
+		} else if(strcmp(key, "ParallelChecks") == 0) {
+			long checks;
+			char *endptr;
+
+			checks = strtol(value, &endptr, 10);
+			if(*endptr != '\0' || checks < 1 || checks > 256) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "ParallelChecks", value);
+				return 1;
+			}
+			config->parallelchecks = checks;
+			pm_printf(ALPM_LOG_DEBUG, "config: parallelchecks: %ld\n", checks);
+		} else if(strcmp(key, "DownloadSegments") == 0) {
+			long segments;
+			char *endptr;
+
+			segments = strtol(value, &endptr, 10);
+			if(*endptr != '\0' || segments < 1 || segments > 16) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "DownloadSegments", value);
+				return 1;
+			}
+			config->dlsegments = segments;
+			pm_printf(ALPM_LOG_DEBUG, "config: dlsegments: %ld\n", segments);
+		} else if(strcmp(key, "ProgressInterval") == 0) {
+			long msecs;
+			char *endptr;
+
+			msecs = strtol(value, &endptr, 10);
+			if(*endptr != '\0' || msecs < 0 || msecs > 10000) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "ProgressInterval", value);
+				return 1;
+			}
+			config->progressinterval = msecs;
+			pm_printf(ALPM_LOG_DEBUG, "config: progressinterval: %ld\n", msecs);
 		} else if(strcmp(key, "DBPath") == 0) {
 			/* don't overwrite a path specified on the command line */
 			if(!config->dbpath) {
@@ -561,6 +633,10 @@ static int _parse_options(const char *key, char *value,
 				config->gpgdir = strdup(value);
 				pm_printf(ALPM_LOG_DEBUG, "config: gpgdir: %s\n", value);
 			}
+		} else if(strcmp(key, "StoreDir") == 0) {
+			free(config->storedir);
+			config->storedir = strdup(value);
+			pm_printf(ALPM_LOG_DEBUG, "config: storedir: %s\n", value);
 		} else if(strcmp(key, "LogFile") == 0) {
 			if(!config->logfile) {
 				config->logfile = strdup(value);
@@ -729,7 +805,7 @@ static int setup_libalpm(void)
 	config->handle = handle;
 
 	alpm_option_set_logcb(handle, cb_log);
-	alpm_option_set_dlcb(handle, cb_dl_progress);
+	alpm_option_set_dlprogresscb(handle, cb_dl_progress);
 	alpm_option_set_eventcb(handle, cb_event);
 	alpm_option_set_questioncb(handle, cb_question);
 	alpm_option_set_progresscb(handle, cb_progress);
@@ -756,6 +832,15 @@ static int setup_libalpm(void)
 		return ret;
 	}
 
+	if(config->storedir) {
+		ret = alpm_option_set_storedir(handle, config->storedir);
+		if(ret != 0) {
+			pm_printf(ALPM_LOG_ERROR, _("problem setting storedir '%s' (%s)\n"),
+					config->storedir, alpm_strerror(alpm_errno(handle)));
+			return ret;
+		}
+	}
+
 	/* Set user hook directory. This is not relative to rootdir, even if
 	 * rootdir is defined. Reasoning: hookdir contains configuration data. */
 	if(config->hookdirs == NULL) {
@@ -782,6 +867,8 @@ static int setup_libalpm(void)
 		alpm_option_set_cachedirs(handle, config->cachedirs);
 	}
 
+	alpm_option_set_cachepeers(handle, config->cachepeers);
+
 	alpm_option_set_default_siglevel(handle, config->siglevel);
 
 	config->localfilesiglevel = merge_siglevel(config->siglevel,
@@ -808,6 +895,14 @@ static int setup_libalpm(void)
 
 	alpm_option_set_arch(handle, config->arch);
 	alpm_option_set_checkspace(handle, config->checkspace);
+	alpm_option_set_filestamps(handle, config->filestamps);
+	alpm_option_set_scoremirrors(handle, config->scoremirrors);
+	if(config->dlsegments > 0) {
+		alpm_option_set_dlsegments(handle, config->dlsegments);
+	}
+	alpm_option_set_hashedcache(handle, config->hashedcache);
+	alpm_option_set_progressinterval(handle, config->progressinterval);
+	alpm_option_set_durability(handle, config->durability);
 	alpm_option_set_usesyslog(handle, config->usesyslog);
 	alpm_option_set_deltaratio(handle, config->deltaratio);
 
@@ -53,9 +53,16 @@ typedef struct __config_t {
 	unsigned short logmask;
 	unsigned short print;
 	unsigned short checkspace;
+	unsigned short filestamps;
+	unsigned short scoremirrors;
+	unsigned short hashedcache;
 	unsigned short usesyslog;
 	unsigned short color;
 	double deltaratio;
+	alpm_durability_t durability;
+	unsigned int parallelchecks;
+	unsigned int dlsegments;
+	unsigned int progressinterval;
 	char *arch;
 	char *print_format;
 	/* unfortunately, we have to keep track of paths both here and in the library
@@ -66,8 +73,10 @@ typedef struct __config_t {
 	char *dbpath;
 	char *logfile;
 	char *gpgdir;
+	char *storedir;
 	alpm_list_t *hookdirs;
 	alpm_list_t *cachedirs;
+	alpm_list_t *cachepeers;
 
 	unsigned short op_q_isfile;
 	unsigned short op_q_info;
@@ -80,6 +89,7 @@ typedef struct __config_t {
 	unsigned short op_q_changelog;
 	unsigned short op_q_upgrade;
 	unsigned short op_q_check;
+	unsigned short op_q_full;
 	unsigned short op_q_locality;
 
 	unsigned short op_s_clean;
@@ -90,8 +100,8 @@ typedef struct __config_t {
 	unsigned short op_s_upgrade;
 
 	unsigned short op_f_regex;
-	unsigned short op_f_machinereadable;
 
+	unsigned short machinereadable;
 	unsigned short group;
 	unsigned short noask;
 	unsigned int ask;
@@ -181,6 +191,7 @@ enum {
 	OP_HELP,
 	OP_INFO,
 	OP_CHECK,
+	OP_FULL,
 	OP_LIST,
 	OP_FOREIGN,
 	OP_NATIVE,
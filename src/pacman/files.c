@@ -27,28 +27,6 @@
 #include "conf.h"
 #include "package.h"
 
-static void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, char *filename)
-{
-	/* Fields are repo, pkgname, pkgver, filename separated with \0 */
-	fputs(alpm_db_get_name(db), stdout);
-	fputc(0, stdout);
-	fputs(alpm_pkg_get_name(pkg), stdout);
-	fputc(0, stdout);
-	fputs(alpm_pkg_get_version(pkg), stdout);
-	fputc(0, stdout);
-	fputs(filename, stdout);
-	fputs("\n", stdout);
-}
-
-static void dump_pkg_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg)
-{
-	alpm_filelist_t *pkgfiles = alpm_pkg_get_files(pkg);
-	for(size_t filenum = 0; filenum < pkgfiles->count; filenum++) {
-		const alpm_file_t *file = pkgfiles->files + filenum;
-		print_line_machinereadable(db, pkg, file->name);
-	}
-}
-
 static int files_fileowner(alpm_list_t *syncs, alpm_list_t *targets) {
 	int ret = 0;
 	alpm_list_t *t;
@@ -74,7 +52,7 @@ static int files_fileowner(alpm_list_t *syncs, alpm_list_t *targets) {
 				alpm_filelist_t *files = alpm_pkg_get_files(pkg);
 
 				if(alpm_filelist_contains(files, filename)) {
-					if(config->op_f_machinereadable) {
+					if(config->machinereadable) {
 						print_line_machinereadable(repo, pkg, filename);
 					} else if(!config->quiet) {
 						const colstr_t *colstr = &config->colstr;
@@ -147,7 +125,7 @@ static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 				}
 
 				if(match != NULL) {
-					if(config->op_f_machinereadable) {
+					if(config->machinereadable) {
 						alpm_list_t *ml;
 						for(ml = match; ml; ml = alpm_list_next(ml)) {
 							char *filename = ml->data;
@@ -241,7 +219,7 @@ static int files_list(alpm_list_t *syncs, alpm_list_t *targets) {
 
 				if((pkg = alpm_db_get_pkg(db, targ)) != NULL) {
 					found = 1;
-					if(config->op_f_machinereadable) {
+					if(config->machinereadable) {
 						dump_pkg_machinereadable(db, pkg);
 					} else {
 						dump_file_list(pkg);
@@ -263,7 +241,7 @@ static int files_list(alpm_list_t *syncs, alpm_list_t *targets) {
 
 			for(j = alpm_db_get_pkgcache(db); j; j = alpm_list_next(j)) {
 				alpm_pkg_t *pkg = j->data;
-				if(config->op_f_machinereadable) {
+				if(config->machinereadable) {
 					dump_pkg_machinereadable(db, pkg);
 				} else {
 					dump_file_list(pkg);
@@ -182,6 +182,177 @@ static void optdeplist_display(alpm_pkg_t *pkg, unsigned short cols)
 	FREELIST(text);
 }
 
+/* Machine readable output writes each record straight from libalpm, without
+ * formatting or allocating: fields are separated with \0 and records end
+ * with \n. */
+
+static void print_pkg_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	/* packages read from a file belong to no repository */
+	fputs(db ? alpm_db_get_name(db) : "", stdout);
+	fputc(0, stdout);
+	fputs(alpm_pkg_get_name(pkg), stdout);
+	fputc(0, stdout);
+	fputs(alpm_pkg_get_version(pkg), stdout);
+}
+
+void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, const char *value)
+{
+	/* Fields are repo, pkgname, pkgver and an optional value */
+	print_pkg_machinereadable(db, pkg);
+	if(value) {
+		fputc(0, stdout);
+		fputs(value, stdout);
+	}
+	fputc('\n', stdout);
+}
+
+void dump_pkg_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	alpm_filelist_t *pkgfiles = alpm_pkg_get_files(pkg);
+	for(size_t filenum = 0; filenum < pkgfiles->count; filenum++) {
+		const alpm_file_t *file = pkgfiles->files + filenum;
+		print_line_machinereadable(db, pkg, file->name);
+	}
+}
+
+static void print_key_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg,
+		const char *key)
+{
+	print_pkg_machinereadable(db, pkg);
+	fputc(0, stdout);
+	fputs(key, stdout);
+	fputc(0, stdout);
+}
+
+static void string_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg,
+		const char *key, const char *value)
+{
+	if(value) {
+		print_key_machinereadable(db, pkg, key);
+		fputs(value, stdout);
+		fputc('\n', stdout);
+	}
+}
+
+static void number_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg,
+		const char *key, long long value)
+{
+	print_key_machinereadable(db, pkg, key);
+	printf("%lld\n", value);
+}
+
+static void list_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg,
+		const char *key, alpm_list_t *list)
+{
+	for(; list; list = alpm_list_next(list)) {
+		string_machinereadable(db, pkg, key, list->data);
+	}
+}
+
+static void deplist_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg,
+		const char *key, alpm_list_t *deps)
+{
+	for(; deps; deps = alpm_list_next(deps)) {
+		const alpm_depend_t *dep = deps->data;
+
+		print_key_machinereadable(db, pkg, key);
+		/* the same form alpm_dep_compute_string() gives */
+		fputs(dep->name, stdout);
+		if(dep->version) {
+			switch(dep->mod) {
+				case ALPM_DEP_MOD_EQ:
+					fputc('=', stdout);
+					break;
+				case ALPM_DEP_MOD_GE:
+					fputs(">=", stdout);
+					break;
+				case ALPM_DEP_MOD_LE:
+					fputs("<=", stdout);
+					break;
+				case ALPM_DEP_MOD_GT:
+					fputc('>', stdout);
+					break;
+				case ALPM_DEP_MOD_LT:
+					fputc('<', stdout);
+					break;
+				default:
+					break;
+			}
+			if(dep->mod != ALPM_DEP_MOD_ANY) {
+				fputs(dep->version, stdout);
+			}
+		}
+		if(dep->desc) {
+			fputs(": ", stdout);
+			fputs(dep->desc, stdout);
+		}
+		fputc('\n', stdout);
+	}
+}
+
+/** Display the details of a package one field per line.
+ * Keys follow the field names of the package databases; sizes are in
+ * bytes and dates in seconds since the epoch.
+ * @param pkg the package to display
+ * @param extra also compute the packages requiring this one, and show
+ * checksums of sync packages and backup files of installed ones
+ */
+static void dump_pkg_full_machinereadable(alpm_pkg_t *pkg, int extra)
+{
+	alpm_db_t *db = alpm_pkg_get_db(pkg);
+	alpm_pkgfrom_t from = alpm_pkg_get_origin(pkg);
+
+	string_machinereadable(db, pkg, "base", alpm_pkg_get_base(pkg));
+	string_machinereadable(db, pkg, "desc", alpm_pkg_get_desc(pkg));
+	string_machinereadable(db, pkg, "arch", alpm_pkg_get_arch(pkg));
+	string_machinereadable(db, pkg, "url", alpm_pkg_get_url(pkg));
+	list_machinereadable(db, pkg, "license", alpm_pkg_get_licenses(pkg));
+	list_machinereadable(db, pkg, "groups", alpm_pkg_get_groups(pkg));
+	deplist_machinereadable(db, pkg, "provides", alpm_pkg_get_provides(pkg));
+	deplist_machinereadable(db, pkg, "depends", alpm_pkg_get_depends(pkg));
+	deplist_machinereadable(db, pkg, "optdepends", alpm_pkg_get_optdepends(pkg));
+	if(extra) {
+		alpm_list_t *requiredby = alpm_pkg_compute_requiredby(pkg);
+		alpm_list_t *optionalfor = alpm_pkg_compute_optionalfor(pkg);
+		list_machinereadable(db, pkg, "requiredby", requiredby);
+		list_machinereadable(db, pkg, "optionalfor", optionalfor);
+		FREELIST(requiredby);
+		FREELIST(optionalfor);
+	}
+	deplist_machinereadable(db, pkg, "conflicts", alpm_pkg_get_conflicts(pkg));
+	deplist_machinereadable(db, pkg, "replaces", alpm_pkg_get_replaces(pkg));
+
+	if(from != ALPM_PKG_FROM_LOCALDB) {
+		number_machinereadable(db, pkg, "csize", (long long)alpm_pkg_get_size(pkg));
+	}
+	number_machinereadable(db, pkg, "isize", (long long)alpm_pkg_get_isize(pkg));
+	string_machinereadable(db, pkg, "packager", alpm_pkg_get_packager(pkg));
+	number_machinereadable(db, pkg, "builddate",
+			(long long)alpm_pkg_get_builddate(pkg));
+	if(from == ALPM_PKG_FROM_LOCALDB) {
+		number_machinereadable(db, pkg, "installdate",
+				(long long)alpm_pkg_get_installdate(pkg));
+		string_machinereadable(db, pkg, "reason",
+				alpm_pkg_get_reason(pkg) == ALPM_PKG_REASON_DEPEND
+				? "dependency" : "explicit");
+	}
+	if(from == ALPM_PKG_FROM_SYNCDB) {
+		string_machinereadable(db, pkg, "filename", alpm_pkg_get_filename(pkg));
+		if(extra) {
+			string_machinereadable(db, pkg, "md5sum", alpm_pkg_get_md5sum(pkg));
+			string_machinereadable(db, pkg, "sha256sum", alpm_pkg_get_sha256sum(pkg));
+		}
+	}
+	if(from == ALPM_PKG_FROM_LOCALDB && extra) {
+		alpm_list_t *i;
+		for(i = alpm_pkg_get_backup(pkg); i; i = alpm_list_next(i)) {
+			const alpm_backup_t *backup = i->data;
+			string_machinereadable(db, pkg, "backup", backup->name);
+		}
+	}
+}
+
 /**
  * Display the details of a package.
  * Extra information entails 'required by' info for sync packages and backup
@@ -199,6 +370,11 @@ void dump_pkg_full(alpm_pkg_t *pkg, int extra)
 	const char *label, *reason;
 	alpm_list_t *validation = NULL, *requiredby = NULL, *optionalfor = NULL;
 
+	if(config->machinereadable) {
+		dump_pkg_full_machinereadable(pkg, extra);
+		return;
+	}
+
 	/* make aligned titles once only */
 	static int need_alignment = 1;
 	if(need_alignment) {
@@ -432,6 +608,11 @@ void dump_pkg_files(alpm_pkg_t *pkg, int quiet)
 	alpm_filelist_t *pkgfiles;
 	size_t i;
 
+	if(config->machinereadable) {
+		dump_pkg_machinereadable(alpm_pkg_get_db(pkg), pkg);
+		return;
+	}
+
 	pkgname = alpm_pkg_get_name(pkg);
 	pkgfiles = alpm_pkg_get_files(pkg);
 	root = alpm_option_get_root(config->handle);
@@ -529,6 +710,11 @@ int dump_pkg_search(alpm_db_t *db, alpm_list_t *targets, int show_status)
 		alpm_list_t *grp;
 		alpm_pkg_t *pkg = i->data;
 
+		if(config->machinereadable) {
+			print_line_machinereadable(db, pkg, NULL);
+			continue;
+		}
+
 		if(config->quiet) {
 			fputs(alpm_pkg_get_name(pkg), stdout);
 		} else {
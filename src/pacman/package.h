@@ -31,6 +31,9 @@ void dump_pkg_changelog(alpm_pkg_t *pkg);
 void print_installed(alpm_db_t *db_local, alpm_pkg_t *pkg);
 int dump_pkg_search(alpm_db_t *db, alpm_list_t *targets, int show_status);
 
+void print_line_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg, const char *value);
+void dump_pkg_machinereadable(alpm_db_t *db, alpm_pkg_t *pkg);
+
 #endif /* _PM_PACKAGE_H */
 
 /* vim: set noet: */
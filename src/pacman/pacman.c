@@ -140,6 +140,7 @@ static void usage(int op, const char * const myname)
 			addlist(_("  -g, --groups         view all members of a package group\n"));
 			addlist(_("  -i, --info           view package information (-ii for backup files)\n"));
 			addlist(_("  -k, --check          check that package files exist (-kk for file properties)\n"));
+			addlist(_("      --full           with -kk, verify the checksums of all files\n"));
 			addlist(_("  -l, --list           list the files owned by the queried package\n"));
 			addlist(_("  -m, --foreign        list installed packages not found in sync db(s) [filter]\n"));
 			addlist(_("  -n, --native         list installed packages only found in sync db(s) [filter]\n"));
@@ -150,6 +151,8 @@ static void usage(int op, const char * const myname)
 			addlist(_("  -t, --unrequired     list packages not (optionally) required by any\n"
 			          "                       package (-tt to ignore optdepends) [filter]\n"));
 			addlist(_("  -u, --upgrades       list outdated packages [filter]\n"));
+			addlist(_("      --machinereadable\n"
+			          "                       produce machine-readable output\n"));
 		} else if(op == PM_OP_SYNC) {
 			printf("%s:  %s {-S --sync} [%s] [%s]\n", str_usg, myname, str_opt, str_pkg);
 			printf("%s:\n", str_opt);
@@ -165,6 +168,8 @@ static void usage(int op, const char * const myname)
 			addlist(_("  -y, --refresh        download fresh package databases from the server\n"
 			          "                       (-yy to force a refresh even if up to date)\n"));
 			addlist(_("      --needed         do not reinstall up to date packages\n"));
+			addlist(_("      --machinereadable\n"
+			          "                       produce machine-readable output\n"));
 		} else if(op == PM_OP_DATABASE) {
 			printf("%s:  %s {-D --database} <%s> <%s>\n", str_usg, myname, str_opt, str_pkg);
 			printf("%s:\n", str_opt);
@@ -281,6 +286,15 @@ static void cleanup(int ret)
 {
 	remove_soft_interrupt_handler();
 	if(config) {
+		if(config->handle) {
+			const alpm_dload_stats_t *stats = alpm_dload_stats(config->handle);
+			if(stats && stats->transfers) {
+				pm_printf(ALPM_LOG_DEBUG, "downloads: %lu transfers, "
+						"%lu connections opened, %lu reused a connection\n",
+						stats->transfers, stats->connects, stats->reused);
+			}
+		}
+
 		/* free alpm library resources */
 		if(config->handle && alpm_release(config->handle) == -1) {
 			pm_printf(ALPM_LOG_ERROR, "error releasing alpm library\n");
@@ -513,6 +527,9 @@ static int parsearg_query(int opt)
 		case 'k':
 			(config->op_q_check)++;
 			break;
+		case OP_FULL:
+			config->op_q_full = 1;
+			break;
 		case OP_LIST:
 		case 'l':
 			config->op_q_list = 1;
@@ -549,6 +566,9 @@ static int parsearg_query(int opt)
 		case 'u':
 			config->op_q_upgrade = 1;
 			break;
+		case OP_MACHINEREADABLE:
+			config->machinereadable = 1;
+			break;
 		default:
 			return 1;
 	}
@@ -590,6 +610,11 @@ static void checkargs_query(void)
 		checkargs_query_display_opts("--groups");
 	}
 
+	if(config->machinereadable) {
+		invalid_opt(config->group, "--machinereadable", "--groups");
+		invalid_opt(config->op_q_changelog, "--machinereadable", "--changelog");
+		invalid_opt(config->op_q_check, "--machinereadable", "--check");
+	}
 	invalid_opt(config->op_q_deps && config->op_q_explicit, "--deps", "--explicit");
 	invalid_opt((config->op_q_locality & PKG_LOCALITY_NATIVE) &&
 				 (config->op_q_locality & PKG_LOCALITY_FOREIGN),
@@ -753,7 +778,7 @@ static int parsearg_files(int opt)
 			config->op_f_regex = 1;
 			break;
 		case OP_MACHINEREADABLE:
-			config->op_f_machinereadable = 1;
+			config->machinereadable = 1;
 			break;
 		case OP_QUIET:
 		case 'q':
@@ -821,6 +846,9 @@ static int parsearg_sync(int opt)
 		case 'y':
 			(config->op_s_sync)++;
 			break;
+		case OP_MACHINEREADABLE:
+			config->machinereadable = 1;
+			break;
 		default:
 			return 1;
 	}
@@ -857,6 +885,14 @@ static void checkargs_sync(void)
 		invalid_opt(config->op_s_upgrade, "--groups", "--sysupgrade");
 		invalid_opt(config->op_s_downloadonly, "--groups", "--downloadonly");
 	}
+	if(config->machinereadable && !config->op_s_info
+			&& !config->op_s_search && !config->op_q_list) {
+		/* only the display operations have a machine readable format */
+		pm_printf(ALPM_LOG_ERROR,
+				_("invalid option: '%s' requires '%s', '%s' or '%s'\n"),
+				"--machinereadable", "--info", "--list", "--search");
+		cleanup(1);
+	}
 }
 
 /** Parse command-line arguments for each operation.
@@ -892,6 +928,7 @@ static int parseargs(int argc, char *argv[])
 		{"groups",     no_argument,       0, OP_GROUPS},
 		{"info",       no_argument,       0, OP_INFO},
 		{"check",      no_argument,       0, OP_CHECK},
+		{"full",       no_argument,       0, OP_FULL},
 		{"list",       no_argument,       0, OP_LIST},
 		{"foreign",    no_argument,       0, OP_FOREIGN},
 		{"native",     no_argument,       0, OP_NATIVE},
@@ -1135,6 +1172,12 @@ int main(int argc, char *argv[])
 		cleanup(ret);
 	}
 
+	if(config->machinereadable && !config->op_s_sync) {
+		/* output for other programs is written in large blocks, even to a
+		 * terminal; a refresh first shows its progress as usual */
+		setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+	}
+
 	/* we support reading targets from stdin if a cmdline parameter is '-' */
 	if(alpm_list_find_str(pm_targets, "-")) {
 		if(!isatty(fileno(stdin))) {
@@ -1233,6 +1276,13 @@ int main(int argc, char *argv[])
 			printf("%s  ", (const char *)j->data);
 		}
 		printf("\n");
+		if(alpm_option_get_cachepeers(config->handle)) {
+			printf("Cache Peers: ");
+			for(j = alpm_option_get_cachepeers(config->handle); j; j = alpm_list_next(j)) {
+				printf("%s  ", (const char *)j->data);
+			}
+			printf("\n");
+		}
 		printf("Hook Dirs : ");
 		for(j = alpm_option_get_hookdirs(config->handle); j; j = alpm_list_next(j)) {
 			printf("%s  ", (const char *)j->data);
@@ -82,7 +82,9 @@ static int search_path(char **filename, struct stat *bufptr)
 
 static void print_query_fileowner(const char *filename, alpm_pkg_t *info)
 {
-	if(!config->quiet) {
+	if(config->machinereadable) {
+		print_line_machinereadable(alpm_pkg_get_db(info), info, filename);
+	} else if(!config->quiet) {
 		const colstr_t *colstr = &config->colstr;
 		printf(_("%s is owned by %s%s %s%s\n"), filename, colstr->title,
 				alpm_pkg_get_name(info), colstr->version, alpm_pkg_get_version(info));
@@ -317,7 +319,15 @@ static int display(alpm_pkg_t *pkg)
 	}
 	if(!config->op_q_info && !config->op_q_list
 			&& !config->op_q_changelog && !config->op_q_check) {
-		if(!config->quiet) {
+		if(config->machinereadable) {
+			/* outdated packages get the newer version as a fourth field */
+			const char *newver = NULL;
+			if(config->op_q_upgrade) {
+				newver = alpm_pkg_get_version(alpm_sync_newversion(pkg,
+							alpm_get_syncdbs(config->handle)));
+			}
+			print_line_machinereadable(alpm_pkg_get_db(pkg), pkg, newver);
+		} else if(!config->quiet) {
 			const colstr_t *colstr = &config->colstr;
 			printf("%s%s %s%s%s", colstr->title, alpm_pkg_get_name(pkg),
 					colstr->version, alpm_pkg_get_version(pkg), colstr->nocolor);
@@ -425,6 +435,21 @@ int pacman_query(alpm_list_t *targets)
 			return 1;
 		}
 
+		/* a full check is the slow part of -Qkk; hand every package to the
+		 * checker at once so files can be looked up in parallel */
+		if(config->op_q_check > 1 && !config->op_q_info && !config->op_q_list
+				&& !config->op_q_changelog) {
+			alpm_list_t *pkgs = NULL;
+			for(i = alpm_db_get_pkgcache(db_local); i; i = alpm_list_next(i)) {
+				if(filter(i->data)) {
+					pkgs = alpm_list_add(pkgs, i->data);
+				}
+			}
+			ret = pkgs ? check_pkgs_full(pkgs) : 1;
+			alpm_list_free(pkgs);
+			return ret;
+		}
+
 		for(i = alpm_db_get_pkgcache(db_local); i; i = alpm_list_next(i)) {
 			pkg = i->data;
 			if(filter(pkg)) {
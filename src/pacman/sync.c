@@ -27,6 +27,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <fnmatch.h>
+#include <pthread.h>
 
 #ifdef __MSYS__
 #include <termios.h>
@@ -156,12 +157,234 @@ static int sync_cleandb_all(void)
 	return ret;
 }
 
+/** Decide whether a cached package survives cleaning.
+ * @param name name of the package
+ * @param version version of the package
+ * @return 0 to remove it, 1 to keep it
+ */
+static int keep_cached_version(const char *name, const char *version)
+{
+	alpm_pkg_t *pkg;
+
+	if(config->cleanmethod & PM_CLEAN_KEEPINST) {
+		/* check if this package is in the local DB */
+		pkg = alpm_db_get_pkg(alpm_get_localdb(config->handle), name);
+		if(pkg != NULL && alpm_pkg_vercmp(version,
+					alpm_pkg_get_version(pkg)) == 0) {
+			/* package was found in local DB and version matches, keep it */
+			pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in local db\n",
+					name, version);
+			return 1;
+		}
+	}
+	if(config->cleanmethod & PM_CLEAN_KEEPCUR) {
+		alpm_list_t *j;
+		/* check if this package is in a sync DB */
+		for(j = alpm_get_syncdbs(config->handle); j; j = alpm_list_next(j)) {
+			pkg = alpm_db_get_pkg(j->data, name);
+			if(pkg != NULL && alpm_pkg_vercmp(version,
+						alpm_pkg_get_version(pkg)) == 0) {
+				/* package was found in a sync DB and version matches, keep it */
+				pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in sync db\n",
+						name, version);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/** Decide whether a cached package file survives cleaning.
+ * @param file the cached file
+ * @return 0 to remove it, 1 to keep it, -1 if it is no package
+ */
+static int keep_cached_pkg(const alpm_cachefile_t *file)
+{
+	alpm_pkg_t *localpkg = NULL;
+	int keep;
+
+	/* the file name tells name and version of well named packages */
+	if(file->name && file->version) {
+		return keep_cached_version(file->name, file->version);
+	}
+
+	/* attempt to load the file as a package. if we cannot load the file,
+	 * simply skip it and move on. we don't need a full load of the package,
+	 * just the metadata. */
+	if(alpm_pkg_load(config->handle, file->path, 0, 0, &localpkg) != 0) {
+		pm_printf(ALPM_LOG_DEBUG, "skipping %s, could not load as package\n",
+				file->path);
+		return -1;
+	}
+	keep = keep_cached_version(alpm_pkg_get_name(localpkg),
+			alpm_pkg_get_version(localpkg));
+	/* free the local file package */
+	alpm_pkg_free(localpkg);
+
+	return keep;
+}
+
+struct cache_unlink {
+	char *path;
+	int ignore_missing;
+	int err;
+};
+
+/* Files queued for removal; they are unlinked by several threads at once as
+ * a large cache spends most of its cleaning time waiting on the filesystem. */
+struct unlink_batch {
+	struct cache_unlink *files;
+	size_t count;
+	size_t size;
+};
+
+struct unlink_worker {
+	struct unlink_batch *batch;
+	size_t first;
+	size_t step;
+};
+
+static int unlink_batch_add(struct unlink_batch *batch, const char *path,
+		int ignore_missing)
+{
+	struct cache_unlink *file;
+
+	if(batch->count == batch->size) {
+		size_t size = batch->size ? batch->size * 2 : 64;
+		struct cache_unlink *files = realloc(batch->files,
+				size * sizeof(struct cache_unlink));
+		if(files == NULL) {
+			return -1;
+		}
+		batch->files = files;
+		batch->size = size;
+	}
+	file = &batch->files[batch->count];
+	if((file->path = strdup(path)) == NULL) {
+		return -1;
+	}
+	file->ignore_missing = ignore_missing;
+	file->err = 0;
+	batch->count++;
+	return 0;
+}
+
+static void *unlink_worker(void *arg)
+{
+	struct unlink_worker *worker = arg;
+	size_t i;
+
+	for(i = worker->first; i < worker->batch->count; i += worker->step) {
+		struct cache_unlink *file = &worker->batch->files[i];
+		if(unlink(file->path) != 0
+				&& !(file->ignore_missing && errno == ENOENT)) {
+			file->err = errno;
+		}
+	}
+	return NULL;
+}
+
+/** Unlink all queued files and empty the batch.
+ * Errors are reported in the order the files were queued.
+ * @return the number of files that could not be removed
+ */
+static int unlink_batch_run(struct unlink_batch *batch)
+{
+	struct unlink_worker workers[8];
+	pthread_t threads[8];
+	size_t i, nthreads, started = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int ret = 0;
+
+	/* a thread per 32 files keeps small batches from paying for startup */
+	nthreads = batch->count / 32 + 1;
+	if(cpus > 0 && nthreads > (size_t)cpus) {
+		nthreads = cpus;
+	}
+	if(nthreads > ARRAYSIZE(threads)) {
+		nthreads = ARRAYSIZE(threads);
+	}
+
+	for(i = 0; i < nthreads; i++) {
+		workers[i].batch = batch;
+		workers[i].first = i;
+		workers[i].step = nthreads;
+	}
+	/* the calling thread takes the first share and any a thread failed for */
+	for(i = 1; i < nthreads; i++) {
+		if(pthread_create(&threads[i], NULL, unlink_worker, &workers[i]) != 0) {
+			break;
+		}
+		started = i;
+	}
+	for(i = started + 1; i <= nthreads; i++) {
+		unlink_worker(&workers[i % nthreads]);
+	}
+	for(i = 1; i <= started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for(i = 0; i < batch->count; i++) {
+		struct cache_unlink *file = &batch->files[i];
+		if(file->err) {
+			pm_printf(ALPM_LOG_ERROR, _("could not remove %s: %s\n"),
+					file->path, strerror(file->err));
+			ret++;
+		}
+		free(file->path);
+	}
+	batch->count = 0;
+	return ret;
+}
+
+/** Clean a cache directory from its list of package files.
+ * Name and version of most files are known from their names, so only oddly
+ * named files have to be opened.
+ */
+static int sync_cleancache_files(const char *cachedir, int level,
+		struct unlink_batch *batch)
+{
+	alpm_list_t *i, *remove = NULL;
+	int ret = 0;
+
+	for(i = alpm_cache_get_files(config->handle, cachedir); i; i = alpm_list_next(i)) {
+		alpm_cachefile_t *file = i->data;
+
+		if(level <= 1 && keep_cached_pkg(file) != 0) {
+			continue;
+		}
+		if(file->hashed) {
+			remove = alpm_list_add(remove, file->filename);
+		} else if(level <= 1) {
+			char sigpath[PATH_MAX];
+
+			/* unlink a signature file if present too */
+			snprintf(sigpath, PATH_MAX, "%s.sig", file->path);
+			if(unlink_batch_add(batch, file->path, 0) != 0
+					|| unlink_batch_add(batch, sigpath, 1) != 0) {
+				pm_printf(ALPM_LOG_ERROR, _("memory exhausted\n"));
+				ret++;
+				break;
+			}
+		}
+	}
+	ret += unlink_batch_run(batch);
+
+	/* the file list is gone once the hashed cache changes */
+	if(remove && alpm_cache_remove_files(config->handle, cachedir, remove) != 0) {
+		pm_printf(ALPM_LOG_ERROR, _("could not clean hashed cache in %s: %s\n"),
+				cachedir, alpm_strerror(alpm_errno(config->handle)));
+		ret++;
+	}
+	alpm_list_free(remove);
+	return ret;
+}
+
 static int sync_cleancache(int level)
 {
 	alpm_list_t *i;
-	alpm_list_t *sync_dbs = alpm_get_syncdbs(config->handle);
-	alpm_db_t *db_local = alpm_get_localdb(config->handle);
 	alpm_list_t *cachedirs = alpm_option_get_cachedirs(config->handle);
+	struct unlink_batch batch = { NULL, 0, 0 };
 	int ret = 0;
 
 	if(!config->cleanmethod) {
@@ -209,104 +432,34 @@ static int sync_cleancache(int level)
 			continue;
 		}
 
-		rewinddir(dir);
-		/* step through the directory one file at a time */
-		while((ent = readdir(dir)) != NULL) {
+		/* step through the directory one file at a time when removing all */
+		while(level > 1 && (ent = readdir(dir)) != NULL) {
 			char path[PATH_MAX];
-			int delete = 1;
-			alpm_pkg_t *localpkg = NULL, *pkg = NULL;
-			const char *local_name, *local_version;
+			struct stat st;
 
 			if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
 				continue;
 			}
 
-			if(level <= 1) {
-				static const char *const glob_skips[] = {
-					/* skip signature files - they are removed with their package file */
-					"*.sig",
-					/* skip package databases within the cache directory */
-					"*.db*", "*.files*",
-					/* skip source packages within the cache directory */
-					"*.src.tar.*",
-					/* skip package deltas, we aren't smart enough to clean these yet */
-					"*.delta"
-				};
-				size_t j;
-
-				for(j = 0; j < ARRAYSIZE(glob_skips); j++) {
-					if(fnmatch(glob_skips[j], ent->d_name, 0) == 0) {
-						delete = 0;
-						break;
-					}
-				}
-				if(delete == 0) {
-					continue;
-				}
-			}
-
 			/* build the full filepath */
 			snprintf(path, PATH_MAX, "%s%s", cachedir, ent->d_name);
 
-			/* short circuit for removing all files from cache */
-			if(level > 1) {
-				ret += unlink_verbose(path, 0);
+			/* hashed contents are cleaned through their index below */
+			if(stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
 				continue;
 			}
 
-			/* attempt to load the file as a package. if we cannot load the file,
-			 * simply skip it and move on. we don't need a full load of the package,
-			 * just the metadata. */
-			if(alpm_pkg_load(config->handle, path, 0, 0, &localpkg) != 0) {
-				pm_printf(ALPM_LOG_DEBUG, "skipping %s, could not load as package\n",
-						path);
-				continue;
-			}
-			local_name = alpm_pkg_get_name(localpkg);
-			local_version = alpm_pkg_get_version(localpkg);
-
-			if(config->cleanmethod & PM_CLEAN_KEEPINST) {
-				/* check if this package is in the local DB */
-				pkg = alpm_db_get_pkg(db_local, local_name);
-				if(pkg != NULL && alpm_pkg_vercmp(local_version,
-							alpm_pkg_get_version(pkg)) == 0) {
-					/* package was found in local DB and version matches, keep it */
-					pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in local db\n",
-							local_name, local_version);
-					delete = 0;
-				}
-			}
-			if(config->cleanmethod & PM_CLEAN_KEEPCUR) {
-				alpm_list_t *j;
-				/* check if this package is in a sync DB */
-				for(j = sync_dbs; j && delete; j = alpm_list_next(j)) {
-					alpm_db_t *db = j->data;
-					pkg = alpm_db_get_pkg(db, local_name);
-					if(pkg != NULL && alpm_pkg_vercmp(local_version,
-								alpm_pkg_get_version(pkg)) == 0) {
-						/* package was found in a sync DB and version matches, keep it */
-						pm_printf(ALPM_LOG_DEBUG, "package %s-%s found in sync db\n",
-								local_name, local_version);
-						delete = 0;
-					}
-				}
-			}
-			/* free the local file package */
-			alpm_pkg_free(localpkg);
-
-			if(delete) {
-				size_t pathlen = strlen(path);
-				ret += unlink_verbose(path, 0);
-				/* unlink a signature file if present too */
-				if(PATH_MAX - 5 >= pathlen) {
-					strcpy(path + pathlen, ".sig");
-					ret += unlink_verbose(path, 1);
-				}
+			if(unlink_batch_add(&batch, path, 0) != 0) {
+				pm_printf(ALPM_LOG_ERROR, _("memory exhausted\n"));
+				ret++;
+				break;
 			}
 		}
 		closedir(dir);
+		ret += sync_cleancache_files(cachedir, level, &batch);
 		printf("\n");
 	}
+	free(batch.files);
 
 	return ret;
 }
@@ -489,7 +642,9 @@ static int sync_list(alpm_list_t *syncs, alpm_list_t *targets)
 		for(j = alpm_db_get_pkgcache(db); j; j = alpm_list_next(j)) {
 			alpm_pkg_t *pkg = j->data;
 
-			if(!config->quiet) {
+			if(config->machinereadable) {
+				print_line_machinereadable(db, pkg, NULL);
+			} else if(!config->quiet) {
 				const colstr_t *colstr = &config->colstr;
 				printf("%s%s %s%s %s%s%s", colstr->repo, alpm_db_get_name(db),
 						colstr->title, alpm_pkg_get_name(pkg),
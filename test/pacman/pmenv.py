@@ -63,6 +63,9 @@ def run(self):
             tap.diag("Running '%s'" % t.testname)
 
             t.load()
+            if t.skipall:
+                tap.skip(t.description, t.skipall)
+                continue
             t.generate(self.pacman)
             t.run(self.pacman)
 
@@ -21,10 +21,12 @@
 import util
 
 class pmfile(object):
-    def __init__(self, path, content, mode=0o644):
+    def __init__(self, path, content, mode=0o644, raw=False):
         self.path = path
         self.content = content
         self.mode = mode
+        # raw contents are written as they are, without a final newline
+        self.raw = raw
 
     def mkfile(self, root):
         path = os.path.join(root, self.path)
@@ -33,10 +35,10 @@ def mkfile(self, root):
         if dir_path and not os.path.isdir(dir_path):
             os.makedirs(dir_path, 0o755)
 
-        fd = open(path, "w")
+        fd = open(path, "wb" if self.raw else "w")
         if self.content:
             fd.write(self.content)
-            if self.content[-1] != "\n":
+            if not self.raw and self.content[-1] != "\n":
                 fd.write("\n")
         fd.close()
 
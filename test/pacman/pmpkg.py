@@ -14,9 +14,13 @@
 #  You should have received a copy of the GNU General Public License
 #  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+import gzip
+import hashlib
 import os
+import shutil
 from StringIO import StringIO
 import tarfile
+import tempfile
 
 import util
 
@@ -141,8 +145,11 @@ def makepkg(self, path):
         self.path = os.path.join(path, self.filename())
         util.mkdir(os.path.dirname(self.path))
 
-        # Generate package metadata
-        tar = tarfile.open(self.path, "w:gz")
+        # Generate package metadata; without a name or time in the gzip header
+        # the same package is built into the same file every time
+        pkgfile = open(self.path, "wb")
+        gz = gzip.GzipFile("", "wb", fileobj=pkgfile, mtime=0)
+        tar = tarfile.open(fileobj=gz, mode="w")
         for name, data in archive_files:
             info = tarfile.TarInfo(name)
             info.size = len(data)
@@ -170,6 +177,24 @@ def makepkg(self, path):
                 tar.addfile(info, StringIO(filedata))
 
         tar.close()
+        gz.close()
+        pkgfile.close()
+
+    def sha256sum(self):
+        """Checksum of the archive makepkg() creates.
+
+        Packages are built the same way every time, so this is known before
+        the test environment is generated.
+        """
+        tmpdir = tempfile.mkdtemp()
+        try:
+            self.finalize()
+            self.makepkg(tmpdir)
+            with open(self.path, "rb") as f:
+                return hashlib.sha256(f.read()).hexdigest()
+        finally:
+            shutil.rmtree(tmpdir)
+            self.path = None
 
     def install_package(self, root):
         """Install the package in the given root."""
@@ -178,6 +203,26 @@ def install_package(self, root):
             if os.path.isfile(path):
                 os.utime(path, (355, 355))
 
+    def local_mtree(self, altered=()):
+        """Generate an mtree of the files install_package() creates.
+
+        Files named in altered are described with other contents of the same
+        size, as if they were changed after they were installed.
+        """
+        umask = os.umask(0)
+        os.umask(umask)
+        mtree = ["#mtree"]
+        for f in self.filelist():
+            if f.endswith("/") or " -> " in f:
+                continue
+            data = f + "\n"
+            if f in altered:
+                data = data.swapcase()
+            mtree.append("./%s time=355.0 size=%d mode=%o uid=%d gid=%d type=file sha256digest=%s"
+                    % (f, len(data), 0o666 & ~umask, os.getuid(), os.getgid(),
+                        hashlib.sha256(data.encode()).hexdigest()))
+        return "\n".join(mtree)
+
     def filelist(self):
         """Generate a list of package files."""
         return sorted([self.parse_filename(f) for f in self.files])
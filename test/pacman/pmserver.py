@@ -0,0 +1,141 @@
+#  Copyright (c) 2016 Pacman Development Team <pacman-dev@archlinux.org>
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+import email.utils
+import os
+import threading
+import time
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+except ImportError:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+
+
+class pmserver(object):
+    """HTTP server object
+
+    Serves the files below a directory on the loopback interface from a
+    background thread, for tests of downloads that file:// cannot cover.
+    Every request is noted by creating a file named after the requested
+    file in the hits directory, so rules can check what was fetched. The
+    byte ranges asked for are written to it, one "first-last" per line.
+    """
+
+    def __init__(self, directory, hits, delay=0, status=None, mtimes=None,
+            etags=None, ranges=True, truncate=None):
+        self.directory = directory
+        self.hits = hits
+        # modification times to report instead of the real ones, by file
+        # name, like a mirror that keeps the times of its upstream
+        self.mtimes = mtimes or {}
+        # ETags to send instead of ones made from size and time, by file name
+        self.etags = etags or {}
+        # seconds to wait before answering each request
+        self.delay = delay
+        # if set, answer every request with this HTTP status instead
+        self.status = status
+        # whether to honour Range headers, or always send the whole file
+        self.ranges = ranges
+        # if set, drop the connection after sending this many bytes of a body
+        self.truncate = truncate
+
+        server = self
+
+        class handler(BaseHTTPRequestHandler):
+            def do_HEAD(self):
+                server.handle(self, False)
+
+            def do_GET(self):
+                server.handle(self, True)
+
+            def log_message(self, format, *args):
+                pass
+
+        self.httpd = HTTPServer(("127.0.0.1", 0), handler)
+        self.url = "http://127.0.0.1:%d" % self.httpd.server_port
+        thread = threading.Thread(target=self.httpd.serve_forever)
+        thread.daemon = True
+        thread.start()
+
+    def __str__(self):
+        return self.url
+
+    def handle(self, request, body):
+        name = request.path.split("?")[0].lstrip("/")
+        if not os.path.isdir(self.hits):
+            os.makedirs(self.hits, 0o755)
+        byterange = request.headers.get("Range")
+        with open(os.path.join(self.hits, os.path.basename(name)), "a") as f:
+            if byterange and byterange.startswith("bytes="):
+                f.write(byterange[6:] + "\n")
+
+        if self.delay:
+            time.sleep(self.delay)
+        if self.status:
+            request.send_error(self.status)
+            return
+
+        path = os.path.join(self.directory, name)
+        if not os.path.isfile(path):
+            request.send_error(404)
+            return
+
+        st = os.stat(path)
+        mtime = int(self.mtimes.get(name, st.st_mtime))
+        etag = self.etags.get(name, '"%x-%x"' % (st.st_size, mtime))
+        since = request.headers.get("If-Modified-Since")
+        match = request.headers.get("If-None-Match")
+        if match is not None:
+            unchanged = match == etag
+        elif since is not None:
+            since = email.utils.parsedate_tz(since)
+            unchanged = since is not None \
+                    and mtime <= email.utils.mktime_tz(since)
+        else:
+            unchanged = False
+        if unchanged:
+            request.send_response(304)
+            request.send_header("ETag", etag)
+            request.end_headers()
+            return
+
+        with open(path, "rb") as f:
+            data = f.read()
+        start, end = 0, len(data) - 1
+        if not self.ranges:
+            byterange = None
+        if byterange and byterange.startswith("bytes="):
+            first, last = byterange[6:].split("-", 1)
+            start = int(first) if first else 0
+            end = min(int(last), end) if last else end
+        if start > end:
+            request.send_error(416)
+            return
+
+        request.send_response(206 if byterange else 200)
+        if byterange:
+            request.send_header("Content-Range",
+                    "bytes %d-%d/%d" % (start, end, len(data)))
+        request.send_header("Content-Length", str(end - start + 1))
+        request.send_header("Last-Modified",
+                email.utils.formatdate(mtime, usegmt=True))
+        request.send_header("ETag", etag)
+        request.end_headers()
+        if body:
+            request.wfile.write(data[start:end + 1][:self.truncate])
+
+# vim: set ts=4 sw=4 et:
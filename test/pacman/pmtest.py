@@ -29,6 +29,10 @@
 import util
 from util import vprint
 
+class SkipTest(Exception):
+    """Raised by a test that cannot run here"""
+
+
 class pmtest(object):
     """Test object
     """
@@ -79,6 +83,11 @@ def addrule(self, rulename):
         rule = pmrule.pmrule(rulename)
         self.rules.append(rule)
 
+    def require_program(self, name):
+        """Skip the test unless the program is in the PATH."""
+        if not util.which(name):
+            raise SkipTest("%s is not installed" % name)
+
     def load(self):
         # Reset test parameters
         self.result = {
@@ -96,17 +105,23 @@ def load(self):
 
         self.description = ""
         self.option = {}
+        # extra environment variables for pacman
+        self.env = {}
 
         # Test rules
         self.rules = []
         self.files = []
         self.expectfailure = False
+        self.skipall = None
 
         if os.path.isfile(self.name):
             # all tests expect this to be available
             from pmpkg import pmpkg
             with open(self.name) as input:
-                exec(input.read(),locals())
+                try:
+                    exec(input.read(),locals())
+                except SkipTest as e:
+                    self.skipall = str(e)
         else:
             raise IOError("file %s does not exist!" % self.name)
 
@@ -195,6 +210,11 @@ def generate(self, pacman):
             self.files.append(f)
             vprint("\t%s" % f.name)
 
+    def add_mtree(self, pkg, altered=()):
+        """Describe the installed files of a local package in its mtree."""
+        path = os.path.join(util.PM_DBPATH, "local", pkg.fullname(), "mtree")
+        self.filesystem.append(pmfile.pmfile(path, pkg.local_mtree(altered)))
+
     def add_hook(self, name, content):
         if not name.endswith(".hook"):
             name = name + ".hook"
@@ -264,7 +284,7 @@ def run(self, pacman):
         time_start = time.time()
         self.retcode = subprocess.call(cmd,
                 cwd=os.path.join(self.root, util.TMPDIR),
-                env={'LC_ALL': 'C', 'PATH': os.environ['PATH']})
+                env=dict(self.env, LC_ALL='C', PATH=os.environ['PATH']))
         time_end = time.time()
         vprint("\ttime elapsed: %.2fs" % (time_end - time_start))
 
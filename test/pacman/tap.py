@@ -30,6 +30,11 @@ def ok(ok, description=""):
     _output("%s %d - %s%s" % ("ok" if ok else "not ok", count,
         description, directive))
 
+def skip(description, reason):
+    global count
+    count += 1
+    _output("ok %d - %s # SKIP %s" % (count, description, reason))
+
 def plan(count):
     _output("1..%d" % (count))
 
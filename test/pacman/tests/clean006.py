@@ -0,0 +1,28 @@
+self.description = "Clean the cache by the names of the package files"
+
+lp = pmpkg("lib-foo-bar", "2:1.0-1")
+self.addpkg2db("local", lp)
+
+lp = pmpkg("my-app", "1.5-2")
+self.addpkg2db("local", lp)
+
+# none of these files are packages; only their names tell what they hold
+cached = "var/cache/pacman/pkg/"
+keep = ["lib-foo-bar-2:1.0-1-x86_64.pkg.tar.zst",
+        "lib-foo-bar-2:1.0-1-x86_64.pkg.tar.zst.sig",
+        "my-app-1.5-2-any.pkg.tar.xz",
+        "notes.txt"]
+remove = ["lib-foo-bar-1:3.0-1-x86_64.pkg.tar.zst",
+          "lib-foo-bar-1:3.0-1-x86_64.pkg.tar.zst.sig",
+          "lib-foo-2:1.0-1-x86_64.pkg.tar.zst",
+          "my-app-1.5-1-any.pkg.tar.xz"]
+for f in keep + remove:
+    self.filesystem.append(cached + f)
+
+self.args = "-Sc"
+
+self.addrule("PACMAN_RETCODE=0")
+for f in keep:
+    self.addrule("FILE_EXIST=%s%s" % (cached, f))
+for f in remove:
+    self.addrule("!FILE_EXIST=%s%s" % (cached, f))
@@ -0,0 +1,22 @@
+self.description = "Upgrade a package with per-package durability"
+
+self.option['Durability'] = ['Package']
+
+lp = pmpkg("dummy")
+lp.files = ["bin/dummy",
+            "usr/man/man1/dummy.1"]
+self.addpkg2db("local", lp)
+
+p = pmpkg("dummy", "1.0-2")
+p.files = ["bin/dummy",
+           "usr/man/man1/dummy.1"]
+self.addpkg(p)
+
+self.args = "--debug -U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=dummy|1.0-2")
+for f in lp.files:
+	self.addrule("FILE_MODIFIED=%s" % f)
+self.addrule("PACMAN_OUTPUT=flushing package changes to disk")
+self.addrule("!PACMAN_OUTPUT=flushing transaction changes to disk")
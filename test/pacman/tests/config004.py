@@ -0,0 +1,13 @@
+self.description = "Reject an invalid Durability value"
+
+self.option['Durability'] = ['Always']
+
+p = pmpkg("dummy")
+p.files = ["bin/dummy"]
+self.addpkg(p)
+
+self.args = "-U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PKG_EXIST=dummy")
+self.addrule("PACMAN_OUTPUT=invalid value for 'Durability' : 'Always'")
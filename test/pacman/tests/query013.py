@@ -0,0 +1,23 @@
+self.description = "Query info on a package (reverse deps through provides)"
+
+pkg1 = pmpkg("pkg1")
+pkg1.depends = ["libfoo>=2"]
+self.addpkg2db("local", pkg1)
+
+pkg2 = pmpkg("pkg2")
+pkg2.depends = ["libfoo<2"]
+self.addpkg2db("local", pkg2)
+
+pkg3 = pmpkg("pkg3")
+pkg3.depends = ["foo"]
+self.addpkg2db("local", pkg3)
+
+foo = pmpkg("foo")
+foo.provides = ["libfoo=2.1"]
+self.addpkg2db("local", foo)
+
+self.args = "-Qi %s" % foo.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^Required By.*pkg1  pkg3")
+self.addrule("!PACMAN_OUTPUT=^Required By.*pkg2")
@@ -0,0 +1,23 @@
+self.description = "Query packages with machine readable output"
+
+p = pmpkg("foobar")
+p.files = ["bin/foobar"]
+p.desc = "test description"
+p.depends = ["bar>1.0", "baz"]
+p.optdepends = ["qux: for testing"]
+p.license = "GPL2"
+p.packager = "Arch Linux"
+p.reason = 1
+
+self.addpkg2db("local", p)
+
+self.args = "-Qil --machinereadable %s" % p.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00desc\x00test description$")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00depends\x00bar>1\.0$")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00optdepends\x00qux: for testing$")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00license\x00GPL2$")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00reason\x00dependency$")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00bin/foobar$")
+self.addrule("!PACMAN_OUTPUT=^Name")
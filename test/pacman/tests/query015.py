@@ -0,0 +1,12 @@
+self.description = "Query upgrades with machine readable output"
+
+lp = pmpkg("foobar")
+self.addpkg2db("local", lp)
+
+sp = pmpkg("foobar", "2.0-1")
+self.addpkg2db("sync", sp)
+
+self.args = "-Qu --machinereadable"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x002\.0-1$")
@@ -0,0 +1,11 @@
+self.description = "Query the owner of a file with machine readable output"
+
+p = pmpkg("foobar")
+p.files = ["bin/foobar"]
+self.addpkg2db("local", p)
+
+self.args = "-Qo --machinereadable %sbin/foobar" % self.rootdir()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^local\x00foobar\x001\.0-1\x00%sbin/foobar$" % self.rootdir())
+self.addrule("!PACMAN_OUTPUT=is owned by")
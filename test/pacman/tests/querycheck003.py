@@ -0,0 +1,17 @@
+self.description = "Query--check mtree of several packages in parallel"
+
+for n in range(8):
+    pkg = pmpkg("pkg%d" % n)
+    pkg.files = ["usr/share/pkg%d/file%02d" % (n, i) for i in range(40)]
+    self.addpkg2db("local", pkg)
+
+    self.add_mtree(pkg, altered=["usr/share/pkg5/file07"])
+
+self.option["ParallelChecks"] = ["4"]
+self.args = "-Qkk --full"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=pkg5: .*usr/share/pkg5/file07 \\(SHA256 checksum mismatch\\)")
+self.addrule("PACMAN_OUTPUT=^pkg5: 40 total files, 1 altered file")
+for n in [0, 1, 2, 3, 4, 6, 7]:
+    self.addrule("PACMAN_OUTPUT=^pkg%d: 40 total files, 0 altered files" % n)
@@ -0,0 +1,27 @@
+import pmfile
+
+self.description = "Query--check --full hashes every file"
+
+pkg = pmpkg("dummy")
+pkg.files = ["usr/share/dummy/a",
+             "usr/share/dummy/b",
+             "usr/share/dummy/c"]
+self.addpkg2db("local", pkg)
+
+# a and b were modified behind pacman's back, keeping their size
+self.add_mtree(pkg, altered=["usr/share/dummy/a", "usr/share/dummy/b"])
+
+# the stamps of a and c no longer match, b was never stamped
+self.filesystem.append(pmfile.pmfile(
+    "var/lib/pacman/local/dummy-1.0-1/stamps", "\n".join([
+        "%STAMPS%",
+        "0 0 18 0 0 usr/share/dummy/a",
+        "0 0 18 0 0 usr/share/dummy/c"])))
+
+self.args = "-Qkk --full"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=dummy: .*usr/share/dummy/a \\(SHA256 checksum mismatch\\)")
+self.addrule("PACMAN_OUTPUT=dummy: .*usr/share/dummy/b \\(SHA256 checksum mismatch\\)")
+self.addrule("!PACMAN_OUTPUT=usr/share/dummy/c")
+self.addrule("PACMAN_OUTPUT=^dummy: 3 total files, 2 altered files")
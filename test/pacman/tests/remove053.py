@@ -0,0 +1,28 @@
+self.description = "-Rs removes a dependency only required through a provider"
+
+lp1 = pmpkg("pkg1")
+lp1.depends = ["pkg2", "pkg3"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkg2")
+lp2.reason = 1
+self.addpkg2db("local", lp2)
+
+lp3 = pmpkg("pkg3")
+lp3.depends = ["pkg2-provider"]
+lp3.reason = 1
+self.addpkg2db("local", lp3)
+
+lp4 = pmpkg("pkg4")
+lp4.provides = ["pkg2-provider"]
+lp4.depends = ["pkg2"]
+lp4.reason = 1
+self.addpkg2db("local", lp4)
+
+self.args = "-Rs %s" % lp1.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!PKG_EXIST=pkg3")
+self.addrule("!PKG_EXIST=pkg4")
+self.addrule("!PKG_EXIST=pkg2")
@@ -0,0 +1,14 @@
+self.description = "Remove a package with files nested deeper than 33 directories"
+
+lp = pmpkg("dummy")
+lp.files = ["d/" * 40 + "file",
+            "d/" * 34 + "file",
+            "d/" * 36 + "file"]
+self.addpkg2db("local", lp)
+
+self.args = "-R %s" % lp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("!PKG_EXIST=dummy")
+for f in lp.files:
+	self.addrule("!FILE_EXIST=%s" % f)
@@ -0,0 +1,25 @@
+self.description = "Find a verified package signature in the signature cache"
+
+import os
+
+import pmfile
+
+p = pmpkg("pkg1")
+self.addpkg(p)
+
+gpgdir = "etc/pacman.d/gnupg/"
+self.option["GPGDir"] = [os.path.join(self.root, gpgdir)]
+self.option["LocalFileSigLevel"] = ["Required"]
+self.filesystem.append(pmfile.pmfile(gpgdir + "pubring.gpg", "keys"))
+self.filesystem.append(pmfile.pmfile(gpgdir + "trustdb.gpg", "trust"))
+self.filesystem.append(pmfile.pmfile("tmp/%s.sig" % p.filename(),
+    "signature", raw=True))
+
+# the second load is refused as a duplicate only after its signature was
+# checked, this time from the cache the first load filled
+self.args = "--debug -U %s %s" % (p.filename(), p.filename())
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("PACMAN_OUTPUT=signature for %s found in signature cache" % p.filename())
+self.addrule("FILE_EXIST=var/cache/pacman/pkg/.sigcache")
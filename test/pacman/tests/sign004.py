@@ -0,0 +1,30 @@
+self.description = "Ignore the signature cache after the keyring changed"
+
+import hashlib
+import os
+
+import pmfile
+
+p = pmpkg("pkg1")
+self.addpkg(p)
+
+gpgdir = "etc/pacman.d/gnupg/"
+self.option["GPGDir"] = [os.path.join(self.root, gpgdir)]
+self.option["LocalFileSigLevel"] = ["Required"]
+self.filesystem.append(pmfile.pmfile(gpgdir + "pubring.gpg", "keys"))
+self.filesystem.append(pmfile.pmfile(gpgdir + "trustdb.gpg", "trust"))
+self.filesystem.append(pmfile.pmfile("tmp/%s.sig" % p.filename(),
+    "signature", raw=True))
+
+# the package was verified before the keyring files were created
+self.filesystem.append(pmfile.pmfile("var/cache/pacman/pkg/.sigcache",
+    "-;-;-;-;\n%s %s 0" % (p.sha256sum(),
+        hashlib.sha256("signature").hexdigest())))
+
+self.args = "--debug -U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("PACMAN_OUTPUT=signature cache .* is stale, keyring has changed")
+self.addrule("!PACMAN_OUTPUT=found in signature cache")
+self.addrule("FILE_MODIFIED=var/cache/pacman/pkg/.sigcache")
@@ -0,0 +1,16 @@
+self.description = "Download from the mirror when no cache peer has the package"
+
+# this setting forces us to download packages
+self.cachepkgs = False
+self.option['CachePeer'] = ['file:///nonexistent/peer/',
+                            'file://%svar/pub/nonexistent' % self.rootdir()]
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
@@ -0,0 +1,23 @@
+self.description = "Discard a package from a cache peer that does not match"
+
+import pmfile
+import pmserver
+
+self.cachepkgs = False
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+peer = pmserver.pmserver(self.rootdir() + "var/peer",
+        self.rootdir() + "var/log/peer")
+self.option['CachePeer'] = [peer.url]
+self.filesystem.append(pmfile.pmfile("var/peer/%s" % sp.filename(), "bogus"))
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("FILE_EXIST=var/log/peer/%s" % sp.filename())
+self.addrule("PACMAN_OUTPUT=does not match the database")
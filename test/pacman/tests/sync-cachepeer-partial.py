@@ -0,0 +1,26 @@
+self.description = "Do not complete a partial download from a cache peer"
+
+import pmfile
+import pmserver
+
+self.cachepkgs = False
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+peer = pmserver.pmserver(self.rootdir() + "var/pub/sync",
+        self.rootdir() + "var/log/peer")
+self.option['CachePeer'] = [peer.url]
+
+# left behind by an interrupted download from elsewhere
+self.filesystem.append(pmfile.pmfile(
+    "var/cache/pacman/pkg/%s.part" % sp.filename(), "bogus"))
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("FILE_EXIST=var/log/peer/%s" % sp.filename())
+self.addrule("!FILE_EXIST=var/cache/pacman/pkg/%s.part" % sp.filename())
@@ -0,0 +1,36 @@
+self.description = "Keep a partial download from a mirror when cache peers fail"
+
+import time
+
+import pmfile
+import pmserver
+
+self.cachepkgs = False
+self.option["ScoreMirrors"] = [""]
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+repo = self.rootdir() + "var/pub/sync"
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror")
+self.db["sync"].option["Server"] = [mirror.url]
+peer = pmserver.pmserver(self.rootdir() + "var/peer",
+        self.rootdir() + "var/log/peer")
+self.option['CachePeer'] = [peer.url]
+
+# keep the local server out of the way
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats",
+    "%d 5 20.000000 1000000 0.9500 file://%s" % (int(time.time()), repo)))
+
+# left behind by an interrupted download from the mirror; it is not a real
+# prefix of the package, so the completed file fails its checksum
+self.filesystem.append(pmfile.pmfile(
+    "var/cache/pacman/pkg/%s.part" % sp.filename(), "bogus"))
+
+self.args = "-Sw %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("FILE_EXIST=var/log/peer/%s" % sp.filename())
+self.addrule("FILE_CONTENTS=var/log/mirror/%s|6-\n" % sp.filename())
+self.addrule("!FILE_EXIST=var/cache/pacman/pkg/%s.peer.part" % sp.filename())
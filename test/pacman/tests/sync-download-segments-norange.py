@@ -0,0 +1,26 @@
+self.description = "Move download segments off a mirror that ignores ranges"
+
+import pmserver
+
+self.cachepkgs = False
+self.option["DownloadSegments"] = ["2"]
+self.env["ALPM_SEGMENT_MIN_SIZE"] = "1"
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+repo = self.rootdir() + "var/pub/sync"
+norange = pmserver.pmserver(repo, self.rootdir() + "var/log/norange",
+        ranges=False)
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror")
+self.db["sync"].option["Server"] = [norange.url, mirror.url]
+
+self.args = "--debug -S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("PACMAN_OUTPUT=server ignored range request \\(response code 200\\)")
+self.addrule("PACMAN_OUTPUT=segment url: %s/%s \\(bytes 0-"
+        % (mirror.url, sp.filename()))
@@ -0,0 +1,27 @@
+self.description = "Continue a broken download segment on the next mirror"
+
+import pmserver
+
+self.cachepkgs = False
+self.option["DownloadSegments"] = ["2"]
+self.env["ALPM_SEGMENT_MIN_SIZE"] = "1"
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+# the first mirror breaks off every transfer after a few bytes
+repo = self.rootdir() + "var/pub/sync"
+broken = pmserver.pmserver(repo, self.rootdir() + "var/log/broken",
+        truncate=8)
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror")
+self.db["sync"].option["Server"] = [broken.url, mirror.url]
+
+self.args = "--debug -S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("PACMAN_OUTPUT=segment at 0 failed on %s" % broken.url)
+self.addrule("PACMAN_OUTPUT=segment url: %s/%s \\(bytes 8-"
+        % (mirror.url, sp.filename()))
@@ -0,0 +1,27 @@
+self.description = "Download a package in segments from two mirrors"
+
+import pmserver
+
+self.cachepkgs = False
+self.option["DownloadSegments"] = ["4"]
+# packages here are far smaller than real segments
+self.env["ALPM_SEGMENT_MIN_SIZE"] = "1"
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+repo = self.rootdir() + "var/pub/sync"
+mirrors = [pmserver.pmserver(repo, self.rootdir() + "var/log/mirror%d" % n)
+        for n in range(2)]
+self.db["sync"].option["Server"] = [m.url for m in mirrors]
+
+self.args = "--debug -S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("PACMAN_OUTPUT=downloading %s in 4 segments from 2 servers"
+        % sp.filename())
+for n in range(2):
+    self.addrule("FILE_EXIST=var/log/mirror%d/%s" % (n, sp.filename()))
@@ -0,0 +1,29 @@
+self.description = "Clean a hashed cache through its index"
+
+import hashlib
+
+import pmfile
+
+self.option['HashedCache'] = ['']
+self.cachepkgs = False
+
+lp = pmpkg("dummy")
+self.addpkg2db("local", lp)
+
+# contents are stored with a final newline, see pmfile
+blobs = {}
+for name in ["dummy-0.9-1-any.pkg.tar.gz", "dummy-1.0-1-any.pkg.tar.gz"]:
+    blobs[name] = hashlib.sha256(name + "\n").hexdigest()
+    self.filesystem.append(pmfile.pmfile("var/cache/pacman/pkg/.sha256/%s/%s"
+        % (blobs[name][:2], blobs[name]), name))
+self.filesystem.append(pmfile.pmfile("var/cache/pacman/pkg/.sha256/index",
+    "".join("%s %s\n" % (blobs[n], n) for n in sorted(blobs))))
+
+self.args = "-Sc"
+
+old, cur = [blobs[n] for n in sorted(blobs)]
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("!FILE_EXIST=var/cache/pacman/pkg/.sha256/%s/%s" % (old[:2], old))
+self.addrule("FILE_EXIST=var/cache/pacman/pkg/.sha256/%s/%s" % (cur[:2], cur))
+self.addrule("FILE_CONTENTS=var/cache/pacman/pkg/.sha256/index|"
+    "%s dummy-1.0-1-any.pkg.tar.gz\n" % cur)
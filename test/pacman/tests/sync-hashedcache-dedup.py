@@ -0,0 +1,39 @@
+self.description = "Store the contents of two package names once"
+
+import hashlib
+import shutil
+import tempfile
+
+import pmfile
+
+self.option['HashedCache'] = ['']
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+# packages are built the same way every time, so this is the file that
+# ends up in the cache
+tmpdir = tempfile.mkdtemp()
+sp.finalize()
+sp.makepkg(tmpdir)
+with open(sp.path, "rb") as f:
+    data = f.read()
+shutil.rmtree(tmpdir)
+sha256 = hashlib.sha256(data).hexdigest()
+
+# the same contents were stored before under another name
+self.filesystem.append(pmfile.pmfile("var/cache/pacman/pkg/.sha256/%s/%s"
+    % (sha256[:2], sha256), data, raw=True))
+self.filesystem.append(pmfile.pmfile("var/cache/pacman/pkg/.sha256/index",
+    "%s dummy-1.0-1-any.pkg.tar.gz\n" % sha256))
+
+self.args = "--debug -S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("PACMAN_OUTPUT=%s is already cached as" % sp.filename())
+self.addrule("!FILE_EXIST=var/cache/pacman/pkg/%s" % sp.filename())
+self.addrule("FILE_CONTENTS=var/cache/pacman/pkg/.sha256/index|"
+    "%s dummy-1.0-1-any.pkg.tar.gz\n%s %s\n" % (sha256, sha256, sp.filename()))
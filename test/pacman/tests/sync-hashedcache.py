@@ -0,0 +1,15 @@
+self.description = "Move a cached package into the hashed cache layout"
+
+self.option['HashedCache'] = ['']
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=usr/bin/dummy")
+self.addrule("FILE_EXIST=var/cache/pacman/pkg/.sha256/index")
+self.addrule("!CACHE_EXISTS=dummy|1.0-1")
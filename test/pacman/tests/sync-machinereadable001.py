@@ -0,0 +1,17 @@
+self.description = "Sync info with machine readable output"
+
+sp = pmpkg("foobar")
+sp.desc = "test description"
+sp.depends = ["bar>1.0"]
+sp.license = "GPL2"
+self.addpkg2db("sync", sp)
+
+self.args = "-Si --machinereadable %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1\x00desc\x00test description$")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1\x00depends\x00bar>1\.0$")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1\x00license\x00GPL2$")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1\x00csize\x00[0-9]+$")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1\x00filename\x00foobar-1\.0-1\.pkg\.tar\.gz$")
+self.addrule("!PACMAN_OUTPUT=^Repository")
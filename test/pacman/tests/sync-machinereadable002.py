@@ -0,0 +1,13 @@
+self.description = "Sync list with machine readable output"
+
+sp1 = pmpkg("foobar")
+self.addpkg2db("sync", sp1)
+
+sp2 = pmpkg("baz", "2.0-1")
+self.addpkg2db("sync", sp2)
+
+self.args = "-Sl --machinereadable"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00baz\x002\.0-1$")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1$")
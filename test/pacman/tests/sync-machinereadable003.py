@@ -0,0 +1,15 @@
+self.description = "Sync search with machine readable output"
+
+sp1 = pmpkg("foobar")
+sp1.desc = "test description"
+self.addpkg2db("sync", sp1)
+
+sp2 = pmpkg("baz", "2.0-1")
+sp2.desc = "something else"
+self.addpkg2db("sync", sp2)
+
+self.args = "-Ss --machinereadable description"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule(r"PACMAN_OUTPUT=^sync\x00foobar\x001\.0-1$")
+self.addrule("!PACMAN_OUTPUT=baz")
@@ -0,0 +1,9 @@
+self.description = "Machine readable output cannot be used to install"
+
+sp = pmpkg("foobar")
+self.addpkg2db("sync", sp)
+
+self.args = "-S --machinereadable %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PKG_EXIST=foobar")
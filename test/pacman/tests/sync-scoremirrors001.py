@@ -0,0 +1,32 @@
+self.description = "Download from the mirror expected to be fastest"
+
+import time
+
+import pmfile
+import pmserver
+
+self.cachepkgs = False
+self.option["ScoreMirrors"] = [""]
+
+repo = self.rootdir() + "var/pub/sync"
+slow = pmserver.pmserver(repo, self.rootdir() + "var/log/slow", delay=2)
+fast = pmserver.pmserver(repo, self.rootdir() + "var/log/fast")
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+self.db["sync"].option["Server"] = [slow.url, fast.url]
+
+# <last used> <samples> <seconds to first byte> <bytes/s> <failures> <url>
+now = int(time.time())
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats", "\n".join([
+    "%d 5 20.000000 1000000 0.0000 file://%s" % (now, repo),
+    "%d 5 2.000000 1000000 0.0000 %s" % (now, slow.url),
+    "%d 5 0.010000 10000000 0.0000 %s" % (now, fast.url)])))
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=var/log/fast/%s" % sp.filename())
+self.addrule("!FILE_EXIST=var/log/slow/%s" % sp.filename())
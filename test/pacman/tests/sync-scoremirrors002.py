@@ -0,0 +1,33 @@
+self.description = "Try a mirror again once its failures are old"
+
+import time
+
+import pmfile
+import pmserver
+
+self.cachepkgs = False
+self.option["ScoreMirrors"] = [""]
+
+repo = self.rootdir() + "var/pub/sync"
+recovered = pmserver.pmserver(repo, self.rootdir() + "var/log/recovered")
+flaky = pmserver.pmserver(repo, self.rootdir() + "var/log/flaky", delay=1)
+
+sp = pmpkg("dummy")
+sp.files = ["usr/bin/dummy"]
+self.addpkg2db("sync", sp)
+self.db["sync"].option["Server"] = [flaky.url, recovered.url]
+
+# the first download from recovered failed seven hours ago, while flaky
+# has been failing most of the time since
+now = int(time.time())
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats", "\n".join([
+    "%d 5 2.000000 1000000 0.9500 file://%s" % (now, repo),
+    "%d 5 2.000000 1000000 0.9000 %s" % (now - 60, flaky.url),
+    "%d 1 -1.000000 0 1.0000 %s" % (now - 7 * 60 * 60, recovered.url)])))
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=var/log/recovered/%s" % sp.filename())
+self.addrule("!FILE_EXIST=var/log/flaky/%s" % sp.filename())
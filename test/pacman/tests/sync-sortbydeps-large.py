@@ -0,0 +1,30 @@
+self.description = "Sort a synthetic 500 package transaction by dependencies"
+
+# Each package depends on up to three later ones, some through a provision,
+# and a quarter of them are already installed.
+import random
+
+rng = random.Random(500)
+count = 500
+names = ["pkg%04d" % i for i in range(count)]
+
+for i, name in enumerate(names):
+	sp = pmpkg(name, "2.0-1")
+	for k in range(rng.randint(0, 3)):
+		j = rng.randrange(i, count)
+		if j != i:
+			sp.depends.append(names[j] if j % 7 else "virt%04d" % j)
+	if i % 7 == 0:
+		sp.provides = ["virt%04d" % i]
+	self.addpkg2db("sync", sp)
+	if i % 4 == 0:
+		lp = pmpkg(name)
+		lp.depends = list(sp.depends)
+		lp.provides = list(sp.provides)
+		self.addpkg2db("local", lp)
+
+self.args = "-Sp --print-format %%n %s" % " ".join(names[::2])
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^pkg0498$")
+self.addrule("!PACMAN_OUTPUT=dependency cycle detected")
@@ -0,0 +1,15 @@
+self.description = "Download the whole database when its delta index is unusable"
+
+self.option['UseDelta'] = ['0.7']
+
+sp = pmpkg("dummy")
+self.addpkg2db("sync", sp)
+
+# the file only contains its own name, which is no valid index
+self.filesystem = ["var/pub/sync/sync.db.deltas"]
+
+self.args = "-Sy %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("!FILE_EXIST=var/lib/pacman/sync/sync.db.deltas")
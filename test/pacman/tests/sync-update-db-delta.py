@@ -0,0 +1,69 @@
+self.description = "Update a database from a delta"
+
+import hashlib
+import io
+import os
+import shutil
+import subprocess
+import tarfile
+import tempfile
+
+import pmfile
+
+self.require_program("xdelta3")
+
+self.option['UseDelta'] = ['0.7']
+
+def dbtar(pkgs):
+    """An uncompressed sync database, as repo-add -D requires."""
+    data = io.BytesIO()
+    tar = tarfile.open(fileobj=data, mode="w")
+    for name, version in pkgs:
+        entry = "%s-%s" % (name, version)
+        info = tarfile.TarInfo(entry)
+        info.type = tarfile.DIRTYPE
+        tar.addfile(info)
+        desc = "%%FILENAME%%\n%s-any.pkg.tar.gz\n\n%%NAME%%\n%s\n\n" \
+                "%%VERSION%%\n%s\n\n" % (entry, name, version)
+        info = tarfile.TarInfo(entry + "/desc")
+        info.size = len(desc)
+        tar.addfile(info, io.BytesIO(desc))
+    tar.close()
+    return data.getvalue()
+
+old = dbtar([("dummy", "1.0-1"), ("other", "1.0-1")])
+new = dbtar([("dummy", "1.0-2"), ("other", "1.0-1")])
+oldsum = hashlib.sha256(old).hexdigest()
+newsum = hashlib.sha256(new).hexdigest()
+
+tmpdir = tempfile.mkdtemp()
+try:
+    for name, data in [("old", old), ("new", new)]:
+        with open(os.path.join(tmpdir, name), "wb") as f:
+            f.write(data)
+    subprocess.check_call(["xdelta3", "-e", "-q", "-9", "-f", "-D", "-s",
+        os.path.join(tmpdir, "old"), os.path.join(tmpdir, "new"),
+        os.path.join(tmpdir, "delta")])
+    with open(os.path.join(tmpdir, "delta"), "rb") as f:
+        delta = f.read()
+finally:
+    shutil.rmtree(tmpdir)
+
+# the databases written for these packages are replaced below
+self.addpkg2db("sync", pmpkg("dummy"))
+
+deltaname = "sync.db.%s.xdelta" % oldsum[:16]
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/sync/sync.db", old,
+    raw=True))
+self.filesystem.append(pmfile.pmfile("var/pub/sync/sync.db", new, raw=True))
+self.filesystem.append(pmfile.pmfile("var/pub/sync/" + deltaname, delta,
+    raw=True))
+self.filesystem.append(pmfile.pmfile("var/pub/sync/sync.db.deltas",
+    "%s %d\n%s %s %d %s\n" % (newsum, len(new), oldsum, newsum, len(delta),
+        deltaname)))
+
+self.args = "--debug -Sy"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=updated sync with 1 deltas")
+self.addrule("!FILE_EXIST=var/lib/pacman/sync/%s" % deltaname)
@@ -0,0 +1,37 @@
+self.description = "Download a database and its signature when the ETag changed"
+
+import time
+
+import pmfile
+import pmserver
+
+self.option["ScoreMirrors"] = [""]
+
+repo = self.rootdir() + "var/pub/sync"
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror",
+        etags={"sync.db": '"v2"'})
+
+sp = pmpkg("dummy")
+self.addpkg2db("sync", sp)
+self.db["sync"].option["SigLevel"] = ["Optional"]
+self.db["sync"].option["Server"] = [mirror.url]
+
+self.filesystem.append(pmfile.pmfile("var/pub/sync/sync.db.sig", "new"))
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/sync/sync.db.sig", "old"))
+
+# the copy the old ETag was received with, left as it was by the last -Sy
+self.filesystem.append("var/lib/pacman/sync/sync.db")
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/validators",
+    '%d 355 %s/sync.db "v1"' % (len("var/lib/pacman/sync/sync.db\n"),
+        mirror.url)))
+
+# keep the local server out of the way
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats",
+    "%d 5 20.000000 1000000 0.9500 file://%s" % (int(time.time()), repo)))
+
+self.args = "-Sy"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("FILE_MODIFIED=var/lib/pacman/sync/sync.db")
+self.addrule("FILE_EXIST=var/log/mirror/sync.db.sig")
+self.addrule("FILE_CONTENTS=var/lib/pacman/sync/sync.db.sig|new\n")
@@ -0,0 +1,31 @@
+self.description = "Ignore an ETag received with another copy of the database"
+
+import time
+
+import pmfile
+import pmserver
+
+self.option["ScoreMirrors"] = [""]
+
+repo = self.rootdir() + "var/pub/sync"
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror",
+        etags={"sync.db": '"v1"'})
+
+sp = pmpkg("dummy")
+self.addpkg2db("sync", sp)
+self.db["sync"].option["Server"] = [mirror.url]
+
+# the local copy was replaced after the ETag was received with it
+self.filesystem.append("var/lib/pacman/sync/sync.db")
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/validators",
+    '%d 300 %s/sync.db "v1"' % (len("var/lib/pacman/sync/sync.db\n"),
+        mirror.url)))
+
+# keep the local server out of the way
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats",
+    "%d 5 20.000000 1000000 0.9500 file://%s" % (int(time.time()), repo)))
+
+self.args = "-Sy"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("FILE_MODIFIED=var/lib/pacman/sync/sync.db")
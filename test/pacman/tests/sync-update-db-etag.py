@@ -0,0 +1,34 @@
+self.description = "Keep a database whose ETag did not change"
+
+import time
+
+import pmfile
+import pmserver
+
+self.option["ScoreMirrors"] = [""]
+
+# the mirror claims a newer database, but it still has the same ETag
+repo = self.rootdir() + "var/pub/sync"
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror",
+        mtimes={"sync.db": int(time.time())}, etags={"sync.db": '"v1"'})
+
+sp = pmpkg("dummy")
+self.addpkg2db("sync", sp)
+self.db["sync"].option["Server"] = [mirror.url]
+
+# the copy the ETag was received with, left as it was by the last -Sy
+self.filesystem.append("var/lib/pacman/sync/sync.db")
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/validators",
+    '%d 355 %s/sync.db "v1"' % (len("var/lib/pacman/sync/sync.db\n"),
+        mirror.url)))
+
+# keep the local server out of the way
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats",
+    "%d 5 20.000000 1000000 0.9500 file://%s" % (int(time.time()), repo)))
+
+self.args = "-Sy"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=sync is up to date")
+self.addrule("FILE_EXIST=var/log/mirror/sync.db")
+self.addrule("!FILE_MODIFIED=var/lib/pacman/sync/sync.db")
@@ -0,0 +1,32 @@
+self.description = "Fetch the signature of a changed database even if it looks old"
+
+import time
+
+import pmfile
+import pmserver
+
+self.option["ScoreMirrors"] = [""]
+
+# the mirror kept the times of its upstream, where the database was signed
+# an hour before our old signature was downloaded, and changed afterwards
+now = int(time.time())
+repo = self.rootdir() + "var/pub/sync"
+mirror = pmserver.pmserver(repo, self.rootdir() + "var/log/mirror",
+        mtimes={"sync.db": now + 3600, "sync.db.sig": now - 3600})
+
+sp = pmpkg("dummy")
+self.addpkg2db("sync", sp)
+self.db["sync"].option["SigLevel"] = ["Optional"]
+self.db["sync"].option["Server"] = [mirror.url]
+
+self.filesystem.append(pmfile.pmfile("var/pub/sync/sync.db.sig", "new"))
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/sync/sync.db.sig", "old"))
+
+# keep the local server out of the way
+self.filesystem.append(pmfile.pmfile("var/lib/pacman/mirrorstats",
+    "%d 5 20.000000 1000000 0.9500 file://%s" % (now, repo)))
+
+self.args = "-Sy"
+
+self.addrule("FILE_EXIST=var/log/mirror/sync.db.sig")
+self.addrule("FILE_CONTENTS=var/lib/pacman/sync/sync.db.sig|new\n")
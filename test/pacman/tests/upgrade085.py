@@ -0,0 +1,27 @@
+self.description = "Upgrade with CheckSpace using recorded file information without stat"
+
+import pmfile
+
+lp = pmpkg("dummy")
+lp.files = ["bin/dummy"]
+self.addpkg2db("local", lp)
+
+# replace the generated files entry with one carrying %FILEINFO%, listing a
+# file that is not on disk; its recorded size is used without looking
+self.filesystem.append(pmfile.pmfile(
+	"var/lib/pacman/local/dummy-1.0-1/files",
+	"%FILES%\nbin/\nbin/dummy\nbin/gone\n\n"
+	"%FILEINFO%\n40755 0\n100644 10\n100644 1048576\n"))
+
+p = pmpkg("dummy", "2.0-1")
+p.files = ["bin/dummy"]
+self.addpkg(p)
+
+self.option["CheckSpace"] = [""]
+
+self.args = "-U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=dummy|2.0-1")
+self.addrule("FILE_EXIST=bin/dummy")
+self.addrule("!PACMAN_OUTPUT=could not get file information for bin/gone")
@@ -0,0 +1,22 @@
+self.description = "Upgrade a package with files nested deeper than 33 directories"
+
+lp = pmpkg("dummy")
+lp.files = ["d/" * 35 + "old",
+            "d/" * 40 + "kept"]
+self.addpkg2db("local", lp)
+
+p = pmpkg("dummy", "2.0-1")
+p.files = ["d/" * 40 + "kept",
+           "d/" * 40 + "new",
+           "d/" * 36 + "new",
+           "d/" * 33 + "new",
+           "d/" * 34 + "new"]
+self.addpkg(p)
+
+self.args = "-U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=dummy|2.0-1")
+self.addrule("!FILE_EXIST=%s" % ("d/" * 35 + "old"))
+for f in p.files:
+	self.addrule("FILE_EXIST=%s" % f)
@@ -0,0 +1,21 @@
+self.description = "Install a package without backup files by creating them directly"
+
+p = pmpkg("dummy")
+p.files = ["bin/dummy|0755",
+           "bin/dummy-link -> dummy",
+           "usr/share/dummy/data",
+           "usr/share/dummy/setgid|2755"]
+self.addpkg(p)
+
+self.args = "--debug -U %s" % p.filename()
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("PACMAN_OUTPUT=created 4 new files directly")
+self.addrule("FILE_TYPE=bin/dummy|file")
+self.addrule("FILE_MODE=bin/dummy|755")
+self.addrule("FILE_TYPE=bin/dummy-link|link")
+self.addrule("LINK_EXIST=bin/dummy-link")
+self.addrule("FILE_CONTENTS=usr/share/dummy/data|usr/share/dummy/data\n")
+self.addrule("FILE_MODE=usr/share/dummy/data|644")
+self.addrule("FILE_MODE=usr/share/dummy/setgid|2755")
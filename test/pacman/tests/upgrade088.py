@@ -0,0 +1,34 @@
+self.description = "Only add packages extracted in full to the package store"
+
+import os
+
+import util
+
+self.filesystem = ["store/.keep",
+                   "etc/pkgb.conf"]
+self.option["StoreDir"] = [os.path.join(self.root, "store/")]
+self.option["NoUpgrade"] = ["etc/pkgb.conf"]
+
+p1 = pmpkg("pkga")
+p1.files = ["usr/bin/pkga"]
+self.addpkg(p1)
+
+# a NoUpgrade file already on disk is kept, so the root does not hold what
+# the package contains
+p2 = pmpkg("pkgb")
+p2.files = ["etc/pkgb.conf",
+            "usr/bin/pkgb"]
+self.addpkg(p2)
+
+self.args = "--debug -U --force %s" % " ".join(
+		[p.filename() for p in (p1, p2)])
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkga")
+self.addrule("PKG_EXIST=pkgb")
+self.addrule("FILE_PACNEW=etc/pkgb.conf")
+# without reflink support the store cannot hold anything
+if util.has_reflinks(self.root):
+    self.addrule("DIR_EXIST=store/%s" % p1.sha256sum())
+self.addrule("!DIR_EXIST=store/%s" % p2.sha256sum())
+self.addrule("!PACMAN_OUTPUT=add.* pkgb to the package store")
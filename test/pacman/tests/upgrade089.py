@@ -0,0 +1,33 @@
+self.description = "Only record stamps of files that were extracted"
+
+self.option["FileStamps"] = [""]
+self.option["NoUpgrade"] = ["etc/pkga.conf", "etc/pkgb.conf"]
+
+lp1 = pmpkg("pkga")
+lp1.files = ["etc/pkga.conf",
+             "usr/bin/pkga"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkgb")
+lp2.files = ["etc/pkgb.conf"]
+self.addpkg2db("local", lp2)
+
+p1 = pmpkg("pkga", "2.0-1")
+p1.files = ["etc/pkga.conf*",
+            "usr/bin/pkga*"]
+self.addpkg(p1)
+
+# the only file is kept, so nothing of pkgb was extracted
+p2 = pmpkg("pkgb", "2.0-1")
+p2.files = ["etc/pkgb.conf*"]
+self.addpkg(p2)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2)])
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=pkga|2.0-1")
+self.addrule("PKG_VERSION=pkgb|2.0-1")
+self.addrule("FILE_PACNEW=etc/pkga.conf")
+self.addrule("FILE_PACNEW=etc/pkgb.conf")
+self.addrule("FILE_EXIST=var/lib/pacman/local/pkga-2.0-1/stamps")
+self.addrule("!FILE_EXIST=var/lib/pacman/local/pkgb-2.0-1/stamps")
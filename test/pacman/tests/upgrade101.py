@@ -0,0 +1,35 @@
+self.description = "Indirect dependency ordering through a local package"
+
+# t1 -> t3 -> l -> t4 and t2 -> l; l is only installed locally
+lp = pmpkg("l")
+lp.depends = ["t4"]
+self.addpkg2db("local", lp)
+
+p1 = pmpkg("t1")
+p1.depends = ["t3"]
+p1.files = ["bin/t1"]
+p1.install['post_install'] = "[ -f bin/t3 ] && echo > found_t3"
+self.addpkg(p1)
+
+p2 = pmpkg("t2")
+p2.depends = ["l"]
+p2.files = ["bin/t2"]
+self.addpkg(p2)
+
+p3 = pmpkg("t3")
+p3.depends = ["l"]
+p3.files = ["bin/t3"]
+p3.install['post_install'] = "[ -f bin/t4 ] && echo > found_t4"
+self.addpkg(p3)
+
+p4 = pmpkg("t4")
+p4.files = ["bin/t4"]
+self.addpkg(p4)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2, p3, p4)])
+
+self.addrule("PACMAN_RETCODE=0")
+for p in p1, p2, p3, p4:
+	self.addrule("PKG_EXIST=%s" % p.name)
+self.addrule("FILE_EXIST=found_t3")
+self.addrule("FILE_EXIST=found_t4")
@@ -114,7 +114,8 @@ def mkcfgfile(filename, root, option, db):
     # Options
     data = ["[options]"]
     for key, value in option.items():
-        data.extend(["%s = %s" % (key, j) for j in value])
+        # an empty value writes a bare boolean option
+        data.extend(["%s = %s" % (key, j) if j else key for j in value])
 
     # Repositories
     # sort by repo name so tests can predict repo order, rather than be
@@ -169,6 +170,22 @@ def which(filename, path=None):
             return f
     return None
 
+def has_reflinks(path):
+    """Whether files in the directory can be cloned with FICLONE."""
+    import fcntl
+    import tempfile
+    FICLONE = 0x40049409
+    src = tempfile.TemporaryFile(dir=path)
+    dst = tempfile.TemporaryFile(dir=path)
+    try:
+        fcntl.ioctl(dst.fileno(), FICLONE, src.fileno())
+        return True
+    except (IOError, OSError):
+        return False
+    finally:
+        src.close()
+        dst.close()
+
 def grep(filename, pattern):
     pat = re.compile(pattern)
     myfile = open(filename, 'r')